@@ -0,0 +1,529 @@
+/*
+	CodePage
+	
+	Legacy code page conversion for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	Off Windows there is no console to convert to the Console Output Code Page, so these stand
+	in for MultiByteToWideChar() and WideCharToMultiByte().  Every one of these code pages is
+	ASCII in its lower half, so only the characters of the upper half are listed; the tables
+	for both directions are generated from those at compile time.  Bytes that Windows leaves
+	undefined decode to the C1 control character of the same value, as Windows does.
+	
+	Blocks of sixteen ASCII characters are converted with SSE2, where there is that.
+*/
+
+#include <cstdint>
+#include <cwchar>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CODEPAGE_X86
+#include <emmintrin.h>
+#endif
+
+#include "CodePage.h"
+#include "Transcode.h"
+
+
+
+/*	kCodePageUTF8
+	Code page that Windows calls UTF-8, which has no table
+*/
+enum { kCodePageUTF8 = 65001 };
+
+
+/*	kEncodeLimit
+	One past the highest character that any of the tables encode (U+25A0 BLACK SQUARE)
+*/
+enum { kEncodeLimit = 0x2600 };
+
+
+/*	kUnmappable
+	Byte written for a character that the code page doesn't have
+*/
+static const char kUnmappable = '?';
+
+
+/*	CodePageTables
+	Wide character of each byte, and byte of each wide character below kEncodeLimit (zero if
+	the code page doesn't have it, except for U+0000 itself)
+*/
+struct CodePageTables {
+	wchar_t		decode[256];
+	unsigned char	encode[kEncodeLimit];
+	};
+
+
+/*	MakeTables
+	Generate the tables of a code page from the characters of its upper half
+*/
+static constexpr CodePageTables MakeTables(
+	const char16_t	(&upper)[128]
+	)
+{
+CodePageTables tables {};
+
+for (unsigned byte = 0; byte < 0x80; byte++) {
+	tables.decode[byte] = (wchar_t) byte;
+	tables.encode[byte] = (unsigned char) byte;
+	}
+
+for (unsigned byte = 0x80; byte < 0x100; byte++) {
+	const char16_t c = upper[byte - 0x80];
+	tables.decode[byte] = (wchar_t) c;
+	
+	/* where two bytes decode to the same character, the first encodes it */
+	if (c < kEncodeLimit && !tables.encode[c]) tables.encode[c] = (unsigned char) byte;
+	}
+
+return tables;
+}
+
+
+/*	kCP437
+	Upper half of code page 437 (OEM United States)
+*/
+static constexpr char16_t kCP437[128] = {
+	/* 80 */	0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7,
+	/* 88 */	0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+	/* 90 */	0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9,
+	/* 98 */	0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+	/* A0 */	0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA,
+	/* A8 */	0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+	/* B0 */	0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556,
+	/* B8 */	0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+	/* C0 */	0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F,
+	/* C8 */	0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+	/* D0 */	0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B,
+	/* D8 */	0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+	/* E0 */	0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4,
+	/* E8 */	0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+	/* F0 */	0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248,
+	/* F8 */	0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0
+	};
+
+static constexpr CodePageTables gCP437Tables = MakeTables(kCP437);
+
+
+/*	kCP850
+	Upper half of code page 850 (OEM Multilingual Latin 1)
+*/
+static constexpr char16_t kCP850[128] = {
+	/* 80 */	0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7,
+	/* 88 */	0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+	/* 90 */	0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9,
+	/* 98 */	0x00FF, 0x00D6, 0x00DC, 0x00F8, 0x00A3, 0x00D8, 0x00D7, 0x0192,
+	/* A0 */	0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA,
+	/* A8 */	0x00BF, 0x00AE, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+	/* B0 */	0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x00C1, 0x00C2, 0x00C0,
+	/* B8 */	0x00A9, 0x2563, 0x2551, 0x2557, 0x255D, 0x00A2, 0x00A5, 0x2510,
+	/* C0 */	0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x00E3, 0x00C3,
+	/* C8 */	0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x00A4,
+	/* D0 */	0x00F0, 0x00D0, 0x00CA, 0x00CB, 0x00C8, 0x0131, 0x00CD, 0x00CE,
+	/* D8 */	0x00CF, 0x2518, 0x250C, 0x2588, 0x2584, 0x00A6, 0x00CC, 0x2580,
+	/* E0 */	0x00D3, 0x00DF, 0x00D4, 0x00D2, 0x00F5, 0x00D5, 0x00B5, 0x00FE,
+	/* E8 */	0x00DE, 0x00DA, 0x00DB, 0x00D9, 0x00FD, 0x00DD, 0x00AF, 0x00B4,
+	/* F0 */	0x00AD, 0x00B1, 0x2017, 0x00BE, 0x00B6, 0x00A7, 0x00F7, 0x00B8,
+	/* F8 */	0x00B0, 0x00A8, 0x00B7, 0x00B9, 0x00B3, 0x00B2, 0x25A0, 0x00A0
+	};
+
+static constexpr CodePageTables gCP850Tables = MakeTables(kCP850);
+
+
+/*	kCP866
+	Upper half of code page 866 (OEM Russian)
+*/
+static constexpr char16_t kCP866[128] = {
+	/* 80 */	0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,
+	/* 88 */	0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E, 0x041F,
+	/* 90 */	0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,
+	/* 98 */	0x0428, 0x0429, 0x042A, 0x042B, 0x042C, 0x042D, 0x042E, 0x042F,
+	/* A0 */	0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
+	/* A8 */	0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F,
+	/* B0 */	0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556,
+	/* B8 */	0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+	/* C0 */	0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F,
+	/* C8 */	0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+	/* D0 */	0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B,
+	/* D8 */	0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+	/* E0 */	0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
+	/* E8 */	0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F,
+	/* F0 */	0x0401, 0x0451, 0x0404, 0x0454, 0x0407, 0x0457, 0x040E, 0x045E,
+	/* F8 */	0x00B0, 0x2219, 0x00B7, 0x221A, 0x2116, 0x00A4, 0x25A0, 0x00A0
+	};
+
+static constexpr CodePageTables gCP866Tables = MakeTables(kCP866);
+
+
+/*	kCP1250
+	Upper half of code page 1250 (ANSI Central European)
+*/
+static constexpr char16_t kCP1250[128] = {
+	/* 80 */	0x20AC, 0x0081, 0x201A, 0x0083, 0x201E, 0x2026, 0x2020, 0x2021,
+	/* 88 */	0x0088, 0x2030, 0x0160, 0x2039, 0x015A, 0x0164, 0x017D, 0x0179,
+	/* 90 */	0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+	/* 98 */	0x0098, 0x2122, 0x0161, 0x203A, 0x015B, 0x0165, 0x017E, 0x017A,
+	/* A0 */	0x00A0, 0x02C7, 0x02D8, 0x0141, 0x00A4, 0x0104, 0x00A6, 0x00A7,
+	/* A8 */	0x00A8, 0x00A9, 0x015E, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x017B,
+	/* B0 */	0x00B0, 0x00B1, 0x02DB, 0x0142, 0x00B4, 0x00B5, 0x00B6, 0x00B7,
+	/* B8 */	0x00B8, 0x0105, 0x015F, 0x00BB, 0x013D, 0x02DD, 0x013E, 0x017C,
+	/* C0 */	0x0154, 0x00C1, 0x00C2, 0x0102, 0x00C4, 0x0139, 0x0106, 0x00C7,
+	/* C8 */	0x010C, 0x00C9, 0x0118, 0x00CB, 0x011A, 0x00CD, 0x00CE, 0x010E,
+	/* D0 */	0x0110, 0x0143, 0x0147, 0x00D3, 0x00D4, 0x0150, 0x00D6, 0x00D7,
+	/* D8 */	0x0158, 0x016E, 0x00DA, 0x0170, 0x00DC, 0x00DD, 0x0162, 0x00DF,
+	/* E0 */	0x0155, 0x00E1, 0x00E2, 0x0103, 0x00E4, 0x013A, 0x0107, 0x00E7,
+	/* E8 */	0x010D, 0x00E9, 0x0119, 0x00EB, 0x011B, 0x00ED, 0x00EE, 0x010F,
+	/* F0 */	0x0111, 0x0144, 0x0148, 0x00F3, 0x00F4, 0x0151, 0x00F6, 0x00F7,
+	/* F8 */	0x0159, 0x016F, 0x00FA, 0x0171, 0x00FC, 0x00FD, 0x0163, 0x02D9
+	};
+
+static constexpr CodePageTables gCP1250Tables = MakeTables(kCP1250);
+
+
+/*	kCP1251
+	Upper half of code page 1251 (ANSI Cyrillic)
+*/
+static constexpr char16_t kCP1251[128] = {
+	/* 80 */	0x0402, 0x0403, 0x201A, 0x0453, 0x201E, 0x2026, 0x2020, 0x2021,
+	/* 88 */	0x20AC, 0x2030, 0x0409, 0x2039, 0x040A, 0x040C, 0x040B, 0x040F,
+	/* 90 */	0x0452, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+	/* 98 */	0x0098, 0x2122, 0x0459, 0x203A, 0x045A, 0x045C, 0x045B, 0x045F,
+	/* A0 */	0x00A0, 0x040E, 0x045E, 0x0408, 0x00A4, 0x0490, 0x00A6, 0x00A7,
+	/* A8 */	0x0401, 0x00A9, 0x0404, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x0407,
+	/* B0 */	0x00B0, 0x00B1, 0x0406, 0x0456, 0x0491, 0x00B5, 0x00B6, 0x00B7,
+	/* B8 */	0x0451, 0x2116, 0x0454, 0x00BB, 0x0458, 0x0405, 0x0455, 0x0457,
+	/* C0 */	0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,
+	/* C8 */	0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E, 0x041F,
+	/* D0 */	0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,
+	/* D8 */	0x0428, 0x0429, 0x042A, 0x042B, 0x042C, 0x042D, 0x042E, 0x042F,
+	/* E0 */	0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
+	/* E8 */	0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F,
+	/* F0 */	0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
+	/* F8 */	0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F
+	};
+
+static constexpr CodePageTables gCP1251Tables = MakeTables(kCP1251);
+
+
+/*	kCP1252
+	Upper half of code page 1252 (ANSI Latin 1)
+*/
+static constexpr char16_t kCP1252[128] = {
+	/* 80 */	0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+	/* 88 */	0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+	/* 90 */	0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+	/* 98 */	0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178,
+	/* A0 */	0x00A0, 0x00A1, 0x00A2, 0x00A3, 0x00A4, 0x00A5, 0x00A6, 0x00A7,
+	/* A8 */	0x00A8, 0x00A9, 0x00AA, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x00AF,
+	/* B0 */	0x00B0, 0x00B1, 0x00B2, 0x00B3, 0x00B4, 0x00B5, 0x00B6, 0x00B7,
+	/* B8 */	0x00B8, 0x00B9, 0x00BA, 0x00BB, 0x00BC, 0x00BD, 0x00BE, 0x00BF,
+	/* C0 */	0x00C0, 0x00C1, 0x00C2, 0x00C3, 0x00C4, 0x00C5, 0x00C6, 0x00C7,
+	/* C8 */	0x00C8, 0x00C9, 0x00CA, 0x00CB, 0x00CC, 0x00CD, 0x00CE, 0x00CF,
+	/* D0 */	0x00D0, 0x00D1, 0x00D2, 0x00D3, 0x00D4, 0x00D5, 0x00D6, 0x00D7,
+	/* D8 */	0x00D8, 0x00D9, 0x00DA, 0x00DB, 0x00DC, 0x00DD, 0x00DE, 0x00DF,
+	/* E0 */	0x00E0, 0x00E1, 0x00E2, 0x00E3, 0x00E4, 0x00E5, 0x00E6, 0x00E7,
+	/* E8 */	0x00E8, 0x00E9, 0x00EA, 0x00EB, 0x00EC, 0x00ED, 0x00EE, 0x00EF,
+	/* F0 */	0x00F0, 0x00F1, 0x00F2, 0x00F3, 0x00F4, 0x00F5, 0x00F6, 0x00F7,
+	/* F8 */	0x00F8, 0x00F9, 0x00FA, 0x00FB, 0x00FC, 0x00FD, 0x00FE, 0x00FF
+	};
+
+static constexpr CodePageTables gCP1252Tables = MakeTables(kCP1252);
+
+
+/*	kCP28591
+	Upper half of code page 28591 (ISO 8859-1 Latin 1)
+*/
+static constexpr char16_t kCP28591[128] = {
+	/* 80 */	0x0080, 0x0081, 0x0082, 0x0083, 0x0084, 0x0085, 0x0086, 0x0087,
+	/* 88 */	0x0088, 0x0089, 0x008A, 0x008B, 0x008C, 0x008D, 0x008E, 0x008F,
+	/* 90 */	0x0090, 0x0091, 0x0092, 0x0093, 0x0094, 0x0095, 0x0096, 0x0097,
+	/* 98 */	0x0098, 0x0099, 0x009A, 0x009B, 0x009C, 0x009D, 0x009E, 0x009F,
+	/* A0 */	0x00A0, 0x00A1, 0x00A2, 0x00A3, 0x00A4, 0x00A5, 0x00A6, 0x00A7,
+	/* A8 */	0x00A8, 0x00A9, 0x00AA, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x00AF,
+	/* B0 */	0x00B0, 0x00B1, 0x00B2, 0x00B3, 0x00B4, 0x00B5, 0x00B6, 0x00B7,
+	/* B8 */	0x00B8, 0x00B9, 0x00BA, 0x00BB, 0x00BC, 0x00BD, 0x00BE, 0x00BF,
+	/* C0 */	0x00C0, 0x00C1, 0x00C2, 0x00C3, 0x00C4, 0x00C5, 0x00C6, 0x00C7,
+	/* C8 */	0x00C8, 0x00C9, 0x00CA, 0x00CB, 0x00CC, 0x00CD, 0x00CE, 0x00CF,
+	/* D0 */	0x00D0, 0x00D1, 0x00D2, 0x00D3, 0x00D4, 0x00D5, 0x00D6, 0x00D7,
+	/* D8 */	0x00D8, 0x00D9, 0x00DA, 0x00DB, 0x00DC, 0x00DD, 0x00DE, 0x00DF,
+	/* E0 */	0x00E0, 0x00E1, 0x00E2, 0x00E3, 0x00E4, 0x00E5, 0x00E6, 0x00E7,
+	/* E8 */	0x00E8, 0x00E9, 0x00EA, 0x00EB, 0x00EC, 0x00ED, 0x00EE, 0x00EF,
+	/* F0 */	0x00F0, 0x00F1, 0x00F2, 0x00F3, 0x00F4, 0x00F5, 0x00F6, 0x00F7,
+	/* F8 */	0x00F8, 0x00F9, 0x00FA, 0x00FB, 0x00FC, 0x00FD, 0x00FE, 0x00FF
+	};
+
+static constexpr CodePageTables gCP28591Tables = MakeTables(kCP28591);
+
+
+/* the built-in narrow sample is the wide one in code page 437 */
+static_assert(gCP437Tables.encode[0x256C] == 0xCE && gCP437Tables.encode[0x03B4] == 0xEB, "code page 437 table is wrong");
+static_assert(gCP1252Tables.decode[0x80] == 0x20AC && gCP1252Tables.encode[0x20AC] == 0x80, "code page 1252 table is wrong");
+
+
+/*	gCodePages
+	Tables of each code page
+*/
+static const struct {
+	unsigned int	number;
+	const CodePageTables *tables;
+	} gCodePages[] = {
+	{ 437, &gCP437Tables },
+	{ 850, &gCP850Tables },
+	{ 866, &gCP866Tables },
+	{ 1250, &gCP1250Tables },
+	{ 1251, &gCP1251Tables },
+	{ 1252, &gCP1252Tables },
+	{ 28591, &gCP28591Tables }
+	};
+
+
+/*	gCodePageNames
+	Code pages known, for messages
+*/
+extern "C" const char gCodePageNames[] = "437, 850, 866, 1250, 1251, 1252, 28591, 65001";
+
+
+/*	FindCodePage
+	Tables of the given code page
+	Return NULL if there are none
+*/
+static const CodePageTables *FindCodePage(
+	unsigned int	codePage
+	)
+{
+for (const auto &entry : gCodePages)
+	if (entry.number == codePage) return entry.tables;
+
+return NULL;
+}
+
+
+/*	IsCodePageKnown
+	Whether the code page is converted
+*/
+extern "C"
+bool IsCodePageKnown(
+	unsigned int	codePage
+	)
+{
+return codePage == kCodePageUTF8 || FindCodePage(codePage);
+}
+
+
+/*	CodePageBound
+	Largest number of bytes produced by encoding the given number of wide characters
+*/
+extern "C"
+size_t CodePageBound(
+	unsigned int	codePage,
+	size_t		length
+	)
+{
+return codePage == kCodePageUTF8 ? EncodeBound(kEncodingUTF8, length) : length;
+}
+
+
+#ifdef CODEPAGE_X86
+
+/*	PackASCII
+	Store sixteen wide characters as bytes, if they are all ASCII
+	Return whether they were
+*/
+static inline bool PackASCII(
+	const wchar_t	*input,
+	char		*output
+	)
+{
+#if WCHAR_MAX > 0xFFFF
+const __m128i
+	v0 = _mm_loadu_si128((const __m128i*) input),
+	v1 = _mm_loadu_si128((const __m128i*) input + 1),
+	v2 = _mm_loadu_si128((const __m128i*) input + 2),
+	v3 = _mm_loadu_si128((const __m128i*) input + 3),
+	nonASCII = _mm_and_si128(_mm_or_si128(_mm_or_si128(v0, v1), _mm_or_si128(v2, v3)), _mm_set1_epi32(~0x7F));
+if (_mm_movemask_epi8(_mm_cmpeq_epi32(nonASCII, _mm_setzero_si128())) != 0xFFFF) return false;
+
+_mm_storeu_si128((__m128i*) output, _mm_packus_epi16(_mm_packs_epi32(v0, v1), _mm_packs_epi32(v2, v3)));
+
+#else
+const __m128i
+	v0 = _mm_loadu_si128((const __m128i*) input),
+	v1 = _mm_loadu_si128((const __m128i*) input + 1),
+	nonASCII = _mm_and_si128(_mm_or_si128(v0, v1), _mm_set1_epi16(~0x7F));
+if (_mm_movemask_epi8(_mm_cmpeq_epi16(nonASCII, _mm_setzero_si128())) != 0xFFFF) return false;
+
+_mm_storeu_si128((__m128i*) output, _mm_packus_epi16(v0, v1));
+#endif
+
+return true;
+}
+
+
+/*	UnpackASCII
+	Store sixteen bytes as wide characters, if they are all ASCII
+	Return whether they were
+*/
+static inline bool UnpackASCII(
+	const char	*input,
+	wchar_t		*output
+	)
+{
+const __m128i v = _mm_loadu_si128((const __m128i*) input);
+if (_mm_movemask_epi8(v) != 0) return false;
+
+const __m128i
+	zero = _mm_setzero_si128(),
+	low = _mm_unpacklo_epi8(v, zero),
+	high = _mm_unpackhi_epi8(v, zero);
+
+#if WCHAR_MAX > 0xFFFF
+_mm_storeu_si128((__m128i*) output, _mm_unpacklo_epi16(low, zero));
+_mm_storeu_si128((__m128i*) output + 1, _mm_unpackhi_epi16(low, zero));
+_mm_storeu_si128((__m128i*) output + 2, _mm_unpacklo_epi16(high, zero));
+_mm_storeu_si128((__m128i*) output + 3, _mm_unpackhi_epi16(high, zero));
+
+#else
+_mm_storeu_si128((__m128i*) output, low);
+_mm_storeu_si128((__m128i*) output + 1, high);
+#endif
+
+return true;
+}
+
+#endif
+
+
+/*	EncodeCharacters
+	Encode wide characters by table, a character at a time
+	Return the number of bytes produced
+*/
+static size_t EncodeCharacters(
+	const CodePageTables &tables,
+	const wchar_t	*input,
+	size_t		length,
+	char		*output,
+	size_t		&unmappable
+	)
+{
+char *o = output;
+const wchar_t *const inpute = input + length;
+
+while (input < inpute) {
+	const uint32_t c = (uint32_t) *input++;
+	
+	if (c < kEncodeLimit && (tables.encode[c] || !c))
+		*o++ = (char) tables.encode[c];
+	
+	else {
+		/* a surrogate pair is still only one character */
+		if (c >= 0xD800 && c < 0xDC00 && input < inpute && (uint32_t) *input >= 0xDC00 && (uint32_t) *input < 0xE000)
+			input++;
+		
+		*o++ = kUnmappable;
+		unmappable++;
+		}
+	}
+
+return o - output;
+}
+
+
+/*	EncodeCodePage
+	Encode wide characters in the code page
+*/
+extern "C"
+size_t EncodeCodePage(
+	unsigned int	codePage,
+	const wchar_t	*input,
+	size_t		length,
+	char		*output,
+	size_t		*unmappable
+	)
+{
+size_t count = 0;
+
+if (codePage == kCodePageUTF8) {
+	if (unmappable) *unmappable = 0;
+	return EncodeSIMD(kEncodingUTF8, input, length, output);
+	}
+
+const CodePageTables *const tables = FindCodePage(codePage);
+if (!tables) return 0;
+
+char *o = output;
+const wchar_t *const inpute = input + length;
+
+#ifdef CODEPAGE_X86
+while (inpute - input >= 16) {
+	if (PackASCII(input, o)) {
+		input += 16;
+		o += 16;
+		continue;
+		}
+	
+	// don't split a surrogate pair at the end of the block
+	size_t block = 16;
+	if (inpute - input > 16 && (uint32_t) input[block - 1] >= 0xD800 && (uint32_t) input[block - 1] < 0xDC00) block++;
+	
+	o += EncodeCharacters(*tables, input, block, o, count);
+	input += block;
+	}
+#endif
+
+// remainder
+o += EncodeCharacters(*tables, input, inpute - input, o, count);
+
+if (unmappable) *unmappable = count;
+
+return o - output;
+}
+
+
+/*	DecodeCodePage
+	Decode text in the code page into wide characters
+*/
+extern "C"
+size_t DecodeCodePage(
+	unsigned int	codePage,
+	const char	*input,
+	size_t		length,
+	wchar_t		*output
+	)
+{
+if (codePage == kCodePageUTF8)
+	return DecodeUTF8(input, length, output);
+
+const CodePageTables *const tables = FindCodePage(codePage);
+if (!tables) return 0;
+
+size_t i = 0;
+
+#ifdef CODEPAGE_X86
+for (; length - i >= 16; i += 16)
+	if (!UnpackASCII(input + i, output + i))
+		for (size_t j = i; j < i + 16; j++)
+			output[j] = tables->decode[(unsigned char) input[j]];
+#endif
+
+// remainder
+for (; i < length; i++)
+	output[i] = tables->decode[(unsigned char) input[i]];
+
+return length;
+}
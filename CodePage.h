@@ -0,0 +1,72 @@
+/*
+	CodePage.h
+	
+	Legacy code page conversion for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <wchar.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	gCodePageNames
+	Code pages that EncodeCodePage() and DecodeCodePage() know, for messages
+*/
+extern const char gCodePageNames[];
+
+
+/*	IsCodePageKnown
+	Whether EncodeCodePage() and DecodeCodePage() know the given code page
+*/
+extern bool IsCodePageKnown(unsigned int codePage);
+
+
+/*	CodePageBound
+	Largest number of bytes that encoding the given number of wide characters in the code page
+	can produce
+*/
+extern size_t CodePageBound(unsigned int codePage, size_t length);
+
+
+/*	EncodeCodePage
+	Encode wide characters in the given code page into the buffer, which must be at least
+	CodePageBound() bytes; as WideCharToMultiByte() does without best fit, each character that the
+	code page doesn't have becomes '?', and is counted in 'unmappable' if that isn't NULL
+	Return the number of bytes produced
+*/
+extern size_t EncodeCodePage(unsigned int codePage, const wchar_t *input, size_t length, char *output, size_t *unmappable);
+
+
+/*	DecodeCodePage
+	Decode text in the given code page into wide characters; the buffer must have room for as
+	many wide characters as there are bytes
+	Return the number of wide characters produced
+*/
+extern size_t DecodeCodePage(unsigned int codePage, const char *input, size_t length, wchar_t *output);
+
+
+#ifdef __cplusplus
+	}
+#endif
@@ -0,0 +1,344 @@
+/*
+	Codecvt
+	
+	Character set conversion facet for the wide-character C++ streams of
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	A file stream hands its codecvt facet the whole of its buffer at once, but the standard
+	std::codecvt_utf8 and std::codecvt_utf16 then convert it one character at a time; this
+	facet passes the buffer to the same transcoder that the 'simd' method uses instead.
+	Unpaired surrogates become U+FFFD, as they do there, where the standard facets fail.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "Codecvt.h"
+#include "Locales.h"
+
+
+
+/* the pending surrogate is kept in the otherwise opaque mbstate_t */
+static_assert(sizeof(std::mbstate_t) >= sizeof(uint32_t), "mbstate_t can't hold a surrogate");
+
+
+/*	GetPending, SetPending
+	High surrogate held over from the end of the previous buffer (zero, as the state is
+	initially, if there is none)
+*/
+static uint32_t GetPending(const std::mbstate_t &state) { uint32_t pending; memcpy(&pending, &state, sizeof pending); return pending; }
+static void SetPending(std::mbstate_t &state, uint32_t pending) { memcpy(&state, &pending, sizeof pending); }
+
+
+/*	IsHighSurrogate, IsLowSurrogate
+	Whether the wide character is the first or second half of a surrogate pair
+*/
+static bool IsHighSurrogate(wchar_t c) { return (uint32_t) c >= 0xD800 && (uint32_t) c < 0xDC00; }
+static bool IsLowSurrogate(wchar_t c) { return (uint32_t) c >= 0xDC00 && (uint32_t) c < 0xE000; }
+
+
+/*	UnicodeCodecvt
+	Facet producing the given encoding
+*/
+UnicodeCodecvt::UnicodeCodecvt(
+	enum Encoding	encoding,
+	size_t		refs
+	) :
+	std::codecvt<wchar_t, char, std::mbstate_t>(refs),
+	encoding(encoding)
+{
+}
+
+
+/*	do_out
+	Convert as much of the wide characters as there is room for
+*/
+std::codecvt_base::result UnicodeCodecvt::do_out(
+	state_type	&state,
+	const intern_type *from,
+	const intern_type *fromEnd,
+	const intern_type *&fromNext,
+	extern_type	*to,
+	extern_type	*toEnd,
+	extern_type	*&toNext
+	) const
+{
+fromNext = from;
+toNext = to;
+
+// complete the surrogate pair begun at the end of the previous buffer
+if (const uint32_t pending = GetPending(state)) {
+	if (from == fromEnd) return ok;
+	
+	const wchar_t pair[2] = { (wchar_t) pending, *from };
+	const size_t units = IsLowSurrogate(*from) ? 2 : 1;
+	char bytes[8];
+	const size_t length = Encode(encoding, pair, units, bytes);
+	if ((size_t) (toEnd - toNext) < length) return partial;
+	
+	memcpy(toNext, bytes, length);
+	toNext += length;
+	fromNext += units - 1;
+	SetPending(state, 0);
+	}
+
+// hold back a high surrogate whose partner is still to come
+const intern_type *end = fromEnd;
+if (end > fromNext && IsHighSurrogate(end[-1])) end--;
+
+// convert as much as is sure to fit in one go
+size_t count = end - fromNext;
+if (EncodeBound(encoding, count) > (size_t) (toEnd - toNext)) {
+	count = (toEnd - toNext) / EncodeBound(encoding, 1);
+	if (count && IsHighSurrogate(fromNext[count - 1])) count--;
+	}
+
+toNext += EncodeSIMD(encoding, fromNext, count, toNext);
+fromNext += count;
+
+// then a character at a time, into whatever room is left
+while (fromNext < end) {
+	const size_t units = IsHighSurrogate(*fromNext) && fromNext + 1 < end ? 2 : 1;
+	char bytes[8];
+	const size_t length = Encode(encoding, fromNext, units, bytes);
+	if ((size_t) (toEnd - toNext) < length) return partial;
+	
+	memcpy(toNext, bytes, length);
+	toNext += length;
+	fromNext += units;
+	}
+
+if (end < fromEnd) {
+	SetPending(state, (uint32_t) *end);
+	fromNext = fromEnd;
+	}
+
+return ok;
+}
+
+
+/*	do_in
+	Input isn't supported
+*/
+std::codecvt_base::result UnicodeCodecvt::do_in(
+	state_type	&,
+	const extern_type *from,
+	const extern_type *,
+	const extern_type *&fromNext,
+	intern_type	*to,
+	intern_type	*,
+	intern_type	*&toNext
+	) const
+{
+fromNext = from;
+toNext = to;
+
+return error;
+}
+
+
+/*	do_unshift
+	Finish the output; a high surrogate still held over has no partner and becomes U+FFFD
+*/
+std::codecvt_base::result UnicodeCodecvt::do_unshift(
+	state_type	&state,
+	extern_type	*to,
+	extern_type	*toEnd,
+	extern_type	*&toNext
+	) const
+{
+toNext = to;
+
+const wchar_t pending = (wchar_t) GetPending(state);
+if (!pending) return noconv;
+
+char bytes[8];
+const size_t length = Encode(encoding, &pending, 1, bytes);
+if ((size_t) (toEnd - toNext) < length) return partial;
+
+memcpy(toNext, bytes, length);
+toNext += length;
+SetPending(state, 0);
+
+return ok;
+}
+
+
+/*	do_encoding
+	The number of bytes per character varies
+*/
+int UnicodeCodecvt::do_encoding() const noexcept
+{
+return 0;
+}
+
+
+/*	do_always_noconv
+	There is always a conversion
+*/
+bool UnicodeCodecvt::do_always_noconv() const noexcept
+{
+return false;
+}
+
+
+/*	do_length
+	Input isn't supported
+*/
+int UnicodeCodecvt::do_length(
+	state_type	&,
+	const extern_type *,
+	const extern_type *,
+	size_t
+	) const
+{
+return 0;
+}
+
+
+/*	do_max_length
+	Most bytes that one wide character can produce
+*/
+int UnicodeCodecvt::do_max_length() const noexcept
+{
+return (int) EncodeBound(encoding, 1);
+}
+
+
+/*	kCodecvtMinimumInput
+	Number of wide characters a short sample is repeated up to, so that each call converts enough
+	for the per-call overhead not to matter
+*/
+enum { kCodecvtMinimumInput = 64 << 10 };
+
+
+/*	kCodecvtBenchSeconds
+	Minimum time spent measuring each facet
+*/
+static const double kCodecvtBenchSeconds = 0.2;
+
+
+/*	gCodecvtEncodings
+	Encodings compared, and their names
+*/
+static const struct {
+	enum Encoding	encoding;
+	const char	*name;
+	} gCodecvtEncodings[] = {
+	{ kEncodingUTF8, "utf-8" },
+	{ kEncodingUTF16LE, "utf-16le" },
+	{ kEncodingUTF16BE, "utf-16be" },
+	{ kEncodingUTF32LE, "utf-32le" }
+	};
+
+
+/*	MeasureFacet
+	Convert the input with the facet repeatedly, one call each time
+	Return the throughput in MB/s of input, or 0 if the facet failed
+*/
+static double MeasureFacet(
+	const std::codecvt<wchar_t, char, std::mbstate_t> &facet,
+	const std::vector<wchar_t> &input,
+	std::vector<char> &output,
+	size_t		&length
+	)
+{
+const wchar_t *const inpute = input.data() + input.size();
+
+unsigned long long count = 0;
+const double start = Now();
+double elapsed;
+do {
+	std::mbstate_t state {};
+	const wchar_t *inputNext;
+	char *outputNext;
+	if (facet.out(state, input.data(), inpute, inputNext, output.data(), output.data() + output.size(), outputNext) != std::codecvt_base::ok ||
+		inputNext != inpute)
+		return 0;
+	
+	length = outputNext - output.data();
+	count++;
+	} while ((elapsed = Now() - start) < kCodecvtBenchSeconds);
+
+return count * input.size() * sizeof(wchar_t) / elapsed / 1e6;
+}
+
+
+/*	BenchmarkCodecvt
+	Print the throughput of the standard and project codecvt facets converting the sample
+*/
+extern "C"
+bool BenchmarkCodecvt(
+	const struct Sample *sample
+	)
+{
+if (!sample->wideLength) {
+	fprintf(stderr, "error: sample is empty\n");
+	return true;
+	}
+
+// repeat a short sample
+std::vector<wchar_t> input;
+do input.insert(input.end(), sample->wide, sample->wide + sample->wideLength);
+while (input.size() < kCodecvtMinimumInput);
+
+bool failed = false;
+
+printf("# MB/s of input converted by codecvt::out(), %zu wide characters at a time (%s)\n", input.size(), GetSIMDKernelName());
+printf("%-10s %10s %10s %10s\n", "encoding", "standard", "project", "speedup");
+
+for (const auto &entry : gCodecvtEncodings) {
+	std::vector<char> standardOutput(EncodeBound(entry.encoding, input.size())), projectOutput(standardOutput.size());
+	size_t standardLength = 0, projectLength = 0;
+	
+	// not every encoding has a standard facet
+	double standard = 0;
+	try {
+		const std::locale locale = GetLocale(NULL, entry.encoding, kFacetStandard);
+		standard = MeasureFacet(std::use_facet<std::codecvt<wchar_t, char, std::mbstate_t>>(locale), input, standardOutput, standardLength);
+		}
+	
+	catch (const char[]) {
+		}
+	
+	const std::locale locale = GetLocale(NULL, entry.encoding, kFacetProject);
+	const double project = MeasureFacet(std::use_facet<std::codecvt<wchar_t, char, std::mbstate_t>>(locale), input, projectOutput, projectLength);
+	
+	char standardText[16] = "-", speedupText[16] = "-";
+	if (standard > 0) {
+		snprintf(standardText, sizeof standardText, "%.1f", standard);
+		snprintf(speedupText, sizeof speedupText, "%.2fx", project / standard);
+		}
+	
+	printf("%-10s %10s %10.1f %10s\n", entry.name, standardText, project, speedupText);
+	fflush(stdout);
+	
+	// the two have to agree where the standard one could convert the sample at all
+	if (standard > 0 && (standardLength != projectLength || memcmp(standardOutput.data(), projectOutput.data(), projectLength) != 0)) {
+		fprintf(stderr, "error: project facet output differs from the standard facet's for %s\n", entry.name);
+		failed = true;
+		}
+	}
+
+return failed;
+}
@@ -0,0 +1,70 @@
+/*
+	Codecvt.h
+	
+	Character set conversion facet for the wide-character C++ streams of
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "Transcode.h"
+
+#ifdef __cplusplus
+#include <cwchar>
+#include <locale>
+
+
+/*	UnicodeCodecvt
+	Replacement for std::codecvt_utf8 and std::codecvt_utf16 that converts the whole buffer
+	handed to it at once (with the vectorized transcoder, where there is one) rather than a
+	character at a time; a high surrogate at the end of the buffer is held in the mbstate_t
+	until the next one.  Only output is supported
+*/
+class UnicodeCodecvt : public std::codecvt<wchar_t, char, std::mbstate_t> {
+public:
+	explicit UnicodeCodecvt(enum Encoding, size_t refs = 0);
+
+protected:
+	result do_out(state_type&, const intern_type *from, const intern_type *fromEnd, const intern_type *&fromNext, extern_type *to, extern_type *toEnd, extern_type *&toNext) const override;
+	result do_in(state_type&, const extern_type *from, const extern_type *fromEnd, const extern_type *&fromNext, intern_type *to, intern_type *toEnd, intern_type *&toNext) const override;
+	result do_unshift(state_type&, extern_type *to, extern_type *toEnd, extern_type *&toNext) const override;
+	int do_encoding() const noexcept override;
+	bool do_always_noconv() const noexcept override;
+	int do_length(state_type&, const extern_type *from, const extern_type *fromEnd, size_t max) const override;
+	int do_max_length() const noexcept override;
+
+private:
+	const enum Encoding encoding;
+	};
+
+extern "C" {
+#endif
+
+
+/*	BenchmarkCodecvt
+	Print the throughput of the standard and project codecvt facets converting the sample
+	Return whether the call failed
+*/
+extern bool BenchmarkCodecvt(const struct Sample*);
+
+
+#ifdef __cplusplus
+	}
+#endif
@@ -0,0 +1,268 @@
+/*
+	Counters
+	
+	Hardware performance counters around the tests of
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	Each event is opened on its own rather than as a group, so that one the processor or the
+	kernel won't count (in a virtual machine, say) doesn't take the others with it; and the
+	kernel's own share is only counted where perf_event_paranoid allows it.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* perf_event_open() has no C library wrapper; only the kernel's header is needed */
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/perf_event.h>)
+#define HAVE_PERF_EVENT 1
+#endif
+#endif
+
+#ifdef HAVE_PERF_EVENT
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#endif
+
+#include "Counters.h"
+
+
+
+/*	gCounterNames
+	Name of each Counter, as reported
+*/
+static const char *const gCounterNames[] = {
+	/* kCounterCycles */		"cycles",
+	/* kCounterInstructions */	"instructions",
+	/* kCounterBranchMisses */	"branch misses",
+	/* kCounterCacheMisses */	"cache misses",
+	/* kCounterContextSwitches */	"context switches"
+	};
+
+
+#ifdef HAVE_PERF_EVENT
+
+/*	gCounterEvents
+	Type and configuration of the event behind each Counter
+*/
+static const struct {
+	__u32		type;
+	__u64		config;
+	} gCounterEvents[] = {
+	/* kCounterCycles */		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	/* kCounterInstructions */	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	/* kCounterBranchMisses */	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	/* kCounterCacheMisses */	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	/* kCounterContextSwitches */	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES }
+	};
+
+
+/*	OpenEvent
+	Open a counter of the given event for this process (and threads it starts), disabled
+	Return the file descriptor, or -1
+*/
+static int OpenEvent(
+	__u32		type,
+	__u64		config,
+	bool		excludeKernel
+	)
+{
+struct perf_event_attr attr;
+memset(&attr, 0, sizeof attr);
+attr.size = sizeof attr;
+attr.type = type;
+attr.config = config;
+attr.disabled = 1;
+attr.inherit = 1;
+attr.exclude_kernel = excludeKernel;
+attr.exclude_hv = excludeKernel;
+attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+return (int) syscall(SYS_perf_event_open, &attr, 0 /* this process */, -1 /* any processor */, -1 /* no group */, 0);
+}
+
+
+/*	OpenCounters
+	Open whichever counters are allowed
+*/
+bool OpenCounters(
+	struct Counters	*counters
+	)
+{
+unsigned opened = 0;
+int error = 0;
+
+for (unsigned i = 0; i < kCounterCount; i++) {
+	counters->values[i] = 0;
+	
+	// count the kernel's part too, where that's allowed
+	if ((counters->fds[i] = OpenEvent(gCounterEvents[i].type, gCounterEvents[i].config, false)) == -1 && (errno == EACCES || errno == EPERM))
+		counters->fds[i] = OpenEvent(gCounterEvents[i].type, gCounterEvents[i].config, true);
+	
+	if (counters->fds[i] != -1)
+		opened++;
+	
+	else if (!error)
+		error = errno;
+	}
+
+if (!opened) {
+	int paranoid = -1;
+	FILE *const file = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+	if (file) {
+		if (fscanf(file, "%d", &paranoid) != 1) paranoid = -1;
+		fclose(file);
+		}
+	
+	fprintf(stderr, "warning: no performance counters available (%s; perf_event_paranoid is %d)\n", strerror(error), paranoid);
+	return true;
+	}
+
+if (opened < kCounterCount)
+	for (unsigned i = 0; i < kCounterCount; i++)
+		if (counters->fds[i] == -1)
+			fprintf(stderr, "info: %s can't be counted here\n", gCounterNames[i]);
+
+return false;
+}
+
+
+/*	StartCounters
+	Reset and enable the counters
+*/
+void StartCounters(
+	struct Counters	*counters
+	)
+{
+for (unsigned i = 0; i < kCounterCount; i++)
+	if (counters->fds[i] != -1) {
+		ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+}
+
+
+/*	StopCounters
+	Disable the counters and read them
+*/
+void StopCounters(
+	struct Counters	*counters
+	)
+{
+for (unsigned i = 0; i < kCounterCount; i++)
+	if (counters->fds[i] != -1)
+		ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+for (unsigned i = 0; i < kCounterCount; i++) {
+	counters->values[i] = 0;
+	
+	/* value, time enabled, time running */
+	__u64 reading[3];
+	if (counters->fds[i] == -1 || read(counters->fds[i], reading, sizeof reading) != sizeof reading) continue;
+	
+	// the kernel multiplexes more events than there are hardware counters
+	counters->values[i] =
+		reading[2] == 0 ? 0 :
+		reading[2] < reading[1] ? (unsigned long long) ((double) reading[0] * reading[1] / reading[2]) :
+		reading[0];
+	}
+}
+
+
+/*	CloseCounters
+	Release the counters
+*/
+void CloseCounters(
+	struct Counters	*counters
+	)
+{
+for (unsigned i = 0; i < kCounterCount; i++)
+	if (counters->fds[i] != -1) {
+		close(counters->fds[i]);
+		counters->fds[i] = -1;
+		}
+}
+
+
+#else
+
+/*	OpenCounters
+	There are no counters on this platform
+*/
+bool OpenCounters(
+	struct Counters	*counters
+	)
+{
+for (unsigned i = 0; i < kCounterCount; i++) {
+	counters->fds[i] = -1;
+	counters->values[i] = 0;
+	}
+
+fprintf(stderr, "warning: performance counters are only available on Linux\n");
+
+return true;
+}
+
+
+void StartCounters(struct Counters *counters) {}
+void StopCounters(struct Counters *counters) {}
+void CloseCounters(struct Counters *counters) {}
+
+#endif
+
+
+/*	ReportCounters
+	Print the counts, per byte of input
+*/
+void ReportCounters(
+	const struct Counters *counters,
+	const char	*method,
+	const char	*mode,
+	unsigned long long bytes
+	)
+{
+fprintf(stderr, "counters: %s %s:", method, mode);
+
+for (unsigned i = 0; i < kCounterCount; i++) {
+	fprintf(stderr, i ? ", " : " ");
+	
+	if (counters->fds[i] == -1)
+		fprintf(stderr, "- %s", gCounterNames[i]);
+	
+	else {
+		fprintf(stderr, "%llu %s", counters->values[i], gCounterNames[i]);
+		
+		if (bytes) fprintf(stderr, " (%.4g/byte)", (double) counters->values[i] / bytes);
+		}
+	}
+
+// instructions per cycle
+if (counters->fds[kCounterCycles] != -1 && counters->fds[kCounterInstructions] != -1 && counters->values[kCounterCycles])
+	fprintf(stderr, ", %.2f IPC", (double) counters->values[kCounterInstructions] / counters->values[kCounterCycles]);
+
+fprintf(stderr, "\n");
+}
@@ -0,0 +1,83 @@
+/*
+	Counters.h
+	
+	Hardware performance counters around the tests of
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	Counter
+	Events counted
+*/
+enum Counter {
+	kCounterCycles,
+	kCounterInstructions,
+	kCounterBranchMisses,
+	kCounterCacheMisses,
+	kCounterContextSwitches,
+	kCounterCount
+	};
+
+
+/*	Counters
+	Open counters, and what they counted between StartCounters() and StopCounters()
+*/
+struct Counters {
+	int		fds[kCounterCount];		// -1 where the event can't be counted
+	unsigned long long values[kCounterCount];
+	};
+
+
+/*	OpenCounters
+	Open whichever of the counters this process is allowed, disabled
+	Return whether none could be opened (having said why)
+*/
+extern bool OpenCounters(struct Counters*);
+
+
+/*	StartCounters, StopCounters
+	Reset and enable the counters; disable them again and read what they counted (scaled up if
+	the kernel had to share the hardware counters with other events)
+*/
+extern void StartCounters(struct Counters*);
+extern void StopCounters(struct Counters*);
+
+
+/*	CloseCounters
+	Release the counters
+*/
+extern void CloseCounters(struct Counters*);
+
+
+/*	ReportCounters
+	Print the counts to standard error, with instructions per cycle and each per byte of input
+*/
+extern void ReportCounters(const struct Counters*, const char *method, const char *mode, unsigned long long bytes);
+
+
+#ifdef __cplusplus
+	}
+#endif
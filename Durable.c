@@ -0,0 +1,545 @@
+/*
+	Durable
+	
+	Durable file output for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	With O_DIRECT, every write must start at an offset, come from an address and have a length
+	that are all multiples of the block size; so the output is staged in an aligned buffer
+	(which the simd method encodes straight into, see ReserveOutputFile()) and written out a
+	whole number of blocks at a time.  Flushing writes the last, partial block padded with
+	zeros, cuts the file back to its true length and seeks back to the start of that block,
+	keeping it staged, so that writing can carry on where it left off.
+	
+	The output file is the only one treated this way; standard output, and any other file
+	descriptor handed to these functions, is written to as it is.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+#include "Durable.h"
+#include "Encoding.h"
+#include "Platform.h"
+
+
+
+/*	gSyncPolicyNames
+	Name of each SyncPolicy
+*/
+const char *const gSyncPolicyNames[] = {
+	"none",
+	"end",
+	"every",
+	"range"
+	};
+
+
+/*	kDirectAlignment
+	Alignment of the address, offset and length of every O_DIRECT write; the logical block
+	size of most devices is 512 or 4096 bytes
+*/
+enum { kDirectAlignment = 4096 };
+
+
+/*	kDirectBuffer
+	Bytes staged before they are written out with O_DIRECT
+*/
+enum { kDirectBuffer = 1 << 20 };
+
+
+/*	DurableOutput
+	Output file that the Durability is being applied to
+*/
+struct DurableOutput {
+	int		fd;			// -1 if there is none
+	
+	// O_DIRECT staging buffer, if any
+	char		*staged;
+	size_t		capacity, used;
+	
+	// syncing
+	unsigned long long unsynced;		// bytes written since the last sync (or range started)
+	unsigned long long started;		// offset of the first of those
+	unsigned long long previous, previousLength; // range whose writeback was started last
+	};
+
+
+/*	gDurability, gOutput, gStatistics
+	Durability being applied, if any; the file it is applied to; and what it has cost
+*/
+static const struct Durability *gDurability;
+static struct DurableOutput gOutput = { .fd = -1 };
+static struct DurableStatistics gStatistics;
+
+
+/*	IsDurable
+	Whether there is anything to apply
+*/
+bool IsDurable(
+	const struct Durability *durability
+	)
+{
+return durability->preallocate || durability->direct || durability->policy != kSyncNone;
+}
+
+
+/*	StartDurability
+	Apply the Durability from now on
+*/
+void StartDurability(
+	const struct Durability *durability
+	)
+{
+gDurability = durability;
+memset(&gStatistics, 0, sizeof gStatistics);
+}
+
+
+/*	StopDurability
+	Stop applying it
+*/
+void StopDurability(
+	struct DurableStatistics *statistics
+	)
+{
+gDurability = NULL;
+*statistics = gStatistics;
+}
+
+
+/*	SyncOutput
+	Sync the output file to storage, timing it
+	Return whether the call failed
+*/
+static bool SyncOutput(void)
+{
+const double start = Now();
+
+#ifdef _WIN32
+const bool failed = _commit(gOutput.fd) != 0;
+#else
+const bool failed = (gDurability->data ? fdatasync(gOutput.fd) : fsync(gOutput.fd)) != 0;
+#endif
+
+const double elapsed = Now() - start;
+
+if (failed) {
+	fprintf(stderr, "error: can't sync output file (%s)\n", strerror(errno));
+	return true;
+	}
+
+gStatistics.syncs++;
+gStatistics.syncing += elapsed;
+if (elapsed > gStatistics.longest) gStatistics.longest = elapsed;
+
+gOutput.started += gOutput.unsynced;
+gOutput.unsynced = 0;
+
+return false;
+}
+
+
+/*	SyncRange
+	Start writeback of what was written since the last range, and wait for that of the range
+	before it to complete, timing both
+	Return whether the call failed
+*/
+static bool SyncRange(void)
+{
+#ifdef __linux__
+const double start = Now();
+
+const bool failed =
+	sync_file_range(gOutput.fd, (off_t) gOutput.started, (off_t) gOutput.unsynced, SYNC_FILE_RANGE_WRITE) != 0 ||
+	(gOutput.previousLength && sync_file_range(
+		gOutput.fd, (off_t) gOutput.previous, (off_t) gOutput.previousLength,
+		SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER
+		) != 0);
+
+const double elapsed = Now() - start;
+
+if (failed) {
+	fprintf(stderr, "error: can't sync output file range (%s)\n", strerror(errno));
+	return true;
+	}
+
+gStatistics.syncs++;
+gStatistics.syncing += elapsed;
+if (elapsed > gStatistics.longest) gStatistics.longest = elapsed;
+
+gOutput.previous = gOutput.started;
+gOutput.previousLength = gOutput.unsynced;
+gOutput.started += gOutput.unsynced;
+gOutput.unsynced = 0;
+
+return false;
+
+#else
+/* there is no sync_file_range(); sync the whole file instead */
+return SyncOutput();
+#endif
+}
+
+
+/*	WriteAll
+	Write all of the buffer to the output file
+	Return whether the call failed
+*/
+static bool WriteAll(
+	const char	*buffer,
+	size_t		length
+	)
+{
+// _write() may write less than it was asked to
+while (length) {
+	const unsigned int request = length < 0x40000000 ? (unsigned int) length : 0x40000000;
+	const int written = _write(gOutput.fd, buffer, request);
+	if (written <= 0) return true;
+	
+	gStatistics.writes++;
+	buffer += written;
+	length -= written;
+	}
+
+return false;
+}
+
+
+/*	CountWritten
+	Count bytes written to the output file, syncing it if the policy says it is time
+	Return whether the call failed
+*/
+static bool CountWritten(
+	size_t		length
+	)
+{
+gOutput.unsynced += length;
+if (gOutput.unsynced < gDurability->interval) return false;
+
+switch (gDurability->policy) {
+	case kSyncEvery:	return SyncOutput();
+	case kSyncRange:	return SyncRange();
+	default:		return false;
+	}
+}
+
+
+/*	WriteThrough
+	Write to the output file, and count it
+	Return whether the call failed
+*/
+static bool WriteThrough(
+	const char	*buffer,
+	size_t		length
+	)
+{
+return WriteAll(buffer, length) || CountWritten(length);
+}
+
+
+/*	KeepStaged
+	Drop the given number of bytes, that were written, from the start of the staging buffer
+	and keep the rest
+	Return false
+*/
+static bool KeepStaged(
+	size_t		written
+	)
+{
+memmove(gOutput.staged, gOutput.staged + written, gOutput.used - written);
+gOutput.used -= written;
+
+return false;
+}
+
+
+/*	WriteStaged
+	Write out the whole blocks that are staged, and with 'all' the last partial one too
+	Return whether the call failed
+*/
+static bool WriteStaged(
+	bool		all
+	)
+{
+const size_t length = gOutput.used / kDirectAlignment * kDirectAlignment, partial = gOutput.used - length;
+if (!all || !partial) return WriteThrough(gOutput.staged, length) || KeepStaged(length);
+
+// fill the partial block out with zeros, and write it too
+memset(gOutput.staged + gOutput.used, 0, kDirectAlignment - partial);
+if (WriteAll(gOutput.staged, length + kDirectAlignment)) return true;
+
+#ifdef O_DIRECT
+// the padding isn't part of the output, and the partial block is rewritten if more follows
+gStatistics.padding += kDirectAlignment - partial;
+
+const off_t end = lseek(gOutput.fd, 0, SEEK_CUR);
+if (
+	end == -1 ||
+	ftruncate(gOutput.fd, end - kDirectAlignment + (off_t) partial) != 0 ||
+	lseek(gOutput.fd, end - kDirectAlignment, SEEK_SET) == -1
+	) {
+	fprintf(stderr, "error: can't cut output file back to its length\n");
+	return true;
+	}
+#endif
+
+/* the partial block is counted once it is written whole */
+return CountWritten(length) || KeepStaged(length);
+}
+
+
+/*	OpenOutputFile
+	Open the output file, applying the Durability
+*/
+int OpenOutputFile(
+	int		mode
+	)
+{
+if (!gDurability)
+	return _open(gFileName, _O_WRONLY | _O_CREAT | _O_TRUNC | mode, _S_IREAD | _S_IWRITE);
+
+int flags = _O_WRONLY | _O_CREAT | _O_TRUNC | mode;
+if (gDurability->direct) {
+#ifdef O_DIRECT
+	flags |= O_DIRECT;
+#else
+	fprintf(stderr, "error: 'direct' is not available on this platform\n");
+	return -1;
+#endif
+	}
+
+const int fd = _open(gFileName, flags, _S_IREAD | _S_IWRITE);
+if (fd == -1) {
+	if (gDurability->direct) fprintf(stderr, "info: the file system may not support O_DIRECT\n");
+	return -1;
+	}
+
+// allocate the blocks ahead of the writes, without changing the file's size
+if (gDurability->preallocate && gDurability->expected) {
+#ifdef __linux__
+	if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t) gDurability->expected) != 0)
+		fprintf(stderr, "warning: can't preallocate output file (%s)\n", strerror(errno));
+#else
+	fprintf(stderr, "warning: 'fallocate' is only available on Linux\n");
+#endif
+	}
+
+gOutput = (struct DurableOutput) { .fd = fd };
+
+#ifdef O_DIRECT
+if (gDurability->direct) {
+	void *staged;
+	if (posix_memalign(&staged, kDirectAlignment, kDirectBuffer) != 0) {
+		fprintf(stderr, "error: can't allocate aligned output buffer\n");
+		_close(fd);
+		gOutput.fd = -1;
+		return -1;
+		}
+	
+	gOutput.staged = staged;
+	gOutput.capacity = kDirectBuffer;
+	}
+#endif
+
+return fd;
+}
+
+
+/*	WriteOutputFile
+	Write to the file descriptor, staging the output file's bytes if it was opened with O_DIRECT
+*/
+bool WriteOutputFile(
+	int		fd,
+	const void	*buffer,
+	size_t		length
+	)
+{
+if (fd != gOutput.fd) return _write(fd, buffer, (unsigned int) length) != (int) length;
+
+if (!gOutput.staged) return WriteThrough(buffer, length);
+
+// stage it, writing out whenever enough is staged
+for (const char *bytes = buffer; length;) {
+	const size_t room = gOutput.capacity - gOutput.used, copy = length < room ? length : room;
+	memcpy(gOutput.staged + gOutput.used, bytes, copy);
+	gOutput.used += copy;
+	bytes += copy;
+	length -= copy;
+	
+	if (gOutput.used >= kDirectBuffer && WriteStaged(false)) return true;
+	}
+
+return false;
+}
+
+
+/*	WriteOutputFilePair
+	Write both buffers in one call, unless the output file is staged
+*/
+bool WriteOutputFilePair(
+	int		fd,
+	const void	*first,
+	size_t		firstLength,
+	const void	*second,
+	size_t		secondLength
+	)
+{
+if (fd == gOutput.fd && gOutput.staged)
+	return WriteOutputFile(fd, first, firstLength) || WriteOutputFile(fd, second, secondLength);
+
+const size_t total = firstLength + secondLength;
+
+#ifdef _WIN32
+/* There is no writev(); the second buffer takes a call of its own */
+const bool failed =
+	(firstLength && _write(fd, first, (unsigned int) firstLength) != (int) firstLength) ||
+	(secondLength && _write(fd, second, (unsigned int) secondLength) != (int) secondLength);
+
+#else
+const struct iovec vector[2] = {
+	{ (void*) first, firstLength },
+	{ (void*) second, secondLength }
+	};
+
+const bool failed = writev(fd, vector + !firstLength, 2 - !firstLength) != (ssize_t) total;
+#endif
+
+if (failed) return true;
+
+// the output file counts it towards its next sync
+if (fd != gOutput.fd) return false;
+
+gStatistics.writes++;
+return CountWritten(total);
+}
+
+
+/*	ReserveOutputFile
+	Make room for 'length' bytes at the end of the output file's staging buffer, growing it
+*/
+char *ReserveOutputFile(
+	int		fd,
+	size_t		length
+	)
+{
+if (fd != gOutput.fd || !gOutput.staged) return NULL;
+
+if (gOutput.capacity - gOutput.used < length) {
+	/* Failing to grow isn't an error; the caller uses its own buffer instead */
+	const size_t capacity = (gOutput.used + length + kDirectAlignment - 1) / kDirectAlignment * kDirectAlignment;
+#ifdef O_DIRECT
+	void *staged;
+	if (posix_memalign(&staged, kDirectAlignment, capacity) != 0) return NULL;
+	memcpy(staged, gOutput.staged, gOutput.used);
+	free(gOutput.staged);
+	
+	gOutput.staged = staged;
+	gOutput.capacity = capacity;
+#else
+	return NULL;
+#endif
+	}
+
+return gOutput.staged + gOutput.used;
+}
+
+
+/*	CommitOutputFile
+	Take the bytes placed in the reserved room as output
+*/
+bool CommitOutputFile(
+	int		fd,
+	size_t		length
+	)
+{
+(void) fd;
+
+gOutput.used += length;
+
+return gOutput.used >= kDirectBuffer && WriteStaged(false);
+}
+
+
+/*	FlushOutputFile
+	Write out all that is staged, and sync the output file if the policy asks for it
+*/
+bool FlushOutputFile(
+	int		fd
+	)
+{
+if (fd != gOutput.fd) return false;
+
+if (gOutput.staged && WriteStaged(true)) return true;
+
+return gDurability->policy != kSyncNone && SyncOutput();
+}
+
+
+/*	CloseOutputFile
+	Release the staging buffer, and close the file descriptor
+*/
+void CloseOutputFile(
+	int		fd
+	)
+{
+if (fd == gOutput.fd) {
+	free(gOutput.staged);
+	gOutput = (struct DurableOutput) { .fd = -1 };
+	}
+
+_close(fd);
+}
+
+
+/*	ReportDurability
+	Print the syncs and writes
+*/
+void ReportDurability(
+	const struct Durability *durability,
+	const struct DurableStatistics *statistics,
+	const char	*method,
+	const char	*mode,
+	double		elapsed
+	)
+{
+fprintf(stderr, "durable: %s %s: sync=%s", method, mode, gSyncPolicyNames[durability->policy]);
+if (durability->policy == kSyncEvery || durability->policy == kSyncRange) fprintf(stderr, " every %zu bytes", durability->interval);
+if (durability->policy != kSyncNone) fprintf(stderr, " with %s", durability->data ? "fdatasync" : "fsync");
+if (durability->preallocate) fprintf(stderr, ", fallocate");
+if (durability->direct) fprintf(stderr, ", O_DIRECT");
+fprintf(stderr, ": %llu writes", statistics->writes);
+if (statistics->padding) fprintf(stderr, " (%llu bytes of padding)", statistics->padding);
+fprintf(stderr, ", %llu syncs", statistics->syncs);
+if (statistics->syncs)
+	fprintf(stderr, " taking %.3f ms (%.1f%% of the write), %.3f ms the longest",
+		statistics->syncing * 1e3, elapsed > 0 ? statistics->syncing / elapsed * 100 : 0, statistics->longest * 1e3
+		);
+fprintf(stderr, "\n");
+}
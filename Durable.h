@@ -0,0 +1,113 @@
+/*
+	Durable.h
+	
+	Durable file output for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	The methods that write to a file descriptor (posix, simd, iconv and batch) open, write,
+	flush and close the output file through OpenOutputFile() and the functions that go with it
+	(see Encoding.h); between StartDurability() and StopDurability() those preallocate the
+	file, bypass the page cache and sync it to storage as asked.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	SyncPolicy
+	When the output file is synced to storage
+*/
+enum SyncPolicy {
+	kSyncNone,				// never; it is left in the page cache
+	kSyncEnd,				// once, when the output is finished
+	kSyncEvery,				// every 'interval' bytes, and at the end
+	kSyncRange,				// writeback of every 'interval' bytes started with sync_file_range(), waiting for the previous; synced at the end
+	kSyncPolicies
+	};
+
+
+/*	gSyncPolicyNames
+	Name of each SyncPolicy, as reported
+*/
+extern const char *const gSyncPolicyNames[];
+
+
+/*	kSyncDefaultInterval
+	Bytes between syncs when no interval is given
+*/
+enum { kSyncDefaultInterval = 1 << 20 };
+
+
+/*	Durability
+	What is done to make the output file durable
+*/
+struct Durability {
+	bool		preallocate;		// allocate 'expected' bytes of storage up front, with fallocate()
+	bool		direct;			// open with O_DIRECT, writing whole blocks from aligned buffers
+	bool		data;			// sync with fdatasync() rather than fsync()
+	enum SyncPolicy	policy;
+	size_t		interval;		// bytes between syncs
+	unsigned long long expected;		// size the output file is expected to reach
+	};
+
+
+/*	DurableStatistics
+	What durability cost
+*/
+struct DurableStatistics {
+	unsigned long long syncs;
+	double		syncing, longest;	// time spent in the sync calls
+	unsigned long long writes;		// write calls made to the file
+	unsigned long long padding;		// bytes written past the end of the output to fill its last block
+	};
+
+
+/*	IsDurable
+	Whether the Durability asks for anything at all
+*/
+extern bool IsDurable(const struct Durability*);
+
+
+/*	StartDurability
+	Apply the given Durability to the output file opened from now on
+*/
+extern void StartDurability(const struct Durability*);
+
+
+/*	StopDurability
+	Stop applying it, and return what it cost
+*/
+extern void StopDurability(struct DurableStatistics*);
+
+
+/*	ReportDurability
+	Print what durability cost to standard error, with the share of the write's elapsed time
+	spent syncing
+*/
+extern void ReportDurability(const struct Durability*, const struct DurableStatistics*, const char *method, const char *mode, double elapsed);
+
+
+#ifdef __cplusplus
+	}
+#endif
@@ -22,6 +22,11 @@
 	
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <uchar.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -37,12 +42,23 @@ enum Method {
 	kMethodCUnformatted,
 	kMethodCFormatted,
 	kMethodCPPUnformatted,
-	kMethodCPPFormatted
+	kMethodCPPFormatted,
+	kMethodSIMD,
+	kMethodMmap,
+	kMethodURing,
+	kMethodStreambuf,
+	kMethodStreambufFormatted,
+	kMethodIconv,
+	kMethodBatch
 	};
 
 
 /*	Mode
 	Text API modes
+	
+	The char8, char16 and char32 modes aren't API modes, but hand the methods the sample as
+	UTF-8, UTF-16 or UTF-32 code units of that width whatever wchar_t is (16 bits on Windows,
+	32 bits on Linux), and have them write it as UTF-8
 */
 enum Mode {
 	kModeNone,
@@ -50,36 +66,132 @@ enum Mode {
 	kModeText,
 	kModeWide,
 	kModeUnicode,
-	kModeWideUnicode
+	kModeWideUnicode,
+	kModeChar8,
+	kModeChar16,
+	kModeChar32
 	};	
 
 
-/*	gSample
-	Bytes sent as text data
-	These are the same characters listed in gSampleWide, but encoded as Code Page 434
+/*	Sample
+	Text data sent by the tests, as narrow bytes (for the narrow modes), as wide characters
+	(for the wide modes), and as code units of each width (for the char8, char16 and char32
+	modes)
+*/
+struct Sample {
+	const char	*narrow;
+	size_t		narrowLength;
+	const wchar_t	*wide;
+	size_t		wideLength;
+	const char	*utf8;			// char8_t, which C and C++17 don't have
+	size_t		utf8Length;
+	const char16_t	*utf16;
+	size_t		utf16Length;
+	const char32_t	*utf32;
+	size_t		utf32Length;
 	
-	Putting the 'static' definitions in the header file so that both the C and C++ code
-	can see them; they will be duplicated in the object code.
+	// held by a sample read from a file
+	void		*mapping;
+	wchar_t		*decoded;
+	char16_t	*decoded16;
+	char32_t	*decoded32;
+	};
+
+
+/*	SampleText
+	The form of the sample that a Mode hands to the methods, as code units of a given width
+	in bytes
+*/
+struct SampleText {
+	const void	*units;
+	size_t		width;
+	size_t		length;			// code units
+	};
+
+
+/*	GetSampleText
+	Form of the sample that the given Mode writes: the narrow one (width 1), the wide one
+	(sizeof (wchar_t)), or that of the char8, char16 or char32 mode (1, 2 or 4)
 */
-static const char gSample[] = { 0x41, 0xCE, 0xA3, 0xEB, 0x8C, 0x0A };
+extern struct SampleText GetSampleText(const struct Sample*, enum Mode);
 
 
-/*	gSampleWide
-	Wide characters sent as text data (with UTF-16 interpretation)
+/*	IsCodeUnitMode
+	Whether the Mode is one of char8, char16 and char32
+*/
+extern bool IsCodeUnitMode(enum Mode);
+
+
+/*	gDefaultSample
+	Sample used when no input file is given (see Sample.c)
+*/
+extern const struct Sample gDefaultSample;
+
+
+/*	kSampleChunk
+	Largest number of characters handed to a method in a single call
 	
-	Not using u8'' here because that has Unicode semantics; we really want to force exactly
-	the specific value here
-*/
-static const wchar_t gSampleWide[] = {
-	0x0041,			// LATIN CAPITAL LETTER A
-	0x256C,			// BOX DRAWINGS DOUBLE VERTICAL AND HORIZONTAL
-	0x00FA,			// LATIN SMALL LETTER U WITH ACUTE
-	0x03B4,			// GREEK SMALL LETTER DELTA
-	0x00EE,			// LATIN SMALL LETTER I WITH CIRCUMFLEX
-	0x000A			// LINE FEED (LF)
+	Keeps formatted output's 'int' lengths and the conversion buffers bounded when the
+	sample is a large file.
+*/
+enum { kSampleChunk = 1 << 20 };
+
+
+/*	GetNarrowChunk, GetWideChunk, GetTextChunk
+	Number of characters (or code units) of the remainder of the sample to hand to the method
+	next; wide and UTF-16 chunks don't split a surrogate pair
+*/
+extern size_t GetNarrowChunk(size_t remaining);
+extern size_t GetWideChunk(const wchar_t *wide, size_t remaining);
+extern size_t GetTextChunk(const struct SampleText*, size_t offset);
+
+
+/*	Buffering
+	Stream buffering applied by the C and C++ methods; a zero size means BUFSIZ
+*/
+enum BufferingPolicy {
+	kBufferingDefault,			// leave as the library opened it
+	kBufferingFull,
+	kBufferingLine,
+	kBufferingNone
+	};
+
+struct Buffering {
+	enum BufferingPolicy policy;
+	size_t		size;
 	};
 
 
+/*	Facet
+	Conversion facet that the C++ methods imbue wide-character streams with, where the Mode
+	calls for one: the standard library's (std::codecvt_utf8, std::codecvt_utf16) or the
+	project's UnicodeCodecvt
+*/
+enum Facet {
+	kFacetStandard,
+	kFacetProject
+	};
+
+
+/*	Batching
+	When the batch method writes out the messages it has coalesced: once the next wouldn't fit
+	in 'bytes', or it holds 'messages' of them, or the oldest has waited 'interval' seconds
+	(zero for no count or timer)
+*/
+struct Batching {
+	size_t		bytes;
+	size_t		messages;
+	double		interval;
+	};
+
+
+/*	SetCBuffering
+	Apply the given buffering to a C stream, before any output to it
+	Return whether the call failed
+*/
+extern bool SetCBuffering(FILE*, const struct Buffering*);
+
+
 /*	SetPOSIXModeForStandardOutput
 	Retroactively apply a POSIX mode to the already-open standard output C stream
 */
@@ -87,21 +199,145 @@ extern bool SetPOSIXModeForStandardOutput(enum Mode);
 
 
 /*	OpenFileWithCMode
-	Open a C file stream applying the appropriate C file mode
+	Open a C file stream applying the appropriate C file mode and buffering
 */
-extern FILE *OpenFileWithCMode(enum Mode);
+extern FILE *OpenFileWithCMode(enum Mode, const struct Buffering*);
 
 
 /*	gFileName
 	Name of file used when not writing to standard output
 */
-extern const char gFileName[];
+extern const char *gFileName;
+
+
+/*	Now
+	Monotonic clock in seconds
+*/
+extern double Now(void);
 
 
-extern bool TestWindowsAPI(bool standardOutput, enum Mode);
-extern bool TestPOSIX(bool standardOutput, enum Mode, bool isWideMode);
-extern bool TestC(bool standardOutput, enum Mode, bool isWideMode, bool isMethodFormatted);
-extern bool TestCPlusPlusStream(bool standardOutput, enum Mode, bool isWideMode, const char *locale, bool isMethodFormatted);
+/*	MarkWrite
+	Called by the methods after each write of the sample; records the time since the previous
+	one in the latency histogram, if one is being kept (see Latency.h)
+*/
+extern void MarkWrite(void);
+
+
+/*	CheckOutput
+	Called by the methods that have the bytes in hand with each buffer before they write it;
+	checks that it is well-formed, if inline validation was asked for (see Validate.h)
+	Return whether it isn't, in which case the method should fail without writing it
+*/
+extern bool CheckOutput(const void *buffer, size_t length);
+
+
+/*	OpenOutputFile, WriteOutputFile, FlushOutputFile, CloseOutputFile
+	Used by the methods that write to a file descriptor (posix, simd, iconv and batch) in place
+	of _open(gFileName) with the given POSIX mode, _write(), and _close(); they preallocate the
+	output file, write it with O_DIRECT and sync it to storage, if asked to (see Durable.h), and
+	otherwise do just what those would.  FlushOutputFile() writes out whatever is staged for
+	O_DIRECT and syncs the file as the policy asks at the end; standard output is left alone
+	Return the file descriptor or -1 if the call failed, or whether the call failed
+*/
+extern int OpenOutputFile(int mode);
+extern bool WriteOutputFile(int fd, const void *buffer, size_t length);
+extern bool FlushOutputFile(int fd);
+extern void CloseOutputFile(int fd);
+
+
+/*	WriteOutputFilePair
+	Write the first buffer followed by the second, in a single call (writev()) where the
+	platform has one and the output file isn't staged for O_DIRECT
+	Return whether the call failed
+*/
+extern bool WriteOutputFilePair(int fd, const void *first, size_t firstLength, const void *second, size_t secondLength);
+
+
+/*	ReserveOutputFile, CommitOutputFile
+	Where the output file is staged for O_DIRECT, room for 'length' bytes at the end of the
+	aligned staging buffer, for the caller to encode straight into and then commit as many
+	bytes of as it wrote, in place of WriteOutputFile()
+	Return NULL if the file isn't staged, when the caller writes from its own buffer instead;
+	or whether the call failed
+*/
+extern char *ReserveOutputFile(int fd, size_t length);
+extern bool CommitOutputFile(int fd, size_t length);
+
+
+/*	Sink
+	Output of the winapi, posix, C (unformatted, formatted) and C++ (unformatted++, formatted++)
+	methods, kept open between writes: the handle, file descriptor, FILE or stream, with its
+	mode, buffering and imbued locale, are set up once by CreateSink() rather than for every
+	write, so that a program can keep one and the benchmark measures only the writes
+*/
+struct Sink;
+
+struct SinkOptions {
+	bool		standardOutput;		// write to standard output rather than gFileName
+	const char	*locale;		// C++: locale imbued in the stream
+	enum Facet	facet;			// C++: wide-character conversion facet
+	struct Buffering buffering;		// C and C++: stream buffer
+	};
+
+
+/*	CreateSink
+	Open the output of the given method, configured for the given Mode and options
+	Return the sink, or NULL if the call failed
+*/
+extern struct Sink *CreateSink(enum Method, enum Mode, const struct SinkOptions*);
+
+
+/*	WriteSink
+	Write the sample once
+	Return whether the call failed
+*/
+extern bool WriteSink(struct Sink*, const struct Sample*);
+
+
+/*	FlushSink
+	Hand whatever the sink's stream buffer holds to the system
+	Return whether the call failed
+*/
+extern bool FlushSink(struct Sink*);
+
+
+/*	DestroySink
+	Flush and close the output (but not standard output), and release the sink
+	Return whether the call failed
+*/
+extern bool DestroySink(struct Sink*);
+
+
+/*	CPlusPlusSink
+	The C++ methods' part of a Sink (see EncodingCC.cc)
+*/
+struct CPlusPlusSink;
+extern struct CPlusPlusSink *CreateCPlusPlusSink(bool standardOutput, enum Mode, bool isWideMode, const char *locale, enum Facet, bool isMethodFormatted, const struct Buffering*);
+extern bool WriteCPlusPlusSink(struct CPlusPlusSink*, const struct Sample*);
+extern bool FlushCPlusPlusSink(struct CPlusPlusSink*);
+extern bool DestroyCPlusPlusSink(struct CPlusPlusSink*);
+
+
+/*	Test functions
+	Each writes the sample 'repeat' times, so that the same call serves both the single
+	demonstration write and the benchmark; TestSink() to an open sink, and the others between
+	opening and closing their output
+*/
+extern bool TestSink(struct Sink*, const struct Sample*, size_t repeat);
+extern bool TestSIMD(bool standardOutput, enum Mode, const struct Sample*, size_t repeat);
+extern bool TestMmap(bool standardOutput, enum Mode, const struct Sample*, size_t repeat, bool sync);
+extern bool TestURing(bool standardOutput, enum Mode, const struct Sample*, size_t repeat, unsigned int depth);
+extern bool TestIconv(bool standardOutput, enum Mode, const struct Sample*, size_t repeat, size_t chunk);
+extern bool TestBatch(bool standardOutput, enum Mode, const struct Sample*, size_t repeat, const struct Batching*);
+extern bool TestStreambuf(bool standardOutput, enum Mode, bool isWideMode, const char *locale, bool isMethodFormatted, const struct Buffering*, const struct Sample*, size_t repeat);
+
+
+/*	IsURingAvailable, IsIconvAvailable
+	Whether the io_uring and iconv methods were built on this platform; where they weren't,
+	their test functions only fail
+*/
+extern bool IsURingAvailable(void);
+extern bool IsIconvAvailable(void);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,274 @@
+/*
+	EncodingBatch
+	
+	Coalescing (batched) output method for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Encoding.h"
+#include "Platform.h"
+#include "Transcode.h"
+
+
+
+/*	FlushReason
+	What made the batch go out
+*/
+enum FlushReason {
+	kFlushBytes,				// the next message wouldn't fit
+	kFlushMessages,				// the message count was reached
+	kFlushTimer,				// the oldest message had waited long enough
+	kFlushClose,				// the output was closed
+	kFlushReasons
+	};
+
+
+/*	Batch
+	Arena of encoded messages waiting to be written, with what it has done so far
+*/
+struct Batch {
+	int		fd;
+	const struct Batching *batching;
+	
+	// arena
+	char		*arena;
+	size_t		capacity;
+	size_t		used;
+	size_t		messages;
+	double		started;		// when the oldest message went in, if there is a timer
+	
+	// statistics
+	unsigned long long flushes[kFlushReasons];
+	unsigned long long vectored;		// flushes that took an oversized message along, with writev()
+	unsigned long long bytes, sent;		// bytes and messages written
+	double		flushing, longest;	// time spent in the write calls
+	};
+
+
+/*	WriteBatch
+	Write what the arena holds, followed by the given oversized message if there is one, in a
+	single call
+	Return whether the call failed
+*/
+static bool WriteBatch(
+	struct Batch	*batch,
+	enum FlushReason reason,
+	const char	*message,
+	size_t		length
+	)
+{
+if (!batch->used && !length) return false;
+
+// check the bytes before any of them go out
+if (CheckOutput(batch->arena, batch->used) || (length && CheckOutput(message, length))) return true;
+
+const size_t total = batch->used + length;
+const double start = Now();
+
+const bool failed = !length ?
+	WriteOutputFile(batch->fd, batch->arena, batch->used) :
+	WriteOutputFilePair(batch->fd, batch->arena, batch->used, message, length);
+
+const double elapsed = Now() - start;
+
+if (failed) {
+	fprintf(stderr, "error: unable to write entire output\n");
+	return true;
+	}
+
+// account for it
+batch->flushes[reason]++;
+if (length) batch->vectored++;
+batch->bytes += total;
+batch->sent += batch->messages + (length != 0);
+batch->flushing += elapsed;
+if (elapsed > batch->longest) batch->longest = elapsed;
+
+// start over
+batch->used = 0;
+batch->messages = 0;
+
+return false;
+}
+
+
+/*	ReportBatch
+	Print the flush statistics to standard error
+*/
+static void ReportBatch(
+	const struct Batch *batch
+	)
+{
+unsigned long long flushes = 0;
+for (enum FlushReason reason = 0; reason < kFlushReasons; reason++) flushes += batch->flushes[reason];
+if (!flushes) return;
+
+fprintf(stderr,
+	"batch: %llu flushes (%llu full, %llu at the message count, %llu by the timer, %llu at close), %llu with writev()\n",
+	flushes,
+	batch->flushes[kFlushBytes], batch->flushes[kFlushMessages], batch->flushes[kFlushTimer], batch->flushes[kFlushClose],
+	batch->vectored
+	);
+fprintf(stderr,
+	"batch: %.1f messages and %.0f bytes per flush; %.3f ms in the write calls, %.1f us the longest\n",
+	(double) batch->sent / flushes, (double) batch->bytes / flushes,
+	batch->flushing * 1e3, batch->longest * 1e6
+	);
+}
+
+
+/*	TestBatch
+	Coalescing batch writer test cases
+	Return whether call failed
+	
+	Each write of the sample is one message.  Messages are encoded (as by the simd method) into
+	a contiguous arena, which goes out in a single write when the next message wouldn't fit,
+	when it holds the given number of messages, or when its oldest message has waited the
+	given interval; a message larger than the whole arena goes out with it in the same call,
+	through writev(), without being copied.  The timer is only looked at as each message is
+	added, so that a batch that no message follows waits until the output is closed.
+*/
+bool TestBatch(
+	bool		standardOutput,
+	enum Mode	mode,
+	const struct Sample *sample,
+	size_t		repeat,
+	const struct Batching *batching
+	)
+{
+/* the narrow modes and char8 are copied as they are */
+const struct SampleText text = GetSampleText(sample, mode);
+const enum Encoding encoding = text.width > 1 ? gModeEncodings[mode] : kEncodingNone;
+
+// every message is the same size
+const size_t messageBytes = encoding ? EncodeUnitsLength(encoding, text.units, text.width, text.length) : text.length;
+
+fprintf(stderr, "info: batching up to %zu bytes", batching->bytes);
+if (batching->messages) fprintf(stderr, ", %zu messages", batching->messages);
+if (batching->interval) fprintf(stderr, ", %.0f us", batching->interval * 1e6);
+fprintf(stderr, " at a time\n");
+
+// get output file descriptor
+int fd;
+if (standardOutput) {
+	fd = _fileno(stdout);
+	
+	if (_setmode(fd, _O_BINARY) == -1) {
+		fprintf(stderr, "error: can't apply mode to standard output\n");
+		return true;
+		}
+	}
+
+else if ((fd = OpenOutputFile(_O_BINARY)) == -1) {
+	fprintf(stderr, "error: can't open file for output\n");
+	return true;
+	}
+
+struct Batch batch = { .fd = fd, .batching = batching };
+bool failed = false;
+
+// the byte order mark starts the first batch
+const char *mark;
+const size_t markLength = standardOutput ? 0 : GetModeByteOrderMark(mode, &mark);
+
+// allocate the arena, and a buffer for an encoded message too large for it
+batch.capacity = batching->bytes > markLength ? batching->bytes : markLength;
+const bool oversized = messageBytes > batch.capacity;
+char *encoded = NULL;
+if (
+	!(batch.arena = malloc(batch.capacity)) ||
+	(oversized && encoding && !(encoded = malloc(messageBytes)))
+	) {
+	fprintf(stderr, "error: can't allocate batch arena\n");
+	failed = true;
+	}
+
+else if (markLength) {
+	memcpy(batch.arena, mark, markLength);
+	batch.used = markLength;
+	}
+
+// perform output
+for (; repeat && !failed; repeat--, MarkWrite()) {
+	// no room for the message?
+	if (batch.used + messageBytes > batch.capacity) {
+		// too large for any batch; it goes out with this one
+		if (oversized) {
+			const char *message = text.units;
+			if (encoding) {
+				EncodeSIMDUnits(encoding, text.units, text.width, text.length, encoded);
+				message = encoded;
+				}
+			
+			failed = WriteBatch(&batch, kFlushBytes, message, messageBytes);
+			continue;
+			}
+		
+		if ((failed = WriteBatch(&batch, kFlushBytes, NULL, 0))) break;
+		}
+	
+	// add the message
+	char *const o = batch.arena + batch.used;
+	if (encoding)
+		EncodeSIMDUnits(encoding, text.units, text.width, text.length, o);
+	
+	else
+		memcpy(o, text.units, messageBytes);
+	
+	batch.used += messageBytes;
+	
+	// time the oldest message in the batch
+	if (batching->interval) {
+		const double now = Now();
+		if (!batch.messages) batch.started = now;
+		
+		else if (now - batch.started >= batching->interval) {
+			batch.messages++;
+			failed = WriteBatch(&batch, kFlushTimer, NULL, 0);
+			continue;
+			}
+		}
+	
+	// enough messages?
+	if (++batch.messages == batching->messages)
+		failed = WriteBatch(&batch, kFlushMessages, NULL, 0);
+	}
+
+// whatever is left goes out at close
+if (!failed) failed = WriteBatch(&batch, kFlushClose, NULL, 0);
+if (!failed && !standardOutput && FlushOutputFile(fd)) {
+	fprintf(stderr, "error: unable to write entire output\n");
+	failed = true;
+	}
+
+if (!failed) ReportBatch(&batch);
+
+// close
+free(encoded);
+free(batch.arena);
+if (!standardOutput) CloseOutputFile(fd);
+
+return failed;
+}
@@ -22,89 +22,172 @@
 
 #define _CRT_SECURE_NO_WARNINGS
 
-#include <io.h>
-#include <fcntl.h>
 #include <stdio.h>
 #include <stdbool.h>
-#include <sys\stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uchar.h>
+#include <wchar.h>
+
+#ifdef _WIN32
 
 #define WIN32_LEAN_AND_MEAN
 
 #include <WINDOWS.H>
 #include <CONSOLEAPI.H>
 
+#endif
+
 #include "Encoding.h"
+#include "Platform.h"
+#include "Transcode.h"
 
 
 
-/*	TestWindowsAPI
-	Windows API test cases
-	Return whether the call failed
+/*	EmulatedSample
+	Buffer for the explicitly encoded wide sample, on platforms that don't offer the
+	Windows Unicode modes themselves; and for the char16 and char32 samples, which no
+	platform converts
+	
+	The encoding is redone on every write, as the CRT would, so that its cost is measured.
+	The buffers grow to the largest sample written, and are kept for the next.
 */
-bool TestWindowsAPI(
-	bool		standardOutput,
+struct EmulatedSample {
+	enum Encoding	encoding;
+	char		*buffer;
+	wchar_t		*formatted;		// formatted C output before encoding
+	size_t		capacity;		// characters that the buffers have room for
+	bool		multibyteUTF8;		// whether c16rtomb() and c32rtomb() produce UTF-8
+	};
+
+
+/*	IsMultibyteUTF8
+	Whether the C locale's multibyte characters are UTF-8, by converting one outside ASCII
+*/
+static bool IsMultibyteUTF8(void)
+{
+char bytes[8];
+mbstate_t state = { 0 };
+
+return c32rtomb(bytes, 0x20AC, &state) == 3 && memcmp(bytes, "\xE2\x82\xAC", 3) == 0;
+}
+
+
+/*	OpenEmulatedSample
+	Prepare for emulating the given Mode
+*/
+static void OpenEmulatedSample(
+	struct EmulatedSample *emulated,
 	enum Mode	mode
 	)
 {
-HANDLE handle;
+#ifdef _WIN32
+/* the CRT converts the wide modes itself */
+emulated->encoding = IsCodeUnitMode(mode) ? gModeEncodings[mode] : kEncodingNone;
+#else
+emulated->encoding = gModeEncodings[mode];
+#endif
+emulated->buffer = NULL;
+emulated->formatted = NULL;
+emulated->capacity = 0;
+emulated->multibyteUTF8 = IsCodeUnitMode(mode) && IsMultibyteUTF8();
+}
 
-// check for unsupported modes
-if (mode == kModeUnicode || mode == kModeWideUnicode) {
-	fprintf(stderr, "error: no specific 'unicode' modes in Windows API\n");
+
+/*	ReserveEmulatedSample
+	Make room for encoding the sample, and formatting it as wide characters if asked
+	Return whether the call failed
+*/
+static bool ReserveEmulatedSample(
+	struct EmulatedSample *emulated,
+	const struct SampleText *text,
+	bool		isWideFormatted
+	)
+{
+const size_t chunk = GetNarrowChunk(text->length);
+if (!emulated->encoding || text->width == 1 || chunk <= emulated->capacity) return false;
+
+/* c16rtomb() and c32rtomb() produce the C locale's multibyte characters, which may take more */
+const size_t bound = EncodeBound(emulated->encoding, chunk);
+char *const buffer = realloc(emulated->buffer, bound > chunk * MB_CUR_MAX ? bound : chunk * MB_CUR_MAX);
+if (!buffer) {
+	fprintf(stderr, "error: can't allocate encoding buffer\n");
 	return true;
 	}
+emulated->buffer = buffer;
 
-// get output handle
-if (standardOutput)
-	handle = GetStdHandle(STD_OUTPUT_HANDLE);
+if (isWideFormatted) {
+	wchar_t *const formatted = realloc(emulated->formatted, (chunk + 1) * sizeof *formatted);
+	if (!formatted) {
+		fprintf(stderr, "error: can't allocate formatting buffer\n");
+		return true;
+		}
+	emulated->formatted = formatted;
+	}
 
-else
-	handle = CreateFileA("output", GENERIC_WRITE, 0 /* no sharing */, NULL /* security */, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL /* template */);
+emulated->capacity = chunk;
 
-if (handle == INVALID_HANDLE_VALUE) {
-	fprintf(stderr, "error: couldn't get handle for API output\n");
-	return true;
+return false;
+}
+
+
+/*	CloseEmulatedSample
+	Release the buffers
+*/
+static void CloseEmulatedSample(
+	struct EmulatedSample *emulated
+	)
+{
+free(emulated->buffer);
+free(emulated->formatted);
+}
+
+
+/*	GetChunk
+	Get the next piece of the sample to write, encoding it explicitly for an emulated Mode
+	Return the number of code units of the sample that it covers
+*/
+static size_t GetChunk(
+	const struct EmulatedSample *emulated,
+	const struct SampleText *text,
+	size_t		offset,
+	const void	**buffer,
+	size_t		*bytes
+	)
+{
+const size_t chunk = GetTextChunk(text, offset);
+const char *const units = (const char*) text->units + offset * text->width;
+
+// wide or char16/char32, emulated?
+if (emulated->encoding && text->width > 1) {
+	*buffer = emulated->buffer;
+	*bytes = EncodeUnits(emulated->encoding, units, text->width, chunk, emulated->buffer);
 	}
 
-// check if mode supported on this handle
-/* Console API works only on console handles, not on file handles: it doesn't matter whether we opened
-   the file ourselves, or whether the standard handle was a file handle by virtue of redirection. */
-DWORD consoleMode;
-const bool isConsole = GetConsoleMode(handle, &consoleMode) != 0;
-if (!isConsole && (mode == kModeText || mode == kModeWide)) {
-	fprintf(stderr,"error: winapi Console APIs ('text' and 'wide') not supported against file (neither explicit or by redirection)\n");
-	return true;
+// narrow, char8, or wide left to the CRT
+else {
+	*buffer = units;
+	*bytes = chunk * text->width;
 	}
 
-bool failed = false;
+return chunk;
+}
 
-// perform output
-DWORD write;
-DWORD written;
-BOOL succeeded;
-switch (mode) {
-	case kModeBinary:
-		write = sizeof gSample / sizeof *gSample;
-		succeeded = WriteFile(handle, gSample, write, &written, NULL /* overlapped */);
-		break;
-	
-	case kModeText:
-		write = sizeof gSample / sizeof *gSample;
-		succeeded = WriteConsoleA(handle, gSample, write, &written, NULL);
-		break;
-	
-	case kModeWide:
-		write = sizeof gSampleWide / sizeof *gSampleWide;
-		succeeded = WriteConsoleW(handle, gSampleWide, write, &written, NULL);
-		break;
-	}
-if (!succeeded) { fprintf(stderr, "error: API write failed\n"); failed = true; }
-else if (written != write) { fprintf(stderr, "error: unable to write entire output\n"); failed = true; }
 
-// close
-if (!standardOutput) CloseHandle(handle);
+/*	WriteByteOrderMark
+	Write the byte order mark that the CRT puts at the start of a newly created file in
+	the given Mode
+	Return whether the call failed
+*/
+static bool WriteByteOrderMark(
+	int		fd,
+	enum Mode	mode
+	)
+{
+const char *mark;
+const size_t markLength = GetModeByteOrderMark(mode, &mark);
 
-return failed;
+return markLength && WriteOutputFile(fd, mark, markLength);
 }
 
 
@@ -117,10 +200,15 @@ static const int gPOSIXOpenModes[] = {
 	/* kText */		_O_TEXT,
 	/* kWide */		_O_WTEXT,
 	/* kUnicode */		_O_U8TEXT,
-	/* kWideUnicode */	_O_U16TEXT
+	/* kWideUnicode */	_O_U16TEXT,
+	/* kChar8 */		_O_BINARY,
+	/* kChar16 */		_O_BINARY,
+	/* kChar32 */		_O_BINARY
 	};
 
 
+#ifdef _WIN32
+
 /*	gCOpenModes
 	fopen() ‘mode’ parameter corresponding to Mode
 */
@@ -130,100 +218,492 @@ static const char *const gCOpenModes[] = {
 	/* kText */		"w",
 	/* kWide */		"w,ccs=unicode",
 	/* kUnicode */		"w,ccs=utf-8",
-	/* kUnicodeWide */	"w,ccs=utf-16le"
+	/* kUnicodeWide */	"w,ccs=utf-16le",
+	/* kChar8 */		"wb",
+	/* kChar16 */		"wb",
+	/* kChar32 */		"wb"
+	};
+
+#endif
+
+
+/*	Sink
+	Output of the winapi, posix, C and C++ methods, kept open between writes
+*/
+struct Sink {
+	enum Method	method;
+	enum Mode	mode;
+	bool		isWideMode;
+	bool		standardOutput;
+#ifdef _WIN32
+	HANDLE		handle;			// winapi
+#endif
+	int		fd;			// posix
+	FILE		*file;			// C
+	struct EmulatedSample emulated;		// posix and C
+	struct CPlusPlusSink *stream;		// C++
 	};
 
 
-/*	TestPOSIX
-	POSIX-style API test cases
+#ifdef _WIN32
+
+/*	OpenWindowsAPISink
+	Get the Windows API output handle
+	Return whether the call failed
+*/
+static bool OpenWindowsAPISink(
+	struct Sink	*sink
+	)
+{
+// check for unsupported modes
+if (sink->mode == kModeUnicode || sink->mode == kModeWideUnicode) {
+	fprintf(stderr, "error: no specific 'unicode' modes in Windows API\n");
+	return true;
+	}
+
+if (sink->mode == kModeChar32) {
+	fprintf(stderr, "error: no conversion from UTF-32 ('char32') in Windows API\n");
+	return true;
+	}
+
+// get output handle
+if (sink->standardOutput)
+	sink->handle = GetStdHandle(STD_OUTPUT_HANDLE);
+
+else
+	sink->handle = CreateFileA(gFileName, GENERIC_WRITE, 0 /* no sharing */, NULL /* security */, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL /* template */);
+
+if (sink->handle == INVALID_HANDLE_VALUE) {
+	fprintf(stderr, "error: couldn't get handle for API output\n");
+	return true;
+	}
+
+// check if mode supported on this handle
+/* Console API works only on console handles, not on file handles: it doesn't matter whether we opened
+   the file ourselves, or whether the standard handle was a file handle by virtue of redirection. */
+DWORD consoleMode;
+const bool isConsole = GetConsoleMode(sink->handle, &consoleMode) != 0;
+if (!isConsole && (sink->mode == kModeText || sink->mode == kModeWide)) {
+	fprintf(stderr,"error: winapi Console APIs ('text' and 'wide') not supported against file (neither explicit or by redirection)\n");
+	if (!sink->standardOutput) CloseHandle(sink->handle);
+	return true;
+	}
+
+return false;
+}
+
+
+/*	WriteWindowsAPI
+	Write the sample with the Windows API
+	Return whether the call failed
+*/
+static bool WriteWindowsAPI(
+	struct Sink	*sink,
+	const struct Sample *sample
+	)
+{
+const struct SampleText text = GetSampleText(sample, sink->mode);
+if (ReserveEmulatedSample(&sink->emulated, &text, false)) return true;
+
+DWORD write;
+DWORD written;
+BOOL succeeded;
+for (size_t offset = 0, chunk; offset < text.length; offset += chunk) {
+	const char *const units = (const char*) text.units + offset * text.width;
+	switch (sink->mode) {
+		case kModeBinary:
+		case kModeChar8:
+			write = (DWORD) (chunk = GetNarrowChunk(text.length - offset));
+			succeeded = WriteFile(sink->handle, units, write, &written, NULL /* overlapped */);
+			break;
+		
+		case kModeText:
+			write = (DWORD) (chunk = GetNarrowChunk(text.length - offset));
+			succeeded = WriteConsoleA(sink->handle, units, write, &written, NULL);
+			break;
+		
+		case kModeWide:
+			write = (DWORD) (chunk = GetTextChunk(&text, offset));
+			succeeded = WriteConsoleW(sink->handle, (const wchar_t*) units, write, &written, NULL);
+			break;
+		
+		/* char16_t is wchar_t here, so the API's own conversion applies */
+		case kModeChar16:
+			chunk = GetTextChunk(&text, offset);
+			write = (DWORD) WideCharToMultiByte(
+				CP_UTF8, 0, (const wchar_t*) units, (int) chunk,
+				sink->emulated.buffer, (int) EncodeBound(kEncodingUTF8, chunk), NULL, NULL
+				);
+			succeeded = write != 0 && WriteFile(sink->handle, sink->emulated.buffer, write, &written, NULL /* overlapped */);
+			break;
+		}
+	if (!succeeded) { fprintf(stderr, "error: API write failed\n"); return true; }
+	else if (written != write) { fprintf(stderr, "error: unable to write entire output\n"); return true; }
+	}
+
+return false;
+}
+
+
+/*	CloseWindowsAPISink
+	Close the handle, if it was opened for the sink
+*/
+static void CloseWindowsAPISink(
+	struct Sink	*sink
+	)
+{
+if (!sink->standardOutput) CloseHandle(sink->handle);
+}
+
+#else
+
+/*	OpenWindowsAPISink
+	Get the Windows API output handle
+	Return whether the call failed
+*/
+static bool OpenWindowsAPISink(
+	struct Sink	*sink
+	)
+{
+fprintf(stderr, "error: winapi is only available on Windows\n");
+return true;
+}
+
+
+/*	WriteWindowsAPI
+	Write the sample with the Windows API
+	Return whether the call failed
+*/
+static bool WriteWindowsAPI(
+	struct Sink	*sink,
+	const struct Sample *sample
+	)
+{
+return true;
+}
+
+
+/*	CloseWindowsAPISink
+	Close the handle, if it was opened for the sink
+*/
+static void CloseWindowsAPISink(
+	struct Sink	*sink
+	)
+{
+}
+
+#endif
+
+
+/*	OpenPOSIXSink
+	Get the output file descriptor
+	Return whether the call failed
+*/
+static bool OpenPOSIXSink(
+	struct Sink	*sink
+	)
+{
+if (sink->standardOutput) {
+	// use standard output
+	sink->fd = _fileno(stdout);
+	
+	// retroactively apply the 'open()' mode
+	if (_setmode(sink->fd, gPOSIXOpenModes[sink->mode]) == -1) {
+		fprintf(stderr, "error: can't apply mode to standard output\n");
+		return true;
+		}
+	}
+
+else {
+	if ((sink->fd = OpenOutputFile(gPOSIXOpenModes[sink->mode])) == -1) {
+		fprintf(stderr, "error: can't open file for output\n");
+		return true;
+		}
+	
+	// emulated Unicode mode starts a new file with a byte order mark
+	if (sink->emulated.encoding && WriteByteOrderMark(sink->fd, sink->mode)) {
+		fprintf(stderr, "error: unable to write byte order mark\n");
+		CloseOutputFile(sink->fd);
+		return true;
+		}
+	}
+
+return false;
+}
+
+
+/*	WritePOSIX
+	Write the sample with POSIX-style I/O
+	Return whether the call failed
+*/
+static bool WritePOSIX(
+	struct Sink	*sink,
+	const struct Sample *sample
+	)
+{
+const struct SampleText text = GetSampleText(sample, sink->mode);
+if (ReserveEmulatedSample(&sink->emulated, &text, false)) return true;
+
+for (size_t offset = 0; offset < text.length;) {
+	const void *buffer;
+	size_t write;
+	offset += GetChunk(&sink->emulated, &text, offset, &buffer, &write);
+	
+	/* what the CRT converts itself can't be checked here */
+	if ((!sink->isWideMode || sink->emulated.encoding) && CheckOutput(buffer, write)) return true;
+	
+	if (WriteOutputFile(sink->fd, buffer, write)) { fprintf(stderr, "error: unable to write entire output\n"); return true; }
+	}
+
+return false;
+}
+
+
+/*	TestSIMD
+	Vectorized transcoder test cases
 	Return whether call failed
+	
+	The Mode determines the encoding in the same way as the Windows Unicode modes do, but the
+	conversion is done by EncodeSIMDUnits() and the result written in binary.
 */
-bool TestPOSIX(
+bool TestSIMD(
 	bool		standardOutput,
 	enum Mode	mode,
-	bool		isWideMode
+	const struct Sample *sample,
+	size_t		repeat
 	)
 {
+/* the narrow modes and char8 are written as they are */
+const struct SampleText text = GetSampleText(sample, mode);
+const enum Encoding encoding = text.width > 1 ? gModeEncodings[mode] : kEncodingNone;
+fprintf(stderr, "info: simd transcoder is using the %s kernel\n", GetSIMDKernelName());
+
 // get output file descriptor
 int fd;
 if (standardOutput) {
-	// use standard output
 	fd = _fileno(stdout);
 	
-	// retroactively apply the 'open()' mode
-	if (_setmode(fd, gPOSIXOpenModes[mode]) == -1) {
+	if (_setmode(fd, _O_BINARY) == -1) {
 		fprintf(stderr, "error: can't apply mode to standard output\n");
 		return true;
 		}
 	}
 
-else {
-	if ((fd = _open(gFileName, _O_WRONLY | _O_CREAT | _O_TRUNC | gPOSIXOpenModes[mode], _S_IREAD | _S_IWRITE)) == -1) {
-		fprintf(stderr, "error: can't open file for output\n");
-		return true;
-		}
+else if ((fd = OpenOutputFile(_O_BINARY)) == -1) {
+	fprintf(stderr, "error: can't open file for output\n");
+	return true;
 	}
 
 bool failed = false;
 
-// perform output
-unsigned int write;
-int written;
-if (!isWideMode)
-	written = _write(fd, gSample, (write = sizeof gSample));
+// allocate output buffer
+char *encoded = NULL;
+if (encoding && !(encoded = malloc(EncodeBound(encoding, GetNarrowChunk(text.length))))) {
+	fprintf(stderr, "error: can't allocate encoding buffer\n");
+	failed = true;
+	}
 
-else
-	written = _write(fd, gSampleWide, (write = sizeof gSampleWide));
+// start the file as the Windows Unicode modes would
+if (!failed && !standardOutput && WriteByteOrderMark(fd, mode)) {
+	fprintf(stderr, "error: unable to write byte order mark\n");
+	failed = true;
+	}
+
+// perform output
+for (; repeat && !failed; repeat--, MarkWrite())
+	for (size_t offset = 0, chunk; offset < text.length && !failed; offset += chunk) {
+		const char *const units = (const char*) text.units + offset * text.width;
+		const void *buffer;
+		size_t write;
+		char *staged = NULL;
+		if (encoding) {
+			chunk = GetTextChunk(&text, offset);
+			
+			/* with O_DIRECT, encode straight into the aligned staging buffer */
+			if (!standardOutput) staged = ReserveOutputFile(fd, EncodeBound(encoding, chunk));
+			write = EncodeSIMDUnits(encoding, units, text.width, chunk, staged ? staged : encoded);
+			buffer = staged ? staged : encoded;
+			}
+		
+		else {
+			write = chunk = GetNarrowChunk(text.length - offset);
+			buffer = units;
+			}
+		
+		if (CheckOutput(buffer, write)) { failed = true; break; }
+		
+		if (staged ? CommitOutputFile(fd, write) : WriteOutputFile(fd, buffer, write)) {
+			fprintf(stderr, "error: unable to write entire output\n");
+			failed = true;
+			}
+		}
 
-if (written != write) { fprintf(stderr, "error: unable to write entire output\n"); failed = true; }
+if (!failed && !standardOutput && FlushOutputFile(fd)) {
+	fprintf(stderr, "error: unable to write entire output\n");
+	failed = true;
+	}
 
 // close
-if (!standardOutput) _close(fd);
+free(encoded);
+if (!standardOutput) CloseOutputFile(fd);
 
 return failed;
 }
 
 
-/*	TestCUnformatted
-	Standard C unformatted I/O test cases
+/*	WriteCUnformatted
+	Write the sample with standard C unformatted I/O
 	Return if call failed
 */
-static bool TestCUnformatted(
-	FILE		*file,
-	bool		isWideMode
+static bool WriteCUnformatted(
+	struct Sink	*sink,
+	const struct Sample *sample
 	)
 {
-size_t write, written;
-if (!isWideMode)
-	written = fwrite(gSample, sizeof *gSample, (write = sizeof gSample / sizeof *gSample), file);
+const struct SampleText text = GetSampleText(sample, sink->mode);
+if (ReserveEmulatedSample(&sink->emulated, &text, false)) return true;
 
-else
-	written = fwrite(gSampleWide, sizeof *gSampleWide, (write = sizeof gSampleWide / sizeof *gSampleWide), file);
+for (size_t offset = 0; offset < text.length;) {
+	const void *buffer;
+	size_t write;
+	offset += GetChunk(&sink->emulated, &text, offset, &buffer, &write);
+	
+	/* what the CRT converts itself can't be checked here */
+	if ((!sink->isWideMode || sink->emulated.encoding) && CheckOutput(buffer, write)) return true;
+	
+	const size_t written = fwrite(buffer, 1, write, sink->file);
+	if (written != write) { fprintf(stderr, "error: unable to write entire output %zu %zu\n", write, written); return true; }
+	}
+
+return false;
+}
 
-if (written != write) { fprintf(stderr, "error: unable to write entire output %d %dt\n", write, written); return true; }
+
+/*	ConvertToMultibyte
+	Convert char16_t or char32_t code units to the multibyte characters of the C locale with
+	c16rtomb() or c32rtomb()
+	Return the number of bytes produced, or (size_t) -1 if a character can't be converted
+*/
+static size_t ConvertToMultibyte(
+	const struct SampleText *text,
+	size_t		offset,
+	size_t		length,
+	char		*output
+	)
+{
+mbstate_t state = { 0 };
+char *o = output;
+
+for (size_t i = offset; i < offset + length; i++) {
+	/* the first half of a surrogate pair produces nothing until the second */
+	const size_t produced = text->width == 2 ?
+		c16rtomb(o, ((const char16_t*) text->units)[i], &state) :
+		c32rtomb(o, ((const char32_t*) text->units)[i], &state);
+	if (produced == (size_t) -1) return produced;
+	
+	o += produced;
+	}
+
+return o - output;
+}
+
+
+/*	WriteCFormatted
+	Write the sample with standard C formatted I/O
+	Return if call failed
+*/
+static bool WriteCFormatted(
+	struct Sink	*sink,
+	const struct Sample *sample
+	)
+{
+// buffer for formatting before explicit encoding
+struct EmulatedSample *const emulated = &sink->emulated;
+const struct SampleText text = GetSampleText(sample, sink->mode);
+if (ReserveEmulatedSample(emulated, &text, sink->isWideMode)) return true;
+
+/* The samples aren't NUL-terminated, so the length has to be given as precision rather than
+   width; and 'ls' rather than Microsoft's 's' for a wide string in fwprintf() */
+const size_t length = text.length;
+for (size_t offset = 0, chunk; offset < length; offset += chunk) {
+	int write;
+	int written;
+	if (sink->isWideMode && emulated->encoding) {
+		/* Format into a wide buffer as fwprintf() would, then encode that explicitly */
+		chunk = GetWideChunk(sample->wide + offset, length - offset);
+		written = swprintf(emulated->formatted, chunk + 1, L"%.*ls", (write = (int) chunk), sample->wide + offset);
+		if (written > 0) {
+			const size_t encoded = Encode(emulated->encoding, emulated->formatted, written, emulated->buffer);
+			if (CheckOutput(emulated->buffer, encoded)) return true;
+			if (fwrite(emulated->buffer, 1, encoded, sink->file) != encoded) written = -1;
+			}
+		}
+	
+	else if (sink->mode == kModeChar16 || sink->mode == kModeChar32) {
+		/* There is no printf() of char16_t or char32_t; convert to the C locale's multibyte
+		   characters first, and print those; unless they aren't UTF-8, which is what the
+		   mode writes, and then encode it explicitly instead */
+		chunk = GetTextChunk(&text, offset);
+		const size_t converted = emulated->multibyteUTF8 ?
+			ConvertToMultibyte(&text, offset, chunk, emulated->buffer) :
+			EncodeUnits(emulated->encoding, (const char*) text.units + offset * text.width, text.width, chunk, emulated->buffer);
+		if (converted == (size_t) -1) {
+			fprintf(stderr, "error: %s() can't convert the sample; it isn't well-formed\n",
+				text.width == 2 ? "c16rtomb" : "c32rtomb"
+				);
+			return true;
+			}
+		
+		if (CheckOutput(emulated->buffer, converted)) return true;
+		written = fprintf(sink->file, "%.*s", (write = (int) converted), emulated->buffer);
+		}
+	
+	else if (!sink->isWideMode) {
+		/* This doesn't accept files opened in POSIX style _O_U8TEXT; use fwprintf() */
+		const char *const narrow = (const char*) text.units + offset;
+		chunk = GetNarrowChunk(length - offset);
+		if (CheckOutput(narrow, chunk)) return true;
+		written = fprintf(sink->file, "%.*s", (write = (int) chunk), narrow);
+		}
+	
+	else {
+		chunk = GetWideChunk(sample->wide + offset, length - offset);
+		written = fwprintf(sink->file, L"%.*ls", (write = (int) chunk), sample->wide + offset);
+		}
+	
+	if (written != write) { fprintf(stderr, "error: unable to write entire output\n"); return true; }
+	}
 
 return false;
 }
 
 
-/*	TestCFormatted
-	Standard C formatted I/O test cases
+/*	gCBufferingModes
+	setvbuf() mode corresponding to BufferingPolicy
+*/
+static const int gCBufferingModes[] = {
+	/* kBufferingDefault */	0,
+	/* kBufferingFull */	_IOFBF,
+	/* kBufferingLine */	_IOLBF,
+	/* kBufferingNone */	_IONBF
+	};
+
+
+/*	SetCBuffering
+	Apply the given buffering to a C stream, before any output to it
 */
-static bool TestCFormatted(
+bool SetCBuffering(
 	FILE		*file,
-	bool		isWideMode
+	const struct Buffering *buffering
 	)
 {
-int write;
-size_t written;
-if (!isWideMode)
-	/* This doesn't accept files opened in POSIX style _O_U8TEXT; use fwprintf() */
-	written = fprintf(file, "%*s", (write = (int) (sizeof gSample / sizeof *gSample)), gSample);
+if (buffering->policy == kBufferingDefault) return false;
 
-else
-	written = fwprintf(file, L"%*s", (write = (int) (sizeof gSampleWide / sizeof *gSampleWide)), gSampleWide);
-
-if (written != write) { fprintf(stderr, "error: unable to write entire output\n"); return true; }
+/* Let the library allocate the buffer; note that the Microsoft CRT treats _IOLBF as _IOFBF */
+if (setvbuf(file, NULL, gCBufferingModes[buffering->policy], buffering->size ? buffering->size : BUFSIZ) != 0) {
+	fprintf(stderr, "error: can't apply buffering to stream\n");
+	return true;
+	}
 
 return false;
 }
@@ -250,48 +730,242 @@ return false;
 	Open a C file stream applying the appropriate C file mode
 */
 FILE *OpenFileWithCMode(
-	enum Mode	mode
+	enum Mode	mode,
+	const struct Buffering *buffering
 	)
 {
-return fopen(gFileName, gCOpenModes[mode]);
+#ifdef _WIN32
+FILE *const file = fopen(gFileName, gCOpenModes[mode]);
+if (!file) return NULL;
+
+if (SetCBuffering(file, buffering)) {
+	fclose(file);
+	return NULL;
+	}
+
+return file;
+
+#else
+// there is no 'ccs=' to ask for; open as bytes and start with the byte order mark it would have written
+FILE *const file = fopen(gFileName, "wb");
+if (!file) return NULL;
+
+if (SetCBuffering(file, buffering)) {
+	fclose(file);
+	return NULL;
+	}
+
+const char *mark;
+const size_t markLength = GetModeByteOrderMark(mode, &mark);
+if (markLength && fwrite(mark, 1, markLength, file) != markLength) {
+	fclose(file);
+	return NULL;
+	}
+
+return file;
+#endif
 }
 
 
-/*	TestC
-	Standard C I/O test cases
+/*	OpenCSink
+	Get the output C stream
+	Return whether the call failed
 */
-bool TestC(
-	bool		standardOutput,
-	enum Mode	mode,
-	bool		isWideMode,
-	bool		isMethodFormatted
+static bool OpenCSink(
+	struct Sink	*sink,
+	const struct Buffering *buffering
 	)
 {
-FILE *file;
-if (standardOutput) {
-	file = stdout;
+if (sink->standardOutput) {
+	sink->file = stdout;
 	
-	SetPOSIXModeForStandardOutput(mode);
+	SetPOSIXModeForStandardOutput(sink->mode);
+	if (SetCBuffering(sink->file, buffering)) return true;
 	}
 
 else {
 	// open
-	file = OpenFileWithCMode(mode);
-	if (!file) return true;
+	sink->file = OpenFileWithCMode(sink->mode, buffering);
+	if (!sink->file) return true;
 	
 	/* Thought about applying fwide() here, even though it isn't really necessary; however, it's unimplemented. */
 	}
 
-bool failed = false;
+return false;
+}
 
-if (!isMethodFormatted)
-	failed = TestCUnformatted(file, isWideMode);
 
-else
-	failed = TestCFormatted(file, isWideMode);
+/*	CreateSink
+	Open the output of the given method, configured for the given Mode and options
+	Return the sink, or NULL if the call failed
+*/
+struct Sink *CreateSink(
+	enum Method	method,
+	enum Mode	mode,
+	const struct SinkOptions *options
+	)
+{
+struct Sink *const sink = malloc(sizeof *sink);
+if (!sink) {
+	fprintf(stderr, "error: can't allocate sink\n");
+	return NULL;
+	}
+
+sink->method = method;
+sink->mode = mode;
+sink->isWideMode = mode == kModeWide || mode == kModeUnicode || mode == kModeWideUnicode;
+sink->standardOutput = options->standardOutput;
+sink->file = NULL;
+sink->stream = NULL;
+OpenEmulatedSample(&sink->emulated, mode);
+if (method == kMethodCFormatted && (mode == kModeChar16 || mode == kModeChar32) && !sink->emulated.multibyteUTF8)
+	fprintf(stderr, "info: the C locale isn't UTF-8; encoding the code units explicitly rather than with %s()\n",
+		mode == kModeChar16 ? "c16rtomb" : "c32rtomb"
+		);
+
+bool failed;
+switch (method) {
+	case kMethodWindowsAPI:
+		failed = OpenWindowsAPISink(sink);
+		break;
+	
+	case kMethodPOSIX:
+		failed = OpenPOSIXSink(sink);
+		break;
+	
+	case kMethodCUnformatted:
+	case kMethodCFormatted:
+		failed = OpenCSink(sink, &options->buffering);
+		break;
+	
+	case kMethodCPPUnformatted:
+	case kMethodCPPFormatted:
+		sink->stream = CreateCPlusPlusSink(
+			options->standardOutput, mode, sink->isWideMode, options->locale, options->facet,
+			method == kMethodCPPFormatted, &options->buffering
+			);
+		failed = !sink->stream;
+		break;
+	
+	default:
+		fprintf(stderr, "error: method has no sink; it opens and closes its output itself\n");
+		failed = true;
+	}
+
+if (failed) {
+	free(sink);
+	return NULL;
+	}
+
+return sink;
+}
+
+
+/*	WriteSink
+	Write the sample once
+	Return whether the call failed
+*/
+bool WriteSink(
+	struct Sink	*sink,
+	const struct Sample *sample
+	)
+{
+switch (sink->method) {
+	case kMethodWindowsAPI:		return WriteWindowsAPI(sink, sample);
+	case kMethodPOSIX:		return WritePOSIX(sink, sample);
+	case kMethodCUnformatted:	return WriteCUnformatted(sink, sample);
+	case kMethodCFormatted:		return WriteCFormatted(sink, sample);
+	default:			return WriteCPlusPlusSink(sink->stream, sample);
+	}
+}
 
-// close
-if (!standardOutput) fclose(file);
+
+/*	FlushSink
+	Hand whatever the sink's stream buffer holds to the system
+	Return whether the call failed
+*/
+bool FlushSink(
+	struct Sink	*sink
+	)
+{
+switch (sink->method) {
+	case kMethodCUnformatted:
+	case kMethodCFormatted:
+		if (fflush(sink->file) != 0) {
+			fprintf(stderr, "error: unable to write entire output\n");
+			return true;
+			}
+		return false;
+	
+	case kMethodCPPUnformatted:
+	case kMethodCPPFormatted:
+		return FlushCPlusPlusSink(sink->stream);
+	
+	// posix writes straight to the system, unless it is staged for O_DIRECT
+	case kMethodPOSIX:
+		if (FlushOutputFile(sink->fd)) {
+			fprintf(stderr, "error: unable to write entire output\n");
+			return true;
+			}
+		return false;
+	
+	// winapi writes straight to the system
+	default:
+		return false;
+	}
+}
+
+
+/*	DestroySink
+	Flush and close the output (but not standard output), and release the sink
+	Return whether the call failed
+*/
+bool DestroySink(
+	struct Sink	*sink
+	)
+{
+bool failed = false;
+
+switch (sink->method) {
+	case kMethodWindowsAPI:
+		CloseWindowsAPISink(sink);
+		break;
+	
+	case kMethodPOSIX:
+		if (!sink->standardOutput) CloseOutputFile(sink->fd);
+		break;
+	
+	case kMethodCUnformatted:
+	case kMethodCFormatted:
+		failed = FlushSink(sink);
+		if (!sink->standardOutput) fclose(sink->file);
+		break;
+	
+	default:
+		failed = DestroyCPlusPlusSink(sink->stream);
+		break;
+	}
+
+CloseEmulatedSample(&sink->emulated);
+free(sink);
 
 return failed;
 }
+
+
+/*	TestSink
+	Write the sample 'repeat' times, then flush the sink
+	Return whether the call failed
+*/
+bool TestSink(
+	struct Sink	*sink,
+	const struct Sample *sample,
+	size_t		repeat
+	)
+{
+bool failed = false;
+for (; repeat && !failed; repeat--, MarkWrite())
+	failed = WriteSink(sink, sample);
+
+return failed || FlushSink(sink);
+}
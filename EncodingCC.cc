@@ -22,47 +22,144 @@
 
 #define _CRT_SECURE_NO_WARNINGS
 
-/* Note that the codecvt approach demonstrated here is deprecated as of C++17. */
-#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
-
-#include <codecvt>
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
 #include <fstream>
 #include <locale>
 #include <memory>
+#include <string>
+
+#ifndef _WIN32
+#include <ext/stdio_filebuf.h>
+#endif
 
 #include "Encoding.h"
+#include "Locales.h"
+#include "Platform.h"
+#include "Transcode.h"
 
 
 
-/*	TestCPlusPlusNarrowStream
-	Perform I/O on narrow-character stream
+/*	ImbueNarrowStream
+	Prepare a narrow-character stream for output
 */
-static void TestCPlusPlusNarrowStream(
+static void ImbueNarrowStream(
 	std::ostream	&stream,
-	enum Mode	mode,
-	bool		isMethodFormatted,
 	const char	*locale
 	)
 {
 // imbue stream with locale for the purpose of character set conversion
 if (locale)
-	stream.imbue(std::locale(locale));
+	stream.imbue(GetLocale(locale));
+}
 
-// perform output
-if (!isMethodFormatted)
-	stream.write(gSample, sizeof gSample);
 
-else
-	stream << std::string_view(gSample, sizeof gSample / sizeof *gSample);
+/*	WriteNarrowStream
+	Write the sample to a narrow-character stream
+*/
+static void WriteNarrowStream(
+	std::ostream	&stream,
+	bool		isMethodFormatted,
+	const Sample	&sample
+	)
+{
+for (size_t offset = 0, chunk; offset < sample.narrowLength && !stream.fail(); offset += chunk) {
+	chunk = GetNarrowChunk(sample.narrowLength - offset);
+	
+	if (!isMethodFormatted)
+		stream.write(sample.narrow + offset, chunk);
+	
+	else
+		stream << std::string_view(sample.narrow + offset, chunk);
+	}
 
 // find whether the stream is in a 'failed' state
 if (stream.fail()) throw "output stream has failed";
 }
 
 
-/*	TestCPlusPlusWideStream
-	Perform I/O on wide-character stream
+/*	ConvertUnits
+	Convert code units to UTF-8 with the standard codecvt facet for their width
+	Return the number of bytes
+*/
+template <typename Unit>
+static size_t ConvertUnits(
+	const Unit	*units,
+	size_t		length,
+	char		*output
+	)
+{
+/* The char16_t and char32_t facets convert to and from UTF-8 whatever the locale */
+const auto &facet = std::use_facet<std::codecvt<Unit, char, std::mbstate_t>>(std::locale::classic());
+
+std::mbstate_t state {};
+const Unit *next;
+char *end;
+if (facet.out(state, units, units + length, next, output, output + EncodeBound(kEncodingUTF8, length), end) != std::codecvt_base::ok)
+	throw "codecvt can't convert the sample to UTF-8";
+
+return end - output;
+}
+
+
+/*	WriteUnitsStream
+	Write the code units of the sample to a narrow-character stream as UTF-8
+*/
+static void WriteUnitsStream(
+	std::ostream	&stream,
+	bool		isMethodFormatted,
+	const SampleText &text,
+	std::string	&converted
+	)
+{
+for (size_t offset = 0, chunk; offset < text.length && !stream.fail(); offset += chunk) {
+	chunk = GetTextChunk(&text, offset);
+	
+	// convert code units wider than a byte
+	const char *bytes = static_cast<const char*>(text.units) + offset;
+	size_t length = chunk;
+	if (text.width > 1) {
+		converted.resize(EncodeBound(kEncodingUTF8, chunk));
+		length = text.width == 2 ?
+			ConvertUnits(static_cast<const char16_t*>(text.units) + offset, chunk, &converted[0]) :
+			ConvertUnits(static_cast<const char32_t*>(text.units) + offset, chunk, &converted[0]);
+		bytes = converted.data();
+		}
+	
+	if (!isMethodFormatted)
+		stream.write(bytes, length);
+	
+	else
+		stream << std::string_view(bytes, length);
+	}
+
+// find whether the stream is in a 'failed' state
+if (stream.fail()) throw "output stream has failed";
+}
+
+
+/*	TestCPlusPlusNarrowStream
+	Perform I/O on narrow-character stream
+*/
+static void TestCPlusPlusNarrowStream(
+	std::ostream	&stream,
+	bool		isMethodFormatted,
+	const char	*locale,
+	const Sample	&sample,
+	size_t		repeat
+	)
+{
+ImbueNarrowStream(stream, locale);
+
+// perform output
+for (; repeat; repeat--, MarkWrite())
+	WriteNarrowStream(stream, isMethodFormatted, sample);
+}
+
+
+/*	ImbueWideStream
+	Prepare a wide-character stream for output
 	
 	
 	It gets complicated here.  The only truly standard C++ mode is 'wide'; the other two require
@@ -86,11 +183,11 @@ if (stream.fail()) throw "output stream has failed";
 		applies nonconverting UTF16-to-UTF16 conversion
 		UTF-16LE BOM
 */
-static void TestCPlusPlusWideStream(
+static void ImbueWideStream(
 	std::wostream	&stream,
 	enum Mode	mode,
-	bool		isMethodFormatted,
-	const char	*locale
+	const char	*locale,
+	enum Facet	facet
 	)
 {
 // imbue stream with locale for the purpose of character set conversion
@@ -104,15 +201,20 @@ switch (mode) {
 	   which interprets the input as UTF-16 and converts it to UTF-8.  It is also influenced
 	   by the locale setting (but not in a useful way, it seems) */
 	case kModeUnicode:
-		if (locale)
-			/* As far as I know, there are no wide-character locales (there is the one corresponding to
-			   Code Pages 1200/1201, which isn't available in native code) so setting a locale this way
-			   implies some sort of wide-to-narrow conversion; so we'll use 'Unicode mode' to do that. */
-			stream.imbue(std::locale(locale));
-		
-		else
-			/* keep the default 'C' locale */
-			;
+#ifndef _WIN32
+		/* Without the Windows 'Unicode mode' underneath, the UTF-8 conversion has to be done
+		   by the stream itself; any locale only contributes its other facets. */
+		if (mode == kModeUnicode) {
+			stream.imbue(GetLocale(locale, kEncodingUTF8, facet));
+			break;
+			}
+#endif
+
+		/* As far as I know, there are no wide-character locales (there is the one corresponding to
+		   Code Pages 1200/1201, which isn't available in native code) so setting a locale this way
+		   implies some sort of wide-to-narrow conversion; so we'll use 'Unicode mode' to do that.
+		   Without one, keep the default 'C' locale. */
+		if (locale) stream.imbue(GetLocale(locale));
 		break;
 	
 	/* */
@@ -120,23 +222,78 @@ switch (mode) {
 		if (locale) throw "construction of 'wide unicode' mode requires no explicit locale";
 		
 		// Can also specify the character set conversion this way
-		stream.imbue(
-			std::locale(stream.getloc(),
-			new std::codecvt_utf16<wchar_t, 0x10ffff, std::little_endian>)
-			);
+		stream.imbue(GetLocale(NULL, kEncodingUTF16LE, facet));
 		break;
+	
+	/* the other modes don't go through a wide-character stream */
+	default:
+		throw "mode doesn't write through a wide-character stream";
 	}
+}
 
-// perform output
-if (!isMethodFormatted)
-	stream.write(gSampleWide, sizeof gSampleWide / sizeof *gSampleWide);
 
-else
-	stream << std::wstring_view(gSampleWide, 6 /* sizeof gSampleWide / sizeof *gSampleWide */);
+/*	WriteWideStream
+	Write the sample to a wide-character stream
+*/
+static void WriteWideStream(
+	std::wostream	&stream,
+	bool		isMethodFormatted,
+	const Sample	&sample
+	)
+{
+/* stop at the first failure; a failed stream would otherwise just spin through the remaining repeats */
+for (size_t offset = 0, chunk; offset < sample.wideLength && !stream.fail(); offset += chunk) {
+	chunk = GetWideChunk(sample.wide + offset, sample.wideLength - offset);
+	
+	if (!isMethodFormatted)
+		stream.write(sample.wide + offset, chunk);
+	
+	else
+		stream << std::wstring_view(sample.wide + offset, chunk);
+	}
+}
+
+
+/*	CloseWideStream
+	Finish output to a wide-character stream
+	Throws if the stream has failed, since then not all of the output was written
+*/
+static void CloseWideStream(
+	std::wostream	&stream
+	)
+{
+/* libstdc++ only converts when the buffer is flushed, so do that here rather than have
+   the failure go unnoticed when the stream is destroyed */
+stream.flush();
 
 // if character set convertion fails, the 'failbit' is set; unsure how to distinguish that particular error though
-if (stream.fail())
+if (stream.fail()) {
 	fprintf(stderr, "info: stream is in 'failed' state; likely due to error in implicit character set conversion\n");
+	throw "output stream has failed";
+	}
+}
+
+
+/*	TestCPlusPlusWideStream
+	Perform I/O on wide-character stream
+*/
+static void TestCPlusPlusWideStream(
+	std::wostream	&stream,
+	enum Mode	mode,
+	bool		isMethodFormatted,
+	const char	*locale,
+	enum Facet	facet,
+	const Sample	&sample,
+	size_t		repeat
+	)
+{
+ImbueWideStream(stream, mode, locale, facet);
+
+// perform output
+for (; repeat && !stream.fail(); repeat--, MarkWrite())
+	WriteWideStream(stream, isMethodFormatted, sample);
+
+CloseWideStream(stream);
 }
 
 
@@ -145,24 +302,153 @@ if (stream.fail())
 	Note that there are no modes to support wide-character output
 */
 static const std::ios::openmode gNarrowIOSOpenModes[] = {
-	/* kNone */		0,
+	/* kNone */		std::ios::openmode(),
 	/* kBinary */		std::ios::binary,
-	/* kText */		0
-	/* kWide */
-	/* kUnicode */
-	/* kWideUnicode */
+	/* kText */		std::ios::openmode(),
+	/* kWide */		std::ios::openmode(),
+	/* kUnicode */		std::ios::openmode(),
+	/* kWideUnicode */	std::ios::openmode(),
+	/* kChar8 */		std::ios::binary,
+	/* kChar16 */		std::ios::binary,
+	/* kChar32 */		std::ios::binary
 	};
 
 
 
-/*	TestCPlusPlusStandardOutput
-	C++ stream I/O standard output-based test cases
+/*	GetStreamBufferLength
+	Number of characters in the stream buffer for the given buffering
+*/
+template <typename Char>
+static size_t GetStreamBufferLength(
+	const Buffering	&buffering
+	)
+{
+size_t length = std::max<size_t>((buffering.size ? buffering.size : BUFSIZ) / sizeof(Char), 2);
+
+#ifdef __GLIBCXX__
+/* libstdc++ converts the whole buffer of a wide stream on the stack (with alloca()) when it
+   flushes it, at up to six bytes per character; keep that well within a typical 8M stack */
+const size_t limit = 256 << 10;
+if (sizeof(Char) > 1 && length > limit) {
+	fprintf(stderr, "info: wide stream buffer limited to %zu characters\n", limit);
+	length = limit;
+	}
+#endif
+
+return length;
+}
+
+
+/*	SetStreamBuffering
+	Apply the given buffering to a file stream, before it is opened
+	Return the buffer, which has to outlive the stream
+*/
+template <typename Char>
+static std::unique_ptr<Char[]> SetStreamBuffering(
+	std::basic_ofstream<Char> &stream,
+	const Buffering	&buffering
+	)
+{
+std::unique_ptr<Char[]> buffer;
+
+switch (buffering.policy) {
+	case kBufferingDefault:
+		break;
+	
+	/* std::filebuf has no notion of lines; the nearest is to flush after every output operation */
+	case kBufferingLine:
+		stream.setf(std::ios::unitbuf);
+		/* fall through */
+	
+	case kBufferingFull: {
+		const size_t length = GetStreamBufferLength<Char>(buffering);
+		buffer.reset(new Char[length]);
+		stream.rdbuf()->pubsetbuf(buffer.get(), length);
+		}
+		break;
+	
+	case kBufferingNone:
+		stream.rdbuf()->pubsetbuf(nullptr, 0);
+		break;
+	}
+
+return buffer;
+}
+
+
+/*	CPlusPlusSink
+	C++ stream kept open between writes, with the locale it was imbued with and whatever
+	buffer, stream buffer and C stream lie under it
+*/
+struct CPlusPlusSink {
+	CPlusPlusSink(bool standardOutput, enum Mode, bool isWideMode, const char *locale, enum Facet, bool isMethodFormatted, const Buffering&);
+	
+	void Write(const Sample&);
+	void Flush();
+	void Close();
+
+private:
+	void OpenStandardOutput(enum Mode, bool isWideMode, const Buffering&);
+	void OpenFile(enum Mode, bool isWideMode, const Buffering&);
+	
+	const enum Mode	mode;
+	const bool	isMethodFormatted;
+	
+	// the char16 and char32 modes' sample converted to UTF-8
+	std::string	converted;
+	
+	// each outlives the ones declared after it
+	std::unique_ptr<char[]> narrowBuffer;
+	std::unique_ptr<wchar_t[]> wideBuffer;
+	std::unique_ptr<FILE, int (*)(FILE*)> file { nullptr, fclose };
+	std::unique_ptr<std::wstreambuf> fileBuffer;
+	std::unique_ptr<std::ostream> narrowFile;
+	std::unique_ptr<std::wostream> wideFile;
+	
+	// the stream written to, whichever of the above or the standard streams it is
+	std::ostream	*narrow = nullptr;
+	std::wostream	*wide = nullptr;
+	};
+
+
+/*	CPlusPlusSink
+	Open the stream and imbue it with the locale
 */
-static void TestCPlusPlusStandardOutput(
+CPlusPlusSink::CPlusPlusSink(
+	bool		standardOutput,
 	enum Mode	mode,
 	bool		isWideMode,
 	const char	*locale,
-	bool		isMethodFormatted
+	enum Facet	facet,
+	bool		isMethodFormatted,
+	const Buffering	&buffering
+	) :
+	mode(mode),
+	isMethodFormatted(isMethodFormatted)
+{
+// standard output?
+if (standardOutput)
+	OpenStandardOutput(mode, isWideMode, buffering);
+
+// open file?
+else
+	OpenFile(mode, isWideMode, buffering);
+
+if (narrow)
+	ImbueNarrowStream(*narrow, locale);
+
+else
+	ImbueWideStream(*wide, mode, locale, facet);
+}
+
+
+/*	OpenStandardOutput
+	Write to the standard stream
+*/
+void CPlusPlusSink::OpenStandardOutput(
+	enum Mode	mode,
+	bool		isWideMode,
+	const Buffering	&buffering
 	)
 {
 if (mode == kModeText)
@@ -172,86 +458,534 @@ if (mode == kModeText)
 else
 	// retroactively apply a POSIX mode to open standard output
 	if (SetPOSIXModeForStandardOutput(mode)) throw "can't apply mode to standard output";
-	
+
+/* The standard streams write through the C stream while synchronized with it */
+if (SetCBuffering(stdout, &buffering)) throw "can't apply buffering to standard output";
+
+#ifndef _WIN32
+/* While synchronized with C stdio, libstdc++'s std::wcout converts through the C locale
+   and ignores the codecvt facet we imbue */
+if (isWideMode)
+	std::ios::sync_with_stdio(false);
+#endif
+
 // narrow mode?
 if (!isWideMode)
-	TestCPlusPlusNarrowStream(std::cout, mode, isMethodFormatted, locale);
+	narrow = &std::cout;
 
 // wide mode?
 else
-	TestCPlusPlusWideStream(std::wcout, mode, isMethodFormatted, locale);
+	wide = &std::wcout;
 }
 
 
-/*	TestCPlusPlusFile
-	C++ stream I/O file-based test cases
+/*	OpenFile
+	Write to a stream opened on the file
 */
-static void TestCPlusPlusFile(
+void CPlusPlusSink::OpenFile(
 	enum Mode	mode,
 	bool		isWideMode,
-	const char	*locale,
-	bool		isMethodFormatted
+	const Buffering	&buffering
 	)
 {
-// narrow mode?	
+// narrow mode?
 if (!isWideMode) {
 	// open using standard method
-	std::ofstream stream(gFileName, gNarrowIOSOpenModes[mode]);
-	if (!stream.is_open()) throw "can't open file for output";
+	auto stream = std::make_unique<std::ofstream>();
+	narrowBuffer = SetStreamBuffering(*stream, buffering);
+	stream->open(gFileName, gNarrowIOSOpenModes[mode]);
+	if (!stream->is_open()) throw "can't open file for output";
 	
-	TestCPlusPlusNarrowStream(stream, mode, isMethodFormatted, locale);
+	narrow = (narrowFile = std::move(stream)).get();
 	}
 
 // wide mode?
 /* We've defined this to mean the 'canonical' C++ wide stream analogous to the narrow stream;
    for purposes of demonstration */
 else if (mode == kModeWide) {
-	std::wofstream stream(gFileName);
-	if (!stream.is_open()) throw "can't open file for output";
+	auto stream = std::make_unique<std::wofstream>();
+	wideBuffer = SetStreamBuffering(*stream, buffering);
+	stream->open(gFileName);
+	if (!stream->is_open()) throw "can't open file for output";
 	
-	TestCPlusPlusWideStream(stream, mode, isMethodFormatted, locale);
+	wide = (wideFile = std::move(stream)).get();
 	}
-	
+
 // narrow or wide 'unicode mode'?
 else {
 	// open as C FILE stream
 	/* Note that it makes no difference whether you use _fwopen(): the orientation of the C stream
 	   is (or, ought to be) determined by fwide() or at least by fprintf()/fwprintf(). */
-	std::unique_ptr<FILE, int (*)(FILE*)> file { OpenFileWithCMode(mode), fclose };
+	file.reset(OpenFileWithCMode(mode, &buffering));
 	if (!file) throw "can't open file for output";
-	
+
+#ifdef _WIN32
 	/* This is a nonstandard Windows extension that allows actual control over the underlying
 	   POSIX I/O stream and the conversions that it applies. */
-	std::wofstream stream(file.get());
-	if (!stream.is_open()) throw "can't open file for output";
+	auto stream = std::make_unique<std::wofstream>(file.get());
+	if (!stream->is_open()) throw "can't open file for output";
+
+#else
+	/* The libstdc++ equivalent of the above; the FILE has no conversion of its own here, so
+	   this only serves to pick up the byte order mark that OpenFileWithCMode() wrote. */
+	/* It has a buffer of its own ahead of the FILE's, which takes the same size; a size of 1
+	   makes it unbuffered */
+	const size_t size =
+		buffering.policy == kBufferingNone ? 1 :
+		buffering.policy == kBufferingDefault ? static_cast<size_t>(BUFSIZ) :
+		GetStreamBufferLength<wchar_t>(buffering);
+	auto buffer = std::make_unique<__gnu_cxx::stdio_filebuf<wchar_t>>(file.get(), std::ios::out, size);
+	if (!buffer->is_open()) throw "can't open file for output";
 	
-	TestCPlusPlusWideStream(stream, mode, isMethodFormatted, locale);
+	auto stream = std::make_unique<std::wostream>(buffer.get());
+	fileBuffer = std::move(buffer);
+	if (buffering.policy == kBufferingLine) stream->setf(std::ios::unitbuf);
+#endif
+
+	wide = (wideFile = std::move(stream)).get();
+	}
+}
+
+
+/*	Write
+	Write the sample once
+*/
+void CPlusPlusSink::Write(
+	const Sample	&sample
+	)
+{
+// char8, char16 or char32 mode?
+if (IsCodeUnitMode(mode))
+	WriteUnitsStream(*narrow, isMethodFormatted, GetSampleText(&sample, mode), converted);
+
+else if (narrow)
+	WriteNarrowStream(*narrow, isMethodFormatted, sample);
+
+else
+	WriteWideStream(*wide, isMethodFormatted, sample);
+}
+
+
+/*	Flush
+	Hand the stream's buffer to what lies under it
+*/
+void CPlusPlusSink::Flush()
+{
+if (narrow) {
+	narrow->flush();
+	if (narrow->fail()) throw "output stream has failed";
 	}
+
+else
+	/* the wide stream reports its failure when it is closed */
+	wide->flush();
 }
 
 
-/*	TestCPlusPlusStream
-	C++ stream I/O test cases
+/*	Close
+	Flush the stream for the last time
+	Throws if the stream has failed
+*/
+void CPlusPlusSink::Close()
+{
+if (narrow)
+	Flush();
+
+else
+	CloseWideStream(*wide);
+}
+
+
+/*	kDescriptorBufferDefault
+	Size of a DescriptorBuffer in bytes, when no buffer size is given
+*/
+enum { kDescriptorBufferDefault = 1 << 20 };
+
+
+/*	DescriptorBuffer
+	Stream buffer that writes straight to a file descriptor with _write(), in place of
+	std::filebuf; it has no locale, so whatever codecvt facet the stream is imbued with is
+	ignored, and wide characters or code units are encoded by EncodeSIMD() a whole buffer at a
+	time
+*/
+template <typename Char>
+class DescriptorBuffer : public std::basic_streambuf<Char> {
+public:
+	typedef typename std::basic_streambuf<Char>::int_type int_type;
+	typedef typename std::basic_streambuf<Char>::traits_type traits_type;
+	
+	DescriptorBuffer(int fd, enum Encoding, const Buffering&);
+	
+	bool Close();
+
+protected:
+	int_type overflow(int_type) override;
+	std::streamsize xsputn(const Char*, std::streamsize) override;
+	int sync() override;
+
+private:
+	bool Flush(bool final);
+	bool Emit(const Char*, size_t);
+	
+	const int	fd;
+	const enum Encoding encoding;
+	size_t		length;
+	std::unique_ptr<Char[]> buffer;
+	std::unique_ptr<char[]> encoded;
+	bool		failed;
+	};
+
+
+/*	DescriptorBuffer
+	Buffer writing to the given file descriptor, encoding wide characters in the given encoding
+*/
+template <typename Char>
+DescriptorBuffer<Char>::DescriptorBuffer(
+	int		fd,
+	enum Encoding	encoding,
+	const Buffering	&buffering
+	) :
+	fd(fd),
+	encoding(encoding),
+	failed(false)
+{
+// a buffer of one character flushes on every character, and larger writes go straight through
+/* wide characters and code units need two, so that a high surrogate kept back for its partner
+   leaves room for it */
+length =
+	buffering.policy == kBufferingNone ? (sizeof(Char) > 1 ? 2 : 1) :
+	std::max<size_t>((buffering.size ? buffering.size : (size_t) kDescriptorBufferDefault) / sizeof(Char), 2);
+
+buffer.reset(new Char[length]);
+if (sizeof(Char) > 1) encoded.reset(new char[EncodeBound(encoding, length)]);
+
+this->setp(buffer.get(), buffer.get() + length);
+}
+
+
+/*	Emit
+	Write the given characters, encoding wide ones
+	Return whether the call failed
+*/
+template <typename Char>
+bool DescriptorBuffer<Char>::Emit(
+	const Char	*characters,
+	size_t		count
+	)
+{
+const char *bytes;
+size_t remaining;
+if constexpr (sizeof(Char) == 1) {
+	bytes = characters;
+	remaining = count;
+	}
+
+else {
+	bytes = encoded.get();
+	remaining = EncodeSIMDUnits(encoding, characters, sizeof(Char), count, encoded.get());
+	}
+
+if (CheckOutput(bytes, remaining)) return failed = true;
+
+// _write() may write less than it was asked to
+while (remaining) {
+	const unsigned int request = (unsigned int) std::min<size_t>(remaining, 1u << 30);
+	const int written = _write(fd, bytes, request);
+	if (written <= 0) return failed = true;
+	
+	bytes += written;
+	remaining -= written;
+	}
+
+return false;
+}
+
+
+/*	Flush
+	Write out the buffer; unless this is the final flush, a high surrogate at its end is kept
+	back for its partner
+	Return whether the call failed
+*/
+template <typename Char>
+bool DescriptorBuffer<Char>::Flush(
+	bool		final
+	)
+{
+Char *const base = this->pbase();
+size_t count = this->pptr() - base;
+
+size_t kept = 0;
+if (sizeof(Char) > 1 && !final && count && (uint32_t) base[count - 1] >= 0xD800 && (uint32_t) base[count - 1] < 0xDC00)
+	kept = 1, count--;
+
+if (count && Emit(base, count)) return true;
+
+// start over, with any surrogate kept back at the front
+if (kept) base[0] = base[count];
+this->setp(base, base + length);
+this->pbump((int) kept);
+
+return false;
+}
+
+
+/*	overflow
+	Write out the full buffer, then take the character
+*/
+template <typename Char>
+typename DescriptorBuffer<Char>::int_type DescriptorBuffer<Char>::overflow(
+	int_type	c
+	)
+{
+if (failed || Flush(false)) return traits_type::eof();
+
+if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+
+*this->pptr() = traits_type::to_char_type(c);
+this->pbump(1);
+
+return c;
+}
+
+
+/*	xsputn
+	Take the characters into the buffer; whatever fills whole buffers goes straight out
+*/
+template <typename Char>
+std::streamsize DescriptorBuffer<Char>::xsputn(
+	const Char	*characters,
+	std::streamsize	count
+	)
+{
+const std::streamsize total = count;
+
+while (count > 0 && !failed) {
+	const size_t room = this->epptr() - this->pptr();
+	
+	// copy what fits
+	if ((size_t) count < room || this->pptr() != this->pbase()) {
+		const size_t copy = std::min<size_t>(count, room);
+		traits_type::copy(this->pptr(), characters, copy);
+		this->pbump((int) copy);
+		characters += copy;
+		count -= copy;
+		
+		if (this->pptr() == this->epptr()) Flush(false);
+		}
+	
+	// write a whole buffer's worth without copying it, not splitting a surrogate pair
+	/* a high surrogate at its end is left to be copied into the buffer, where it waits for its
+	   partner; the buffer holds at least two, so something always goes out */
+	else {
+		size_t direct = std::min<size_t>(count, length);
+		if (sizeof(Char) > 1 && (uint32_t) characters[direct - 1] >= 0xD800 && (uint32_t) characters[direct - 1] < 0xDC00)
+			direct--;
+		
+		Emit(characters, direct);
+		characters += direct;
+		count -= direct;
+		}
+	}
+
+return failed ? total - count : total;
+}
+
+
+/*	sync
+	Write out the buffer
+*/
+template <typename Char>
+int DescriptorBuffer<Char>::sync()
+{
+return failed || Flush(false) ? -1 : 0;
+}
+
+
+/*	Close
+	Write out everything, including a high surrogate still kept back
+	Return whether any write failed
+*/
+template <typename Char>
+bool DescriptorBuffer<Char>::Close()
+{
+return failed || Flush(true);
+}
+
+
+/*	TestDescriptorUnits
+	Write the code units of the sample through DescriptorBuffer as they are, to be encoded in
+	the given encoding if they are wider than a byte
+	Return whether any write failed
+*/
+template <typename Unit>
+static bool TestDescriptorUnits(
+	int		fd,
+	enum Encoding	encoding,
+	bool		isMethodFormatted,
+	const Buffering	&buffering,
+	const SampleText &text,
+	size_t		repeat
+	)
+{
+DescriptorBuffer<Unit> buffer(fd, encoding, buffering);
+std::basic_ostream<Unit> stream(&buffer);
+if (buffering.policy == kBufferingLine) stream.setf(std::ios::unitbuf);
+
+// perform output
+const Unit *const units = static_cast<const Unit*>(text.units);
+for (; repeat && !stream.fail(); repeat--, MarkWrite())
+	for (size_t offset = 0, chunk; offset < text.length && !stream.fail(); offset += chunk) {
+		chunk = GetTextChunk(&text, offset);
+		
+		if (!isMethodFormatted)
+			stream.write(units + offset, chunk);
+		
+		else
+			stream << std::basic_string_view<Unit>(units + offset, chunk);
+		}
+
+return buffer.Close() || stream.fail();
+}
+
+
+/*	IsSampleUTF8
+	Whether the sample's narrow form is exactly the UTF-8 encoding of its wide form
+	
+	A sample read from a file is decoded from UTF-8, and every byte that isn't well-formed
+	becomes a three-byte U+FFFD; so re-encoding it gives the same length only if it was valid.
+*/
+static bool IsSampleUTF8(
+	const Sample	&sample
+	)
+{
+return sample.decoded && EncodeLength(kEncodingUTF8, sample.wide, sample.wideLength) == sample.narrowLength;
+}
+
+
+/*	TestStreambuf
+	C++ stream I/O through DescriptorBuffer rather than std::filebuf
 */
 extern "C"
-bool TestCPlusPlusStream(
+bool TestStreambuf(
 	bool		standardOutput,
 	enum Mode	mode,
 	bool		isWideMode,
 	const char	*locale,
-	bool		isMethodFormatted
+	bool		isMethodFormatted,
+	const struct Buffering *buffering,
+	const struct Sample *sample,
+	size_t		repeat
 	)
 {
 bool failed = false;
 
+/* As the simd method does, encode the Mode's encoding ourselves and write it in binary */
+const enum Encoding encoding = gModeEncodings[mode];
+
+// get output file descriptor
+int fd;
+if (standardOutput) {
+	fd = _fileno(stdout);
+	
+	if (_setmode(fd, _O_BINARY) == -1) {
+		fprintf(stderr, "error: can't apply mode to standard output\n");
+		return true;
+		}
+	}
+
+else if ((fd = _open(gFileName, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE)) == -1) {
+	fprintf(stderr, "error: can't open file for output\n");
+	return true;
+	}
+
+// start the file as the Windows Unicode modes would
+const char *mark;
+const size_t markLength = standardOutput ? 0 : GetModeByteOrderMark(mode, &mark);
+if (markLength && _write(fd, mark, (unsigned int) markLength) != (int) markLength) {
+	fprintf(stderr, "error: unable to write byte order mark\n");
+	failed = true;
+	}
+
 try {
-	// standard output?
-	if (standardOutput)
-		TestCPlusPlusStandardOutput(mode, isWideMode, locale, isMethodFormatted);
+	// char8, char16 or char32 mode?
+	/* the code units go into the stream as they are, and only the buffer encodes them */
+	if (!failed && IsCodeUnitMode(mode)) {
+		const SampleText text = GetSampleText(sample, mode);
+		switch (text.width) {
+			case 1:	failed = TestDescriptorUnits<char>(fd, kEncodingNone, isMethodFormatted, *buffering, text, repeat); break;
+			case 2:	failed = TestDescriptorUnits<char16_t>(fd, encoding, isMethodFormatted, *buffering, text, repeat); break;
+			default: failed = TestDescriptorUnits<char32_t>(fd, encoding, isMethodFormatted, *buffering, text, repeat); break;
+			}
+		}
+	
+	// sample that is already UTF-8?
+	/* then there is nothing to convert, and the narrow form can go out as it is */
+	else if (!failed && encoding == kEncodingUTF8 && IsSampleUTF8(*sample)) {
+		fprintf(stderr, "info: sample is already UTF-8; writing it without conversion\n");
+		
+		DescriptorBuffer<char> buffer(fd, kEncodingNone, *buffering);
+		std::ostream stream(&buffer);
+		if (buffering->policy == kBufferingLine) stream.setf(std::ios::unitbuf);
+		
+		TestCPlusPlusNarrowStream(stream, isMethodFormatted, locale, *sample, repeat);
+		failed = buffer.Close();
+		}
+	
+	// narrow mode?
+	else if (!failed && !isWideMode) {
+		DescriptorBuffer<char> buffer(fd, kEncodingNone, *buffering);
+		std::ostream stream(&buffer);
+		if (buffering->policy == kBufferingLine) stream.setf(std::ios::unitbuf);
+		
+		TestCPlusPlusNarrowStream(stream, isMethodFormatted, locale, *sample, repeat);
+		failed = buffer.Close();
+		}
+	
+	// wide mode
+	/* the facet that the driver imbues is never consulted */
+	else if (!failed) {
+		DescriptorBuffer<wchar_t> buffer(fd, encoding, *buffering);
+		std::wostream stream(&buffer);
+		if (buffering->policy == kBufferingLine) stream.setf(std::ios::unitbuf);
+		
+		TestCPlusPlusWideStream(stream, mode, isMethodFormatted, locale, kFacetStandard, *sample, repeat);
+		failed = buffer.Close();
+		}
+	
+	if (failed) fprintf(stderr, "error: unable to write entire output\n");
+	}
 
-	// open file?
-	else
-		TestCPlusPlusFile(mode, isWideMode, locale, isMethodFormatted);
+catch (const char error[]) {
+	fprintf(stderr, "error: %s\n", error);
+	
+	failed = true;
+	}
+
+catch (...) {
+	fprintf(stderr, "error\n");
+	
+	failed = true;
+	}
+
+if (!standardOutput) _close(fd);
+
+return failed;
+}
+
+
+/*	Guard
+	Call the function, reporting any exception it throws
+	Return whether the call failed
+*/
+template <typename Function>
+static bool Guard(
+	Function	function
+	)
+{
+bool failed = false;
+
+try {
+	function();
 	}
 
 catch (const char error[]) {
@@ -268,3 +1002,68 @@ catch (...) {
 
 return failed;
 }
+
+
+/*	CreateCPlusPlusSink
+	Open the C++ stream of a Sink
+	Return the sink, or NULL if the call failed
+*/
+extern "C"
+CPlusPlusSink *CreateCPlusPlusSink(
+	bool		standardOutput,
+	enum Mode	mode,
+	bool		isWideMode,
+	const char	*locale,
+	enum Facet	facet,
+	bool		isMethodFormatted,
+	const struct Buffering *buffering
+	)
+{
+CPlusPlusSink *sink = nullptr;
+Guard([&] { sink = new CPlusPlusSink(standardOutput, mode, isWideMode, locale, facet, isMethodFormatted, *buffering); });
+
+return sink;
+}
+
+
+/*	WriteCPlusPlusSink
+	Write the sample once
+	Return whether the call failed
+*/
+extern "C"
+bool WriteCPlusPlusSink(
+	CPlusPlusSink	*sink,
+	const struct Sample *sample
+	)
+{
+return Guard([&] { sink->Write(*sample); });
+}
+
+
+/*	FlushCPlusPlusSink
+	Hand the stream's buffer to what lies under it
+	Return whether the call failed
+*/
+extern "C"
+bool FlushCPlusPlusSink(
+	CPlusPlusSink	*sink
+	)
+{
+return Guard([&] { sink->Flush(); });
+}
+
+
+/*	DestroyCPlusPlusSink
+	Flush and close the stream, and release the sink
+	Return whether the call failed
+*/
+extern "C"
+bool DestroyCPlusPlusSink(
+	CPlusPlusSink	*sink
+	)
+{
+const bool failed = Guard([&] { sink->Close(); });
+delete sink;
+
+return failed;
+}
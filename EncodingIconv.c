@@ -0,0 +1,241 @@
+/*
+	EncodingIconv
+	
+	iconv method for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/* iconv is part of the C library on Linux, and a library of its own on other POSIX systems */
+#if !defined(_WIN32) && defined(__has_include)
+#if __has_include(<iconv.h>)
+#define HAVE_ICONV 1
+#endif
+#endif
+
+#ifdef HAVE_ICONV
+
+#include <errno.h>
+#include <iconv.h>
+#include <string.h>
+
+#endif
+
+#include "Encoding.h"
+#include "Platform.h"
+#include "Transcode.h"
+
+
+
+#ifdef HAVE_ICONV
+
+/*	gIconvEncodingNames
+	iconv name of each Encoding
+*/
+static const char *const gIconvEncodingNames[] = {
+	/* kEncodingNone */	NULL,
+	/* kEncodingUTF8 */	"UTF-8",
+	/* kEncodingUTF16LE */	"UTF-16LE",
+	/* kEncodingUTF16BE */	"UTF-16BE",
+	/* kEncodingUTF32LE */	"UTF-32LE"
+	};
+
+
+/*	GetIconvUnitName
+	iconv name of the code units that the Mode holds the sample in
+*/
+static const char *GetIconvUnitName(
+	enum Mode	mode
+	)
+{
+/* "UTF-16" and "UTF-32" would expect a byte order mark, so name the machine's own order */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static const char kUTF16[] = "UTF-16BE", kUTF32[] = "UTF-32BE";
+#else
+static const char kUTF16[] = "UTF-16LE", kUTF32[] = "UTF-32LE";
+#endif
+
+switch (mode) {
+	case kModeChar8:	return "UTF-8";
+	case kModeChar16:	return kUTF16;
+	case kModeChar32:	return kUTF32;
+	
+	/* "WCHAR_T" is whatever the C library's wchar_t holds */
+	default:		return "WCHAR_T";
+	}
+}
+
+
+/*	TestIconv
+	iconv test cases
+	Return whether call failed
+	
+	The Mode determines the encoding in the same way as the Windows Unicode modes do; one
+	conversion descriptor is opened for the whole test, and the sample handed to iconv() 'chunk'
+	code units at a time and the result written in binary.
+*/
+bool TestIconv(
+	bool		standardOutput,
+	enum Mode	mode,
+	const struct Sample *sample,
+	size_t		repeat,
+	size_t		chunk
+	)
+{
+const enum Encoding encoding = gModeEncodings[mode];
+if (!encoding) {
+	fprintf(stderr, "error: iconv method applies only to the wide, unicode, wideunicode, char8, char16 and char32 modes\n");
+	return true;
+	}
+
+const struct SampleText text = GetSampleText(sample, mode);
+const iconv_t descriptor = iconv_open(gIconvEncodingNames[encoding], GetIconvUnitName(mode));
+if (descriptor == (iconv_t) -1) {
+	fprintf(stderr, "error: iconv can't convert to %s (%s)\n", gIconvEncodingNames[encoding], strerror(errno));
+	return true;
+	}
+
+fprintf(stderr, "info: iconv converting to %s, %zu characters at a time\n", gIconvEncodingNames[encoding], chunk);
+
+// get output file descriptor
+int fd;
+if (standardOutput)
+	fd = _fileno(stdout);
+
+else if ((fd = OpenOutputFile(_O_BINARY)) == -1) {
+	fprintf(stderr, "error: can't open file for output\n");
+	iconv_close(descriptor);
+	return true;
+	}
+
+bool failed = false;
+
+// allocate output buffer
+/* with room for a character that the chunk would have cut short */
+const size_t capacity = EncodeBound(encoding, chunk + 3);
+char *const encoded = malloc(capacity);
+if (!encoded) {
+	fprintf(stderr, "error: can't allocate encoding buffer\n");
+	failed = true;
+	}
+
+// start the file as the Windows Unicode modes would
+const char *mark;
+const size_t markLength = standardOutput ? 0 : GetModeByteOrderMark(mode, &mark);
+if (!failed && markLength && WriteOutputFile(fd, mark, markLength)) {
+	fprintf(stderr, "error: unable to write byte order mark\n");
+	failed = true;
+	}
+
+// perform output
+for (; repeat && !failed; repeat--, MarkWrite())
+	for (size_t offset = 0, length; offset < text.length && !failed; offset += length) {
+		const size_t remaining = text.length - offset;
+		char *output = encoded;
+		
+		/* a character cut short by the end of the chunk is left for the next one, unless the
+		   chunk is too short to hold even one; then it is lengthened to take it whole */
+		bool converted, incomplete;
+		int error = 0;
+		for (size_t piece = chunk; ; piece++) {
+			length = remaining < piece ? remaining : piece;
+			
+			char *input = (char*) text.units + offset * text.width;
+			size_t inputLeft = length * text.width, outputLeft = capacity;
+			converted = iconv(descriptor, &input, &inputLeft, &output, &outputLeft) != (size_t) -1;
+			if (!converted) error = errno;
+			incomplete = !converted && error == EINVAL && length < remaining;
+			length -= inputLeft / text.width;
+			if (!incomplete || length) break;
+			}
+		
+		if (!converted && !incomplete) {
+			fprintf(stderr, "error: iconv failed at code unit %zu (%s)\n", offset + length, strerror(error));
+			failed = true;
+			break;
+			}
+		
+		const unsigned int write = (unsigned int) (output - encoded);
+		if (CheckOutput(encoded, write)) {
+			failed = true;
+			break;
+			}
+		
+		if (WriteOutputFile(fd, encoded, write)) {
+			fprintf(stderr, "error: unable to write entire output\n");
+			failed = true;
+			}
+		}
+
+if (!failed && !standardOutput && FlushOutputFile(fd)) {
+	fprintf(stderr, "error: unable to write entire output\n");
+	failed = true;
+	}
+
+// close
+free(encoded);
+iconv_close(descriptor);
+if (!standardOutput) CloseOutputFile(fd);
+
+return failed;
+}
+
+
+/*	IsIconvAvailable
+	Whether the iconv method was built
+*/
+bool IsIconvAvailable(void)
+{
+return true;
+}
+
+
+#else
+
+/*	IsIconvAvailable
+	Whether the iconv method was built
+*/
+bool IsIconvAvailable(void)
+{
+return false;
+}
+
+
+/*	TestIconv
+	iconv test cases
+	Return whether call failed
+*/
+bool TestIconv(
+	bool		standardOutput,
+	enum Mode	mode,
+	const struct Sample *sample,
+	size_t		repeat,
+	size_t		chunk
+	)
+{
+fprintf(stderr, "error: iconv is not available on this platform\n");
+
+return true;
+}
+
+#endif
@@ -0,0 +1,231 @@
+/*
+	EncodingMap
+	
+	Memory-mapped output method for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+
+#include <WINDOWS.H>
+
+#else
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#endif
+
+#include "Encoding.h"
+#include "Transcode.h"
+
+
+
+/*	OutputMapping
+	Output file presized and mapped for writing
+*/
+struct OutputMapping {
+	char		*view;
+	size_t		size;
+#ifdef _WIN32
+	HANDLE		file;
+#else
+	int		fd;
+#endif
+	};
+
+
+/*	OpenOutputMapping
+	Create the output file at the given size and map all of it for writing
+	Return whether the call failed
+*/
+static bool OpenOutputMapping(
+	struct OutputMapping *output,
+	size_t		size
+	)
+{
+output->size = size;
+
+#ifdef _WIN32
+if ((output->file = CreateFileA(gFileName, GENERIC_READ | GENERIC_WRITE, 0 /* share */, NULL /* security */, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL /* template */)) == INVALID_HANDLE_VALUE) {
+	fprintf(stderr, "error: can't open file for output\n");
+	return true;
+	}
+
+// presize
+LARGE_INTEGER end;
+end.QuadPart = (LONGLONG) size;
+if (!SetFilePointerEx(output->file, end, NULL, FILE_BEGIN) || !SetEndOfFile(output->file)) {
+	fprintf(stderr, "error: can't extend output file to %zu bytes\n", size);
+	CloseHandle(output->file);
+	return true;
+	}
+
+/* The view keeps the mapping open once its handle is closed */
+HANDLE mapping = CreateFileMappingA(output->file, NULL /* security */, PAGE_READWRITE, (DWORD) ((unsigned long long) size >> 32), (DWORD) size, NULL /* name */);
+output->view = mapping ? MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size) : NULL;
+if (mapping) CloseHandle(mapping);
+
+if (!output->view) {
+	fprintf(stderr, "error: can't map output file\n");
+	CloseHandle(output->file);
+	return true;
+	}
+
+#else
+if ((output->fd = open(gFileName, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) == -1) {
+	fprintf(stderr, "error: can't open file for output\n");
+	return true;
+	}
+
+// presize
+/* Where the file system supports it, allocate the blocks now rather than on each page fault */
+#ifdef __linux__
+const bool extended = fallocate(output->fd, 0, 0, (off_t) size) == 0 || ftruncate(output->fd, (off_t) size) == 0;
+#else
+const bool extended = ftruncate(output->fd, (off_t) size) == 0;
+#endif
+if (!extended) {
+	fprintf(stderr, "error: can't extend output file to %zu bytes\n", size);
+	close(output->fd);
+	return true;
+	}
+
+void *const view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, output->fd, 0);
+if (view == MAP_FAILED) {
+	fprintf(stderr, "error: can't map output file\n");
+	close(output->fd);
+	return true;
+	}
+
+output->view = view;
+#endif
+
+return false;
+}
+
+
+/*	CloseOutputMapping
+	Unmap the output file, first writing it back to storage if requested
+	Return whether the call failed
+*/
+static bool CloseOutputMapping(
+	struct OutputMapping *output,
+	bool		sync
+	)
+{
+bool failed = false;
+
+#ifdef _WIN32
+if (sync && (!FlushViewOfFile(output->view, 0) || !FlushFileBuffers(output->file))) {
+	fprintf(stderr, "error: can't flush output mapping\n");
+	failed = true;
+	}
+
+UnmapViewOfFile(output->view);
+CloseHandle(output->file);
+
+#else
+if (sync && msync(output->view, output->size, MS_SYNC) == -1) {
+	fprintf(stderr, "error: can't flush output mapping\n");
+	failed = true;
+	}
+
+munmap(output->view, output->size);
+close(output->fd);
+#endif
+
+return failed;
+}
+
+
+/*	TestMmap
+	Memory-mapped output test cases
+	Return whether call failed
+	
+	The Mode determines the encoding in the same way as the Windows Unicode modes do; the
+	output is sized in advance and the sample copied or encoded straight into the mapping,
+	so that there is no write call and no intermediate buffer.
+*/
+bool TestMmap(
+	bool		standardOutput,
+	enum Mode	mode,
+	const struct Sample *sample,
+	size_t		repeat,
+	bool		sync
+	)
+{
+// only a file can be sized and mapped
+if (standardOutput) {
+	fprintf(stderr, "error: mmap method requires the 'file' option\n");
+	return true;
+	}
+
+/* the narrow modes and char8 are copied as they are */
+const struct SampleText text = GetSampleText(sample, mode);
+const enum Encoding encoding = text.width > 1 ? gModeEncodings[mode] : kEncodingNone;
+
+// size of output
+const char *mark;
+const size_t markLength = GetModeByteOrderMark(mode, &mark);
+const size_t sampleBytes = encoding ? EncodeUnitsLength(encoding, text.units, text.width, text.length) : text.length;
+if (repeat > (SIZE_MAX - markLength) / sampleBytes) {
+	fprintf(stderr, "error: output is too large to map\n");
+	return true;
+	}
+
+struct OutputMapping output;
+if (OpenOutputMapping(&output, markLength + repeat * sampleBytes)) return true;
+
+// start the file as the Windows Unicode modes would
+char *o = output.view;
+if (markLength) {
+	memcpy(o, mark, markLength);
+	o += markLength;
+	}
+
+// perform output
+bool failed = false;
+for (; repeat && !failed; repeat--, MarkWrite()) {
+	char *const written = o;
+	if (!encoding) {
+		memcpy(o, text.units, text.length);
+		o += text.length;
+		}
+	
+	else
+		o += EncodeUnits(encoding, text.units, text.width, text.length, o);
+	
+	/* the mapping is already the file, so a failure leaves the sample in it */
+	failed = CheckOutput(written, o - written);
+	}
+
+return CloseOutputMapping(&output, sync) || failed;
+}
@@ -0,0 +1,456 @@
+/*
+	EncodingURing
+	
+	Asynchronous (io_uring) output method for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* There is no liburing dependency; the ring is driven through the system calls directly, so
+   only the kernel's own header is needed */
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#endif
+
+#include "Encoding.h"
+#include "Transcode.h"
+
+
+
+#ifdef HAVE_IO_URING
+
+/*	kURingBuffer
+	Size of each of the buffers that output is encoded into and submitted from
+*/
+enum { kURingBuffer = 256 << 10 };
+
+
+/*	Ring
+	io_uring instance with its submission and completion queues mapped in
+*/
+struct Ring {
+	int		fd;
+	
+	// submission queue
+	unsigned	*sqHead, *sqTail, *sqMask, *sqArray;
+	struct io_uring_sqe *sqes;
+	
+	// completion queue
+	unsigned	*cqHead, *cqTail, *cqMask;
+	struct io_uring_cqe *cqes;
+	
+	// mappings
+	void		*sqRing, *cqRing;
+	size_t		sqRingSize, cqRingSize, sqesSize;
+	};
+
+
+/*	Slot
+	One of the output buffers, and the write that is in flight from it
+*/
+struct Slot {
+	char		*buffer;
+	size_t		length;			// bytes in buffer
+	size_t		written;		// of which already completed
+	unsigned long long offset;		// file position of buffer
+	double		submitted;		// time of submission
+	bool		busy;
+	};
+
+
+/*	Cursor
+	Position in the stream of repeated samples
+*/
+struct Cursor {
+	struct SampleText text;
+	enum Encoding	encoding;
+	size_t		repeat;			// samples left, including the current one
+	size_t		offset;			// code units of the current sample already taken
+	};
+
+
+/*	OpenRing
+	Create an io_uring with the given number of entries and map its queues
+	Return whether the call failed
+*/
+static bool OpenRing(
+	struct Ring	*ring,
+	unsigned int	entries
+	)
+{
+struct io_uring_params params;
+memset(&params, 0, sizeof params);
+
+if ((ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params)) == -1) {
+	fprintf(stderr, "error: io_uring is not available (%s)\n", strerror(errno));
+	return true;
+	}
+
+// sizes of the mappings
+ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+/* Since Linux 5.4 both rings share a single mapping */
+const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+if (single && ring->cqRingSize > ring->sqRingSize) ring->sqRingSize = ring->cqRingSize;
+
+ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+ring->cqRing = single || ring->sqRing == MAP_FAILED ? ring->sqRing :
+	mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+void *const sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+	fprintf(stderr, "error: can't map io_uring queues\n");
+	if (sqes != MAP_FAILED) munmap(sqes, ring->sqesSize);
+	if (ring->cqRing != MAP_FAILED && ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+	if (ring->sqRing != MAP_FAILED) munmap(ring->sqRing, ring->sqRingSize);
+	close(ring->fd);
+	return true;
+	}
+
+char *const sq = ring->sqRing, *const cq = ring->cqRing;
+ring->sqHead = (unsigned*) (sq + params.sq_off.head);
+ring->sqTail = (unsigned*) (sq + params.sq_off.tail);
+ring->sqMask = (unsigned*) (sq + params.sq_off.ring_mask);
+ring->sqArray = (unsigned*) (sq + params.sq_off.array);
+ring->sqes = sqes;
+ring->cqHead = (unsigned*) (cq + params.cq_off.head);
+ring->cqTail = (unsigned*) (cq + params.cq_off.tail);
+ring->cqMask = (unsigned*) (cq + params.cq_off.ring_mask);
+ring->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+
+return false;
+}
+
+
+/*	CloseRing
+	Unmap and close an io_uring
+*/
+static void CloseRing(
+	struct Ring	*ring
+	)
+{
+munmap(ring->sqes, ring->sqesSize);
+if (ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+munmap(ring->sqRing, ring->sqRingSize);
+close(ring->fd);
+}
+
+
+/*	QueueWrite
+	Add a write of the unwritten part of the given slot to the submission queue
+*/
+static void QueueWrite(
+	struct Ring	*ring,
+	struct Slot	*slots,
+	unsigned int	index,
+	int		fd,
+	bool		registered
+	)
+{
+struct Slot *const slot = slots + index;
+
+const unsigned tail = *ring->sqTail, entry = tail & *ring->sqMask;
+struct io_uring_sqe *const sqe = ring->sqes + entry;
+memset(sqe, 0, sizeof *sqe);
+sqe->opcode = registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+sqe->fd = fd;
+sqe->addr = (unsigned long long) (uintptr_t) (slot->buffer + slot->written);
+sqe->len = (unsigned) (slot->length - slot->written);
+sqe->off = slot->offset + slot->written;
+sqe->buf_index = (unsigned short) index;
+sqe->user_data = index;
+
+ring->sqArray[entry] = entry;
+
+/* Make the entry visible to the kernel before the new tail */
+__atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+
+/*	FillSlot
+	Encode as much of the remaining output as fits into the given buffer
+	Return the number of bytes produced
+*/
+static size_t FillSlot(
+	struct Cursor	*cursor,
+	char		*buffer,
+	size_t		capacity
+	)
+{
+const struct SampleText *const text = &cursor->text;
+size_t length = 0;
+
+while (cursor->repeat) {
+	const size_t room = capacity - length, remaining = text->length - cursor->offset;
+	const char *const units = (const char*) text->units + cursor->offset * text->width;
+	size_t piece;
+	
+	// narrow or char8?
+	if (!cursor->encoding) {
+		if ((piece = remaining < room ? remaining : room) == 0) break;
+		
+		memcpy(buffer + length, units, piece);
+		length += piece;
+		}
+	
+	// wide, char16 or char32
+	else {
+		/* Only take as many code units as are certain to fit, and don't split a surrogate pair */
+		const size_t fits = room / EncodeBound(cursor->encoding, 1);
+		piece = remaining < fits ? remaining : fits;
+		if (piece < remaining && piece) {
+			const uint32_t last = text->width == 2 ?
+				((const uint16_t*) units)[piece - 1] :
+				((const uint32_t*) units)[piece - 1];
+			if (last >= 0xD800 && last < 0xDC00) piece--;
+			}
+		if (piece == 0) break;
+		
+		length += EncodeUnits(cursor->encoding, units, text->width, piece, buffer + length);
+		}
+	
+	// next sample?
+	if ((cursor->offset += piece) == text->length) {
+		cursor->offset = 0;
+		cursor->repeat--;
+		MarkWrite();
+		}
+	}
+
+return length;
+}
+
+
+/*	TestURing
+	io_uring test cases
+	Return whether call failed
+	
+	The Mode determines the encoding in the same way as the Windows Unicode modes do.  Output is
+	encoded into a set of (preferably registered) buffers, one for each entry in the queue, and
+	each buffer is refilled as soon as its write completes; so that encoding overlaps with
+	the writes still in flight.
+*/
+bool TestURing(
+	bool		standardOutput,
+	enum Mode	mode,
+	const struct Sample *sample,
+	size_t		repeat,
+	unsigned int	depth
+	)
+{
+/* Writes may complete in any order, so they need explicit file positions */
+if (standardOutput) {
+	fprintf(stderr, "error: io_uring method requires the 'file' option\n");
+	return true;
+	}
+
+struct Ring ring;
+if (OpenRing(&ring, depth)) return true;
+
+bool failed = false;
+
+// output file
+const int fd = open(gFileName, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+if (fd == -1) {
+	fprintf(stderr, "error: can't open file for output\n");
+	failed = true;
+	}
+
+// allocate buffers
+struct Slot *const slots = calloc(depth, sizeof *slots);
+struct iovec *const vectors = calloc(depth, sizeof *vectors);
+char *const buffers = malloc((size_t) depth * kURingBuffer);
+if (!slots || !vectors || !buffers) {
+	fprintf(stderr, "error: can't allocate io_uring buffers\n");
+	failed = true;
+	}
+
+// register buffers
+/* Pinning the buffers saves the kernel mapping them on every write; this counts against
+   RLIMIT_MEMLOCK, so do without if it's refused */
+bool registered = false;
+if (!failed) {
+	for (unsigned int i = 0; i < depth; i++) {
+		slots[i].buffer = buffers + (size_t) i * kURingBuffer;
+		vectors[i] = (struct iovec) { slots[i].buffer, kURingBuffer };
+		}
+	
+	if (!(registered = syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS, vectors, depth) == 0))
+		fprintf(stderr, "info: io_uring can't register buffers (%s); using unregistered writes\n", strerror(errno));
+	}
+
+// start the file as the Windows Unicode modes would
+/* the narrow modes and char8 are copied as they are */
+struct Cursor cursor = { GetSampleText(sample, mode), kEncodingNone, repeat, 0 };
+if (cursor.text.width > 1) cursor.encoding = gModeEncodings[mode];
+const char *mark;
+const size_t markLength = GetModeByteOrderMark(mode, &mark);
+
+// perform output
+unsigned long long position = 0;
+unsigned int busy = 0, queued = 0;
+size_t writes = 0;
+double latency = 0, latencyMax = 0;
+/* After a failure, still wait for the writes in flight, which are using the buffers */
+while (busy || (!failed && cursor.repeat)) {
+	// fill and queue every idle buffer
+	for (unsigned int i = 0; i < depth && !failed && cursor.repeat; i++)
+		if (!slots[i].busy) {
+			struct Slot *const slot = slots + i;
+			
+			slot->length = 0;
+			if (position == 0 && markLength) {
+				memcpy(slot->buffer, mark, markLength);
+				slot->length = markLength;
+				}
+			const size_t filled = FillSlot(&cursor, slot->buffer + slot->length, kURingBuffer - slot->length);
+			if (CheckOutput(slot->buffer + slot->length, filled)) {
+				failed = true;
+				break;
+				}
+			slot->length += filled;
+			slot->written = 0;
+			slot->offset = position;
+			slot->submitted = Now();
+			slot->busy = true;
+			position += slot->length;
+			
+			QueueWrite(&ring, slots, i, fd, registered);
+			queued++;
+			busy++;
+			}
+	
+	// failed before anything is in flight?
+	if (!busy) break;
+	
+	// submit and wait for at least one completion
+	if (syscall(__NR_io_uring_enter, ring.fd, queued, 1, IORING_ENTER_GETEVENTS, NULL, 0) == -1 && errno != EINTR) {
+		fprintf(stderr, "error: io_uring submission failed (%s)\n", strerror(errno));
+		failed = true;
+		break;
+		}
+	queued = 0;
+	
+	// reap completions
+	const double now = Now();
+	unsigned head = *ring.cqHead;
+	for (const unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE); head != tail; head++) {
+		const struct io_uring_cqe *const cqe = ring.cqes + (head & *ring.cqMask);
+		struct Slot *const slot = slots + cqe->user_data;
+		
+		if (cqe->res <= 0) {
+			fprintf(stderr, "error: io_uring write failed (%s)\n", strerror(cqe->res ? -cqe->res : EIO));
+			failed = true;
+			}
+		
+		// short write?
+		else if ((slot->written += (size_t) cqe->res) < slot->length) {
+			QueueWrite(&ring, slots, (unsigned int) cqe->user_data, fd, registered);
+			queued++;
+			continue;
+			}
+		
+		const double elapsed = now - slot->submitted;
+		latency += elapsed;
+		if (elapsed > latencyMax) latencyMax = elapsed;
+		writes++;
+		
+		slot->busy = false;
+		busy--;
+		}
+	__atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+	}
+
+if (!failed)
+	fprintf(stderr, "info: io_uring: %zu writes of up to %d KiB at queue depth %u (%s buffers); completion latency mean %.1f us, max %.1f us\n",
+		writes, kURingBuffer >> 10, depth, registered ? "registered" : "unregistered",
+		writes ? latency / writes * 1e6 : 0, latencyMax * 1e6
+		);
+
+// release resources
+CloseRing(&ring);
+free(buffers);
+free(vectors);
+free(slots);
+if (fd != -1) close(fd);
+
+return failed;
+}
+
+
+/*	IsURingAvailable
+	Whether the io_uring method was built
+*/
+bool IsURingAvailable(void)
+{
+return true;
+}
+
+
+#else
+
+/*	IsURingAvailable
+	Whether the io_uring method was built
+*/
+bool IsURingAvailable(void)
+{
+return false;
+}
+
+
+/*	TestURing
+	io_uring test cases
+	Return whether call failed
+*/
+bool TestURing(
+	bool		standardOutput,
+	enum Mode	mode,
+	const struct Sample *sample,
+	size_t		repeat,
+	unsigned int	depth
+	)
+{
+fprintf(stderr, "error: io_uring is only available on Linux\n");
+
+return true;
+}
+
+#endif
@@ -0,0 +1,360 @@
+/*
+	Interposer
+	
+	Output system call counting library (LD_PRELOAD) for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	Replacing write(), writev(), fsync() and fdatasync() catches every call made through the
+	C library's exported functions, but glibc's own stdio calls its internal aliases, which
+	can't be replaced; so on x86-64 the first reset also installs a seccomp filter that turns
+	those system calls into SIGSYS wherever they are made, except from the one instruction here
+	that makes them on the program's behalf once they have been counted.  The filter stays in
+	place for the rest of the process, and is inherited by any program it executes afterwards.
+*/
+
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#define HAVE_SECCOMP_TRAP 1
+#endif
+
+#ifdef HAVE_SECCOMP_TRAP
+
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+
+#endif
+
+#include "Syscalls.h"
+
+
+
+/*	gCounts
+	Calls counted on each file descriptor
+*/
+static struct SyscallCounts gCounts[kSyscallFdLimit];
+
+
+/*	gTrapping
+	Whether the seccomp filter counts the system calls, so that the replaced functions mustn't
+*/
+static bool gTrapping;
+
+
+/*	GetSizeClass
+	Histogram class of a call writing the given number of bytes
+*/
+static unsigned GetSizeClass(
+	size_t		size
+	)
+{
+unsigned sizeClass = 0;
+for (; size && sizeClass < kSyscallSizeBuckets - 1; size >>= 1) sizeClass++;
+
+return sizeClass;
+}
+
+
+/*	Add
+	Add to a count, from whichever thread
+*/
+static void Add(
+	unsigned long long *count,
+	unsigned long long value
+	)
+{
+__atomic_fetch_add(count, value, __ATOMIC_RELAXED);
+}
+
+
+/*	CountWrite
+	Count a write() or writev() of the given number of bytes (of which 'written' were)
+*/
+static void CountWrite(
+	int		fd,
+	bool		vector,
+	size_t		size,
+	long		written
+	)
+{
+if (fd < 0 || fd >= kSyscallFdLimit) return;
+
+struct SyscallCounts *const counts = &gCounts[fd];
+Add(vector ? &counts->writevs : &counts->writes, 1);
+if (written > 0) Add(vector ? &counts->writevBytes : &counts->writeBytes, (unsigned long long) written);
+Add(&counts->sizes[GetSizeClass(size)], 1);
+}
+
+
+/*	CountSync
+	Count an fsync() or fdatasync()
+*/
+static void CountSync(
+	int		fd,
+	bool		data
+	)
+{
+if (fd < 0 || fd >= kSyscallFdLimit) return;
+
+Add(data ? &gCounts[fd].fdatasyncs : &gCounts[fd].fsyncs, 1);
+}
+
+
+/*	GetVectorSize
+	Total number of bytes described by an I/O vector
+*/
+static size_t GetVectorSize(
+	const struct iovec *vector,
+	int		count
+	)
+{
+size_t size = 0;
+for (int i = 0; i < count; i++) size += vector[i].iov_len;
+
+return size;
+}
+
+
+#ifdef HAVE_SECCOMP_TRAP
+
+/*	RawSyscall
+	Make a system call of up to three arguments from the one place that the filter lets through
+	Return the kernel's result (negative errno on failure)
+*/
+long RawSyscall(long number, long a, long b, long c);
+extern const char RawSyscallReturn[];
+
+__asm__(
+	".text\n"
+	".globl RawSyscall\n"
+	".hidden RawSyscall\n"
+	".type RawSyscall, @function\n"
+	"RawSyscall:\n"
+	"	movq %rdi, %rax\n"
+	"	movq %rsi, %rdi\n"
+	"	movq %rdx, %rsi\n"
+	"	movq %rcx, %rdx\n"
+	"	syscall\n"
+	".globl RawSyscallReturn\n"
+	".hidden RawSyscallReturn\n"
+	"RawSyscallReturn:\n"
+	"	ret\n"
+	".size RawSyscall, . - RawSyscall\n"
+	);
+
+
+/*	HandleSystemCall
+	Count a system call that the filter trapped, and make it
+*/
+static void HandleSystemCall(
+	int		signal,
+	siginfo_t	*info,
+	void		*context
+	)
+{
+(void) signal;
+
+greg_t *const registers = ((ucontext_t*) context)->uc_mcontext.gregs;
+const long
+	a = registers[REG_RDI],
+	b = registers[REG_RSI],
+	c = registers[REG_RDX],
+	result = RawSyscall(info->si_syscall, a, b, c);
+
+switch (info->si_syscall) {
+	case SYS_write:		CountWrite((int) a, false, (size_t) c, result); break;
+	case SYS_writev:	CountWrite((int) a, true, GetVectorSize((const struct iovec*) b, (int) c), result); break;
+	case SYS_fsync:		CountSync((int) a, false); break;
+	case SYS_fdatasync:	CountSync((int) a, true); break;
+	}
+
+// the interrupted system call returns this
+registers[REG_RAX] = result;
+}
+
+
+/*	InstallTrap
+	Have the kernel trap the counted system calls, except where RawSyscall() makes them
+	Return whether that worked
+	
+	A seccomp filter applies to the whole process and can't be removed once installed.  Both
+	it and the 'no new privileges' flag that installing it takes are inherited across fork()
+	and exec(): a program executed afterwards has its write(), writev(), fsync() and fdatasync()
+	trapped too, without this library's handler (so it is killed by the SIGSYS), and can't gain
+	privileges through set-user-ID files.  That is why 'syscalls' counts a single combination,
+	and can't be combined with 'all' or 'startup', which run theirs in processes of their own.
+*/
+static bool InstallTrap(void)
+{
+const unsigned long long allowed = (unsigned long long) (uintptr_t) RawSyscallReturn;
+
+struct sock_filter filter[] = {
+	// only the x86-64 system call numbers are recognized
+	BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch)),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 0, 9),
+	
+	// is the call one of those counted?
+	BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_write, 3, 0),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_writev, 2, 0),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_fsync, 1, 0),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_fdatasync, 0, 4),
+	
+	// is it made from RawSyscall()?
+	BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, instruction_pointer)),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (__u32) allowed, 0, 3),
+	BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, instruction_pointer) + 4),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (__u32) (allowed >> 32), 0, 1),
+	
+	BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+	BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRAP)
+	};
+const struct sock_fprog program = { sizeof filter / sizeof *filter, filter };
+
+struct sigaction action;
+memset(&action, 0, sizeof action);
+action.sa_sigaction = HandleSystemCall;
+action.sa_flags = SA_SIGINFO;
+sigemptyset(&action.sa_mask);
+
+return
+	sigaction(SIGSYS, &action, NULL) == 0 &&
+	prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 &&
+	prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) == 0;
+}
+
+#endif
+
+
+/*	GetNext
+	The function of the given name that this library replaces
+*/
+static void *GetNext(
+	const char	*name
+	)
+{
+return dlsym(RTLD_NEXT, name);
+}
+
+
+/*	write
+	Count, and write
+*/
+ssize_t write(
+	int		fd,
+	const void	*buffer,
+	size_t		count
+	)
+{
+static ssize_t (*next)(int, const void*, size_t);
+if (!next) next = (ssize_t (*)(int, const void*, size_t)) GetNext("write");
+
+const ssize_t written = next(fd, buffer, count);
+if (!gTrapping) CountWrite(fd, false, count, (long) written);
+
+return written;
+}
+
+
+/*	writev
+	Count, and write
+*/
+ssize_t writev(
+	int		fd,
+	const struct iovec *vector,
+	int		count
+	)
+{
+static ssize_t (*next)(int, const struct iovec*, int);
+if (!next) next = (ssize_t (*)(int, const struct iovec*, int)) GetNext("writev");
+
+const ssize_t written = next(fd, vector, count);
+if (!gTrapping) CountWrite(fd, true, GetVectorSize(vector, count), (long) written);
+
+return written;
+}
+
+
+/*	fsync
+	Count, and flush
+*/
+int fsync(
+	int		fd
+	)
+{
+static int (*next)(int);
+if (!next) next = (int (*)(int)) GetNext("fsync");
+
+if (!gTrapping) CountSync(fd, false);
+
+return next(fd);
+}
+
+
+/*	fdatasync
+	Count, and flush
+*/
+int fdatasync(
+	int		fd
+	)
+{
+static int (*next)(int);
+if (!next) next = (int (*)(int)) GetNext("fdatasync");
+
+if (!gTrapping) CountSync(fd, true);
+
+return next(fd);
+}
+
+
+/*	EncexpGetSyscallCounts
+	What was counted on the given file descriptor
+*/
+const struct SyscallCounts *EncexpGetSyscallCounts(
+	int		fd
+	)
+{
+return fd >= 0 && fd < kSyscallFdLimit ? &gCounts[fd] : NULL;
+}
+
+
+/*	EncexpResetSyscallCounts
+	Start counting from zero, trapping the system calls from here on where that's possible
+*/
+void EncexpResetSyscallCounts(void)
+{
+#ifdef HAVE_SECCOMP_TRAP
+if (!gTrapping) gTrapping = InstallTrap();
+#endif
+
+memset(gCounts, 0, sizeof gCounts);
+}
@@ -0,0 +1,234 @@
+/*
+	Latency
+	
+	Per-write latency histogram for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	Each write of the sample is timed from the end of the previous one, so the durations add
+	up to the whole test, and the first one includes opening the output.  Recording is an
+	increment of one bucket, found from the position of the highest bit of the duration.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Encoding.h"
+#include "Latency.h"
+
+
+
+/*	gLatency
+	Histogram being recorded into, if any, and the time of the last mark
+*/
+static struct Histogram *gLatency;
+static double gLastMark;
+
+
+/*	kTimerCalibration
+	Number of clock readings averaged to find the cost of one
+*/
+enum { kTimerCalibration = 10000 };
+
+
+/*	gTimerCost
+	Time (ns) taken to read the clock, which every recorded duration includes
+*/
+static double gTimerCost;
+
+
+/*	GetHighestBit
+	Position of the highest set bit of a nonzero value
+*/
+static unsigned GetHighestBit(
+	unsigned long long value
+	)
+{
+#ifdef __GNUC__
+return 63 - __builtin_clzll(value);
+
+#else
+unsigned bit = 0;
+while (value >>= 1) bit++;
+
+return bit;
+#endif
+}
+
+
+/*	GetBucket
+	Bucket that a duration is counted in
+*/
+static unsigned GetBucket(
+	unsigned long long value
+	)
+{
+if (value < kLatencySubBuckets) return (unsigned) value;
+
+const unsigned bit = GetHighestBit(value);
+
+return kLatencySubBuckets + (bit - kLatencySubBits) * kLatencySubBuckets + (unsigned) (value >> (bit - kLatencySubBits)) - kLatencySubBuckets;
+}
+
+
+/*	GetBucketLimit
+	Largest duration counted in a bucket
+*/
+static unsigned long long GetBucketLimit(
+	unsigned	bucket
+	)
+{
+if (bucket < kLatencySubBuckets) return bucket;
+
+const unsigned
+	power = (bucket - kLatencySubBuckets) / kLatencySubBuckets,
+	sub = (bucket - kLatencySubBuckets) % kLatencySubBuckets;
+
+return ((unsigned long long) (kLatencySubBuckets + sub + 1) << power) - 1;
+}
+
+
+/*	StartLatency
+	Start recording into the histogram
+*/
+void StartLatency(
+	struct Histogram *histogram
+	)
+{
+memset(histogram, 0, sizeof *histogram);
+
+// how long the clock itself takes
+const double start = Now();
+for (unsigned i = 0; i < kTimerCalibration; i++) Now();
+gTimerCost = (Now() - start) * 1e9 / (kTimerCalibration + 1);
+
+gLatency = histogram;
+gLastMark = Now();
+}
+
+
+/*	StopLatency
+	Stop recording
+*/
+void StopLatency(void)
+{
+gLatency = NULL;
+}
+
+
+/*	MarkWrite
+	Record the time since the previous mark
+*/
+void MarkWrite(void)
+{
+if (!gLatency) return;
+
+const double now = Now();
+const unsigned long long duration = (unsigned long long) ((now - gLastMark) * 1e9);
+gLastMark = now;
+
+gLatency->counts[GetBucket(duration)]++;
+gLatency->count++;
+gLatency->total += duration;
+if (duration > gLatency->max) gLatency->max = duration;
+}
+
+
+/*	GetPercentile
+	Duration that the fraction of those recorded didn't exceed
+*/
+unsigned long long GetPercentile(
+	const struct Histogram *histogram,
+	double		fraction
+	)
+{
+if (!histogram->count) return 0;
+
+// the rank of the duration asked for, counting from one
+unsigned long long rank = (unsigned long long) (fraction * histogram->count + 0.5);
+if (rank < 1) rank = 1;
+
+unsigned long long seen = 0;
+for (unsigned bucket = 0; bucket < kLatencyBuckets; bucket++)
+	if ((seen += histogram->counts[bucket]) >= rank) {
+		/* the top of the bucket, but not beyond what was actually seen */
+		const unsigned long long limit = GetBucketLimit(bucket);
+		return limit < histogram->max ? limit : histogram->max;
+		}
+
+return histogram->max;
+}
+
+
+/*	FormatDuration
+	Format a duration in ns with a unit that suits it
+*/
+static const char *FormatDuration(
+	char		text[],
+	size_t		size,
+	double		ns
+	)
+{
+if (ns < 1e4) snprintf(text, size, "%.0f ns", ns);
+else if (ns < 1e7) snprintf(text, size, "%.1f us", ns / 1e3);
+else if (ns < 1e10) snprintf(text, size, "%.1f ms", ns / 1e6);
+else snprintf(text, size, "%.1f s", ns / 1e9);
+
+return text;
+}
+
+
+/*	gLatencyPercentiles
+	Percentiles reported, and their names
+*/
+static const struct {
+	double		fraction;
+	const char	*name;
+	} gLatencyPercentiles[] = {
+	{ 0.5, "p50" },
+	{ 0.9, "p90" },
+	{ 0.99, "p99" },
+	{ 0.999, "p99.9" }
+	};
+
+
+/*	ReportLatency
+	Print the percentiles
+*/
+void ReportLatency(
+	const struct Histogram *histogram,
+	const char	*method,
+	const char	*mode
+	)
+{
+char text[32];
+
+fprintf(stderr, "latency: %s %s: %llu writes", method, mode, histogram->count);
+if (!histogram->count) {
+	fprintf(stderr, "\n");
+	return;
+	}
+
+fprintf(stderr, ", mean %s", FormatDuration(text, sizeof text, (double) histogram->total / histogram->count));
+for (size_t i = 0; i < sizeof gLatencyPercentiles / sizeof *gLatencyPercentiles; i++)
+	fprintf(stderr, ", %s %s", gLatencyPercentiles[i].name, FormatDuration(text, sizeof text, (double) GetPercentile(histogram, gLatencyPercentiles[i].fraction)));
+fprintf(stderr, ", max %s", FormatDuration(text, sizeof text, (double) histogram->max));
+fprintf(stderr, " (reading the clock takes %s)\n", FormatDuration(text, sizeof text, gTimerCost));
+}
@@ -0,0 +1,82 @@
+/*
+	Latency.h
+	
+	Per-write latency histogram for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	kLatencySubBits, kLatencySubBuckets
+	Each power of two is divided into this many buckets, so that a value is known to within
+	1/kLatencySubBuckets of itself
+*/
+enum { kLatencySubBits = 4, kLatencySubBuckets = 1 << kLatencySubBits };
+
+
+/*	kLatencyBuckets
+	Buckets needed for every 64-bit value: one each below kLatencySubBuckets, then
+	kLatencySubBuckets for each power of two from there on
+*/
+enum { kLatencyBuckets = kLatencySubBuckets + (64 - kLatencySubBits) * kLatencySubBuckets };
+
+
+/*	Histogram
+	Log-linear histogram of durations in ns
+*/
+struct Histogram {
+	unsigned long long counts[kLatencyBuckets];
+	unsigned long long count, total, max;
+	};
+
+
+/*	StartLatency
+	Clear the histogram and record every MarkWrite() into it from now on
+*/
+extern void StartLatency(struct Histogram*);
+
+
+/*	StopLatency
+	Stop recording
+*/
+extern void StopLatency(void);
+
+
+/*	GetPercentile
+	Duration (ns) that the given fraction of those recorded didn't exceed, to within the
+	resolution of the histogram
+*/
+extern unsigned long long GetPercentile(const struct Histogram*, double fraction);
+
+
+/*	ReportLatency
+	Print the percentiles of the histogram to standard error
+*/
+extern void ReportLatency(const struct Histogram*, const char *method, const char *mode);
+
+
+#ifdef __cplusplus
+	}
+#endif
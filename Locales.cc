@@ -0,0 +1,195 @@
+/*
+	Locales
+	
+	Cache of the C++ locales used by
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	Constructing a named std::locale loads and parses the locale's data every time (and
+	composing one with a codecvt facet allocates the facet as well), while copying a locale
+	only counts a reference; so each locale is made once and handed out by copy afterwards.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+/* Note that the codecvt approach demonstrated here is deprecated as of C++17. */
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+
+#include <clocale>
+#include <codecvt>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+#include "Codecvt.h"
+#include "Encoding.h"
+#include "Locales.h"
+
+
+
+/*	gLocales
+	Locales constructed so far, by name, encoding and facet
+*/
+static std::mutex gLocalesLock;
+static std::map<std::tuple<std::string, Encoding, Facet>, std::locale> gLocales;
+
+
+/*	MakeStandardFacet
+	Construct the standard library's conversion facet to the given encoding
+*/
+static std::codecvt<wchar_t, char, std::mbstate_t> *MakeStandardFacet(
+	enum Encoding	encoding
+	)
+{
+switch (encoding) {
+	case kEncodingUTF8:	return new std::codecvt_utf8<wchar_t>;
+	case kEncodingUTF16LE:	return new std::codecvt_utf16<wchar_t, 0x10ffff, std::little_endian>;
+	case kEncodingUTF16BE:	return new std::codecvt_utf16<wchar_t, 0x10ffff>;
+	
+	/* std::codecvt_utf16 is the nearest, but it only produces UTF-16 */
+	default:		throw "no standard codecvt facet for the encoding";
+	}
+}
+
+
+/*	MakeLocale
+	Construct the locale of the given name with the given conversion facet
+*/
+static std::locale MakeLocale(
+	const char	*name,
+	enum Encoding	encoding,
+	enum Facet	facet
+	)
+{
+const std::locale base = name ? std::locale(name) : std::locale::classic();
+
+if (!encoding) return base;
+
+switch (facet) {
+	case kFacetStandard:	return std::locale(base, MakeStandardFacet(encoding));
+	case kFacetProject:	return std::locale(base, new UnicodeCodecvt(encoding));
+	}
+
+return base;
+}
+
+
+/*	GetLocale
+	The locale of the given name with the given conversion facet
+*/
+std::locale GetLocale(
+	const char	*name,
+	enum Encoding	encoding,
+	enum Facet	facet
+	)
+{
+const std::lock_guard<std::mutex> lock(gLocalesLock);
+
+/* the classic locale is its own cache; the name "C" can't be told apart from it here */
+const std::tuple<std::string, Encoding, Facet> key { name ? name : "C", encoding, facet };
+auto found = gLocales.find(key);
+if (found == gLocales.end())
+	found = gLocales.emplace(key, MakeLocale(name, encoding, facet)).first;
+
+return found->second;
+}
+
+
+/*	kLocaleBenchSeconds
+	Minimum time spent measuring each operation
+*/
+static const double kLocaleBenchSeconds = 0.2;
+
+
+/*	MeasureNanoseconds
+	Average time taken by the operation, in ns
+*/
+template <typename Operation>
+static double MeasureNanoseconds(
+	Operation	operation
+	)
+{
+enum { kBatch = 64 };
+
+unsigned long long count = 0;
+const double start = Now();
+double elapsed;
+do {
+	for (unsigned i = 0; i < kBatch; i++) operation();
+	count += kBatch;
+	} while ((elapsed = Now() - start) < kLocaleBenchSeconds);
+
+return elapsed / count * 1e9;
+}
+
+
+/*	BenchmarkLocales
+	Print the cost of constructing, looking up, imbuing and setting each of the named locales
+*/
+extern "C"
+bool BenchmarkLocales(
+	const char *const names[],
+	size_t		count
+	)
+{
+bool failed = false;
+
+// setlocale() is restored afterwards
+const char *const current = setlocale(LC_ALL, NULL);
+const std::string saved = current ? current : "C";
+
+printf("# ns per call by locale\n");
+printf("%-16s %10s %10s %10s %10s %10s\n", "locale", "construct", "cached", "codecvt", "imbue", "setlocale");
+
+for (size_t i = 0; i < count; i++) {
+	const char *const name = names[i];
+	
+	try {
+		// fail early for a locale that doesn't exist
+		const std::locale cached = GetLocale(name);
+		
+		// what each stream setup did before the cache
+		const double construct = MeasureNanoseconds([name] { std::locale locale(name); });
+		const double lookup = MeasureNanoseconds([name] { GetLocale(name); });
+		const double codecvt = MeasureNanoseconds([name] { std::locale locale(std::locale(name), new std::codecvt_utf8<wchar_t>); });
+		
+		// imbuing a stream that is never opened isolates the cost of the imbue itself
+		std::wofstream stream;
+		const double imbue = MeasureNanoseconds([&stream, &cached] { stream.imbue(cached); });
+		
+		/* switch back and forth, in case the library notices that nothing changes */
+		const double set = MeasureNanoseconds([name] { setlocale(LC_ALL, name); setlocale(LC_ALL, "C"); }) / 2;
+		
+		printf("%-16s %10.0f %10.0f %10.0f %10.0f %10.0f\n", *name ? name : "\"\"", construct, lookup, codecvt, imbue, set);
+		fflush(stdout);
+		}
+	
+	catch (const std::runtime_error&) {
+		fprintf(stderr, "error: can't construct locale '%s'\n", name);
+		failed = true;
+		}
+	}
+
+setlocale(LC_ALL, saved.c_str());
+
+return failed;
+}
@@ -0,0 +1,54 @@
+/*
+	Locales.h
+	
+	Cache of the C++ locales used by
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "Transcode.h"
+
+#ifdef __cplusplus
+#include <locale>
+
+
+/*	GetLocale
+	The locale of the given name (or the classic "C" locale for NULL) with a conversion facet
+	(standard or project) to the given encoding, constructed on first use and shared afterwards
+	Throws std::runtime_error if there is no such locale, or a string if there is no such facet
+*/
+extern std::locale GetLocale(const char *name, enum Encoding = kEncodingNone, enum Facet = kFacetStandard);
+
+extern "C" {
+#endif
+
+
+/*	BenchmarkLocales
+	Print the cost of constructing, looking up, imbuing and setting each of the named locales
+	Return whether the call failed
+*/
+extern bool BenchmarkLocales(const char *const names[], size_t count);
+
+
+#ifdef __cplusplus
+	}
+#endif
@@ -0,0 +1,518 @@
+/*
+	Matrix
+	
+	Parallel runner for every configuration of
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	Each combination runs as a separate invocation of this program, writing to a file of its
+	own and with its standard output and error going to a log of its own; so that any one of
+	them crashing, or changing the console code page or the process locale, doesn't affect
+	the others.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+
+#include <WINDOWS.H>
+#include <fcntl.h>
+#include <io.h>
+#include <process.h>
+
+#else
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+#endif
+
+#include "Encoding.h"
+#include "Matrix.h"
+
+
+
+/*	Process
+	Handle on a running worker
+*/
+#ifdef _WIN32
+typedef intptr_t Process;
+#else
+typedef pid_t Process;
+#endif
+
+
+/*	Combination
+	One configuration in the matrix, and what became of it
+*/
+struct Combination {
+	const char	*method, *mode;
+	const char	*locale, *codePage;	// NULL if not given
+	char		output[32], log[40];
+	
+	// outcome
+	bool		supported;		// on this platform, and by design
+	bool		ran;
+	int		status;			// exit status
+	double		started, elapsed;
+	double		throughput;		// MB/s, if the log reports it
+	char		message[96];		// first complaint in the log
+	};
+
+
+/*	SplitList
+	Split a comma-separated list in place; an empty entry stands for 'not given'
+	Return the number of entries
+*/
+static size_t SplitList(
+	char		*list,
+	const char	*entries[]
+	)
+{
+size_t count = 0;
+
+for (char *entry = list;;) {
+	char *const comma = strchr(entry, ',');
+	if (comma) *comma = '\0';
+	
+	entries[count++] = *entry ? entry : NULL;
+	
+	if (!comma) break;
+	entry = comma + 1;
+	}
+
+return count;
+}
+
+
+/*	CountProcessors
+	Number of processors available to run workers on
+*/
+static unsigned int CountProcessors(void)
+{
+#ifdef _WIN32
+SYSTEM_INFO information;
+GetSystemInfo(&information);
+return information.dwNumberOfProcessors;
+
+#else
+const long count = sysconf(_SC_NPROCESSORS_ONLN);
+return count > 0 ? (unsigned int) count : 1;
+#endif
+}
+
+
+/*	GetProgramPath
+	Path by which the workers can run this same program
+*/
+static const char *GetProgramPath(
+	const char	*argv0
+	)
+{
+#ifdef _WIN32
+static char path[MAX_PATH];
+const DWORD length = GetModuleFileNameA(NULL, path, sizeof path);
+return length && length < sizeof path ? path : argv0;
+
+#elif defined(__linux__)
+/* argv[0] needn't be a path at all */
+return access("/proc/self/exe", X_OK) == 0 ? "/proc/self/exe" : argv0;
+
+#else
+return argv0;
+#endif
+}
+
+
+/*	StartWorker
+	Start a worker process with the given arguments and its standard error going to the given
+	log; its standard output (the hexadecimal readback) is discarded, since it would otherwise
+	bury the lines of the log that matter
+	Return whether the call failed
+*/
+static bool StartWorker(
+	const char	*program,
+	const char *const arguments[],
+	const char	log[],
+	Process		*process
+	)
+{
+#ifdef _WIN32
+/* The spawned process inherits the standard handles, so point ours at the log for the
+   duration; and _spawnv() joins the arguments with spaces without quoting them */
+const int fd = _open(log, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+if (fd == -1) return true;
+
+const int null = _open("NUL", _O_WRONLY | _O_BINARY);
+if (null == -1) {
+	_close(fd);
+	return true;
+	}
+
+size_t count = 0;
+while (arguments[count]) count++;
+
+const char **const quoted = calloc(count + 1, sizeof *quoted);
+char **const copies = calloc(count, sizeof *copies);
+bool failed = !quoted || !copies;
+for (size_t i = 0; !failed && i < count; i++)
+	if (!strchr(arguments[i], ' '))
+		quoted[i] = arguments[i];
+	
+	else if ((copies[i] = malloc(strlen(arguments[i]) + 3)))
+		sprintf(copies[i], "\"%s\"", arguments[i]), quoted[i] = copies[i];
+	
+	else
+		failed = true;
+
+if (!failed) {
+	fflush(stdout);
+	fflush(stderr);
+	const int savedOutput = _dup(1), savedError = _dup(2);
+	_dup2(null, 1);
+	_dup2(fd, 2);
+	
+	failed = (*process = _spawnv(_P_NOWAIT, program, quoted)) == -1;
+	
+	_dup2(savedOutput, 1);
+	_dup2(savedError, 2);
+	_close(savedOutput);
+	_close(savedError);
+	}
+
+for (size_t i = 0; copies && i < count; i++) free(copies[i]);
+free(copies);
+free(quoted);
+_close(null);
+_close(fd);
+
+return failed;
+
+#else
+posix_spawn_file_actions_t actions;
+posix_spawn_file_actions_init(&actions);
+posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+posix_spawn_file_actions_addopen(&actions, 2, log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+const bool failed = posix_spawnp(process, program, &actions, NULL, (char *const*) arguments, environ) != 0;
+
+posix_spawn_file_actions_destroy(&actions);
+
+return failed;
+#endif
+}
+
+
+/*	WaitForWorker
+	Wait for any one of the given workers to finish
+	Return its index, or -1 if the wait failed
+*/
+static int WaitForWorker(
+	const Process	processes[],
+	unsigned int	count,
+	int		*status
+	)
+{
+#ifdef _WIN32
+HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+for (unsigned int i = 0; i < count; i++) handles[i] = (HANDLE) processes[i];
+
+const DWORD result = WaitForMultipleObjects(count, handles, FALSE, INFINITE);
+if (result >= WAIT_OBJECT_0 + count) return -1;
+
+const int index = (int) (result - WAIT_OBJECT_0);
+DWORD code;
+*status = GetExitCodeProcess(handles[index], &code) ? (int) code : -1;
+CloseHandle(handles[index]);
+
+return index;
+
+#else
+int waited;
+const pid_t pid = wait(&waited);
+if (pid == -1) return -1;
+
+*status = WIFEXITED(waited) ? WEXITSTATUS(waited) : 128 + WTERMSIG(waited);
+
+for (unsigned int i = 0; i < count; i++)
+	if (processes[i] == pid) return (int) i;
+
+return -1;
+#endif
+}
+
+
+/*	ReadLog
+	Pick the throughput and the first complaint out of a finished worker's log
+*/
+static void ReadLog(
+	struct Combination *combination
+	)
+{
+FILE *const file = fopen(combination->log, "r");
+if (!file) return;
+
+for (char line[512]; fgets(line, sizeof line, file);) {
+	// benchmark result?
+	const char *bench;
+	if (strncmp(line, "bench:", 6) == 0 && (bench = strstr(line, " s: ")))
+		combination->throughput = strtod(bench + 4, NULL);
+	
+	// error or verification?
+	else if (!*combination->message && (strncmp(line, "error", 5) == 0 || strncmp(line, "verify:", 7) == 0)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		/* only as much of the line as the table has room for */
+		snprintf(combination->message, sizeof combination->message, "%.*s", (int) sizeof combination->message - 1, line);
+		}
+	}
+
+fclose(file);
+}
+
+
+/*	PrintResults
+	Print the table of outcomes
+	Return whether any combination that is supported failed
+*/
+static bool PrintResults(
+	const struct Combination *combinations,
+	size_t		count
+	)
+{
+printf("%4s  %-19s %-12s %-12s %-6s %-6s %9s %10s  %s\n", "#", "method", "mode", "locale", "cp", "result", "seconds", "MB/s", "message");
+
+size_t passed = 0, supported = 0;
+for (size_t i = 0; i < count; i++) {
+	const struct Combination *const c = combinations + i;
+	
+	char throughput[16] = "-";
+	if (c->throughput > 0) snprintf(throughput, sizeof throughput, "%.1f", c->throughput);
+	
+	char result[8];
+	if (c->supported) supported++;
+	
+	if (!c->supported) strcpy(result, "n/a");
+	else if (c->ran && c->status == 0) passed++, strcpy(result, "ok");
+	else if (!c->ran) strcpy(result, "-");
+	else snprintf(result, sizeof result, "%d", c->status);
+	
+	printf("%4zu  %-19s %-12s %-12s %-6s %-6s %9.3f %10s  %s\n",
+		i + 1, c->method, c->mode, c->locale ? c->locale : "-", c->codePage ? c->codePage : "-",
+		result, c->elapsed, throughput, c->message
+		);
+	}
+
+printf("%zu of %zu passed", passed, supported);
+if (supported < count) printf(" (%zu not applicable here)", count - supported);
+printf("\n");
+
+return passed < supported;
+}
+
+
+/*	RunMatrix
+	Run every combination, each in a worker process of its own
+*/
+bool RunMatrix(
+	const char	*argv0,
+	const char *const methods[],
+	size_t		methodCount,
+	const char *const modes[],
+	size_t		modeCount,
+	bool		(*supported)(size_t method, size_t mode, const char *locale),
+	int		argc,
+	const char	*argv[]
+	)
+{
+const char *const program = GetProgramPath(argv0);
+unsigned int jobs = CountProcessors();
+char *localeList = NULL, *codePageList = NULL;
+bool keep = false;
+
+// runner options; pass everything else on to the workers
+const char **const passed = calloc(argc + 1, sizeof *passed);
+if (!passed) return true;
+size_t passedCount = 0;
+
+for (int i = 0; i < argc; i++) {
+	const char *const arg = argv[i];
+	
+	// number of workers?
+	if (strncmp(arg, "jobs=", 5) == 0) {
+		if ((jobs = strtoul(arg + 5, NULL, 10)) == 0) {
+			fprintf(stderr, "warning: option jobs=#### needs a number of workers\n");
+			jobs = CountProcessors();
+			}
+		}
+	
+	// locales?
+	else if (strncmp(arg, "locales=", 8) == 0)
+		localeList = (char*) arg + 8;
+	
+	// code pages?
+	else if (strncmp(arg, "codepages=", 10) == 0)
+		codePageList = (char*) arg + 10;
+	
+	// keep output files and logs?
+	else if (strcmp(arg, "keep") == 0)
+		keep = true;
+	
+	// every worker writes to its own file anyway
+	else if (strcmp(arg, "file") == 0 || strncmp(arg, "output=", 7) == 0)
+		;
+	
+	/* the interposer's seccomp filter can't be removed, and would be inherited by every worker */
+	else if (strcmp(arg, "syscalls") == 0) {
+		fprintf(stderr, "error: 'syscalls' can't be combined with 'all'; count one combination at a time\n");
+		free(passed);
+		return true;
+		}
+	
+	else
+		passed[passedCount++] = arg;
+	}
+
+#ifdef _WIN32
+if (jobs > MAXIMUM_WAIT_OBJECTS) jobs = MAXIMUM_WAIT_OBJECTS;
+#endif
+
+// lists
+/* The option strings are ours to split up */
+const char *noEntry = NULL;
+const char **locales = &noEntry, **codePages = &noEntry;
+size_t localeCount = 1, codePageCount = 1;
+if (localeList && (locales = calloc(strlen(localeList) + 1, sizeof *locales)))
+	localeCount = SplitList(localeList, locales);
+if (codePageList && (codePages = calloc(strlen(codePageList) + 1, sizeof *codePages)))
+	codePageCount = SplitList(codePageList, codePages);
+
+// enumerate
+const size_t count = methodCount * modeCount * localeCount * codePageCount;
+struct Combination *const combinations = locales && codePages ? calloc(count, sizeof *combinations) : NULL;
+Process *const processes = calloc(jobs, sizeof *processes);
+size_t *const running = calloc(jobs, sizeof *running);
+const char **const arguments = calloc(8 + passedCount, sizeof *arguments);
+bool failed = !combinations || !processes || !running || !arguments;
+if (failed)
+	fprintf(stderr, "error: can't allocate matrix\n");
+
+struct Combination *c = combinations;
+for (size_t method = 0; !failed && method < methodCount; method++)
+	for (size_t mode = 0; mode < modeCount; mode++)
+		for (size_t locale = 0; locale < localeCount; locale++)
+			for (size_t codePage = 0; codePage < codePageCount; codePage++, c++) {
+				c->method = methods[method];
+				c->mode = modes[mode];
+				c->locale = locales[locale];
+				c->codePage = codePages[codePage];
+				c->supported = supported(method, mode, c->locale);
+				
+				const size_t index = c - combinations + 1;
+				snprintf(c->output, sizeof c->output, "%s-%zu", gFileName, index);
+				snprintf(c->log, sizeof c->log, "%s-%zu.log", gFileName, index);
+				}
+
+if (!failed) fprintf(stderr, "info: running %zu combinations on %u workers\n", count, jobs);
+
+// keep every worker busy until all have run
+unsigned int busy = 0;
+for (size_t next = 0; !failed && (next < count || busy);) {
+	// start another?
+	if (next < count && busy < jobs) {
+		struct Combination *const c = combinations + next++;
+		if (!c->supported) continue;
+		
+		char output[48], locale[128], codePage[32];
+		size_t n = 0;
+		arguments[n++] = program;
+		arguments[n++] = c->method;
+		arguments[n++] = c->mode;
+		arguments[n++] = "file";
+		snprintf(output, sizeof output, "output=%s", c->output);
+		arguments[n++] = output;
+		if (c->locale) {
+			snprintf(locale, sizeof locale, "l%s", c->locale);
+			arguments[n++] = locale;
+			}
+		if (c->codePage) {
+			snprintf(codePage, sizeof codePage, "cp%s", c->codePage);
+			arguments[n++] = codePage;
+			}
+		for (size_t i = 0; i < passedCount; i++) arguments[n++] = passed[i];
+		arguments[n] = NULL;
+		
+		c->started = Now();
+		if (StartWorker(program, arguments, c->log, processes + busy)) {
+			snprintf(c->message, sizeof c->message, "error: can't start worker");
+			continue;
+			}
+		
+		running[busy++] = c - combinations;
+		continue;
+		}
+	
+	// wait for one to finish
+	int status;
+	const int index = WaitForWorker(processes, busy, &status);
+	if (index == -1) {
+		fprintf(stderr, "error: can't wait for worker\n");
+		failed = true;
+		break;
+		}
+	
+	struct Combination *const c = combinations + running[index];
+	c->elapsed = Now() - c->started;
+	c->ran = true;
+	c->status = status;
+	ReadLog(c);
+	
+	if (!keep) {
+		remove(c->output);
+		remove(c->log);
+		}
+	
+	// fill the gap
+	busy--;
+	processes[index] = processes[busy];
+	running[index] = running[busy];
+	}
+
+if (!failed) failed = PrintResults(combinations, count);
+
+free(arguments);
+free(running);
+free(processes);
+free(combinations);
+if (codePages != &noEntry) free(codePages);
+if (locales != &noEntry) free(locales);
+free(passed);
+
+return failed;
+}
@@ -0,0 +1,45 @@
+/*
+	Matrix.h
+	
+	Parallel runner for every configuration of
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	RunMatrix
+	Run every combination of the given Method and Mode names with the locales and code pages
+	and other options in 'argv', each in a worker process of its own; print the results.  A
+	combination that 'supported' (given the offsets of its names, and its locale if any)
+	rejects isn't run, and is listed as not applicable
+	Return whether the call failed, or any combination that ran did
+*/
+extern bool RunMatrix(const char *argv0, const char *const methods[], size_t methodCount, const char *const modes[], size_t modeCount, bool (*supported)(size_t method, size_t mode, const char *locale), int argc, const char *argv[]);
+
+
+#ifdef __cplusplus
+	}
+#endif
@@ -0,0 +1,72 @@
+/*
+	Platform.h
+	
+	Platform layer for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	The test code is written against the Windows CRT's 'POSIX-style' names; elsewhere
+	these are mapped onto POSIX proper.  POSIX file descriptors have no text or Unicode
+	translation modes, so those flags all become zero and the modes are instead emulated
+	by explicit transcoding (see Transcode.h).
+*/
+
+#pragma once
+
+#include <fcntl.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+
+#include <io.h>
+#include <sys\stat.h>
+
+#else
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define _O_WRONLY	O_WRONLY
+#define _O_CREAT	O_CREAT
+#define _O_TRUNC	O_TRUNC
+
+#define _S_IREAD	(S_IRUSR | S_IRGRP | S_IROTH)
+#define _S_IWRITE	(S_IWUSR | S_IWGRP | S_IWOTH)
+
+#define _O_BINARY	0
+#define _O_TEXT		0
+#define _O_WTEXT	0
+#define _O_U8TEXT	0
+#define _O_U16TEXT	0
+
+
+/*	POSIX-style functions
+	Functions rather than macros, since the test code has locals named 'write'
+*/
+static inline int _fileno(FILE *file) { return fileno(file); }
+static inline int _open(const char *path, int flags, int permissions) { return open(path, flags, (mode_t) permissions); }
+static inline int _write(int fd, const void *buffer, unsigned int count) { return (int) write(fd, buffer, count); }
+static inline int _close(int fd) { return close(fd); }
+
+
+/*	_setmode
+	There are no translation modes to apply to a POSIX file descriptor
+*/
+static inline int _setmode(int fd, int mode) { (void) fd; (void) mode; return 0; }
+
+#endif
@@ -0,0 +1,403 @@
+/*
+	Readback
+	
+	Inspection of the output file written by
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	The output file is memory-mapped rather than read, so that checking a benchmark's worth
+	of output costs little more than the page faults; the hexadecimal dump is produced a
+	block at a time by a vector kernel where the processor has one.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define READBACK_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#include "Readback.h"
+#include "Sample.h"
+
+
+
+/*	kHexDigits
+	Digits of the dump
+*/
+static const char kHexDigits[] = "0123456789abcdef";
+
+
+/*	kDumpBlock
+	Number of bytes converted to hexadecimal between writes to standard output
+*/
+enum { kDumpBlock = 64 << 10 };
+
+
+/*	HexScalar
+	Write each byte as two hexadecimal digits followed by a space
+*/
+static void HexScalar(
+	const unsigned char *input,
+	size_t		length,
+	char		*output
+	)
+{
+for (const unsigned char *const inpute = input + length; input < inpute; input++) {
+	*output++ = kHexDigits[*input >> 4];
+	*output++ = kHexDigits[*input & 0x0F];
+	*output++ = ' ';
+	}
+}
+
+
+#ifdef READBACK_X86
+
+/*	TARGET_SSSE3
+	Allow SSSE3 instructions in the marked function only, so that the rest of the program
+	still runs on processors without it
+*/
+#ifdef __GNUC__
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#else
+#define TARGET_SSSE3
+#endif
+
+
+/*	gHexShuffles, gHexSpaces
+	For each of the three 16-byte stores that sixteen input bytes expand to, the positions in
+	the high and low digit vectors that supply each output byte, and the spaces between them
+*/
+static uint8_t gHexShuffles[3][2][16];
+static uint8_t gHexSpaces[3][16];
+
+
+/*	InitializeHexShuffles
+	Fill in the gHexShuffles and gHexSpaces tables
+*/
+static void InitializeHexShuffles(void)
+{
+for (unsigned store = 0; store < 3; store++)
+	for (unsigned i = 0; i < 16; i++) {
+		const unsigned position = 16 * store + i, byte = position / 3, role = position % 3;
+		
+		// positions that don't come from a vector produce zero
+		gHexShuffles[store][0][i] = role == 0 ? (uint8_t) byte : 0x80;
+		gHexShuffles[store][1][i] = role == 1 ? (uint8_t) byte : 0x80;
+		gHexSpaces[store][i] = role == 2 ? ' ' : 0;
+		}
+}
+
+
+/*	HexSSSE3
+	Write each byte as two hexadecimal digits followed by a space
+*/
+TARGET_SSSE3
+static void HexSSSE3(
+	const unsigned char *input,
+	size_t		length,
+	char		*output
+	)
+{
+const __m128i
+	digits = _mm_loadu_si128((const __m128i*) kHexDigits),
+	nibble = _mm_set1_epi8(0x0F);
+
+const unsigned char *const inpute = input + length;
+for (; inpute - input >= 16; input += 16, output += 48) {
+	const __m128i
+		bytes = _mm_loadu_si128((const __m128i*) input),
+		high = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble)),
+		low = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, nibble));
+	
+	for (unsigned store = 0; store < 3; store++) {
+		const __m128i text = _mm_or_si128(
+			_mm_or_si128(
+				_mm_shuffle_epi8(high, _mm_loadu_si128((const __m128i*) gHexShuffles[store][0])),
+				_mm_shuffle_epi8(low, _mm_loadu_si128((const __m128i*) gHexShuffles[store][1]))
+				),
+			_mm_loadu_si128((const __m128i*) gHexSpaces[store])
+			);
+		_mm_storeu_si128((__m128i*) (output + 16 * store), text);
+		}
+	}
+
+HexScalar(input, inpute - input, output);
+}
+
+
+/*	HasSSSE3
+	Whether the processor supports SSSE3
+*/
+static bool HasSSSE3(void)
+{
+#ifdef _MSC_VER
+int registers[4];
+__cpuid(registers, 1);
+return (registers[2] & 1 << 9) != 0;
+
+#else
+return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+#endif
+
+
+/*	HexFunction
+	Signature shared by the hexadecimal kernels
+*/
+typedef void (*HexFunction)(const unsigned char*, size_t, char*);
+
+
+/*	gHexKernel
+	Kernel selected for this processor
+*/
+static struct {
+	const char	*name;
+	HexFunction	hex;
+	} gHexKernel;
+
+
+/*	SelectHexKernel
+	Choose the kernel for this processor
+*/
+static void SelectHexKernel(void)
+{
+#ifdef READBACK_X86
+if (HasSSSE3()) {
+	InitializeHexShuffles();
+	
+	gHexKernel.hex = HexSSSE3;
+	gHexKernel.name = "ssse3";
+	return;
+	}
+#endif
+
+gHexKernel.hex = HexScalar;
+gHexKernel.name = "scalar";
+}
+
+
+/*	GetHexKernelName
+	Name of the kernel that DumpFile() uses
+*/
+const char *GetHexKernelName(void)
+{
+if (!gHexKernel.name) SelectHexKernel();
+
+return gHexKernel.name;
+}
+
+
+/*	DumpFile
+	Print the start of the given file as hexadecimal
+*/
+bool DumpFile(
+	const char	path[],
+	unsigned long long limit
+	)
+{
+if (!gHexKernel.name) SelectHexKernel();
+
+const char *view;
+size_t mapped;
+if (MapReadOnlyFile(path, false, &view, &mapped)) return true;
+
+const size_t length = mapped < limit ? mapped : (size_t) limit;
+
+char *const text = malloc(3 * kDumpBlock);
+if (!text) {
+	fprintf(stderr, "error: can't allocate dump buffer\n");
+	UnmapReadOnlyFile(view, mapped);
+	return true;
+	}
+
+// print each byte in the file as hexadecimal
+for (size_t offset = 0, block; offset < length; offset += block) {
+	block = length - offset < kDumpBlock ? length - offset : kDumpBlock;
+	
+	gHexKernel.hex((const unsigned char*) view + offset, block, text);
+	fwrite(text, 1, 3 * block, stdout);
+	}
+fputc('\n', stdout);
+
+free(text);
+UnmapReadOnlyFile(view, mapped);
+
+return false;
+}
+
+
+/*	FindMismatch
+	Offset of the first byte that differs between the two ranges
+	Return the length if there is none
+*/
+static size_t FindMismatch(
+	const char	*actual,
+	const char	*expected,
+	size_t		length
+	)
+{
+/* memcmp() is vectorized in any library that matters; only the block that differs is
+   searched a byte at a time */
+enum { kBlock = 4096 };
+
+size_t offset = 0;
+for (size_t block; offset < length; offset += block) {
+	block = length - offset < kBlock ? length - offset : kBlock;
+	
+	if (memcmp(actual + offset, expected + offset, block) != 0) break;
+	}
+
+for (; offset < length; offset++)
+	if (actual[offset] != expected[offset]) break;
+
+return offset;
+}
+
+
+/*	ReportComparison
+	Print the result of comparing the output with what was expected
+	Return whether they differ
+*/
+static bool ReportComparison(
+	const char	*actual,
+	unsigned long long actualLength,
+	unsigned long long mismatch,
+	unsigned char	expectedByte,
+	unsigned long long expectedLength
+	)
+{
+const unsigned long long common = actualLength < expectedLength ? actualLength : expectedLength;
+
+if (mismatch < common) {
+	fprintf(stderr, "verify: output differs at byte %llu (0x%llx): %02x, expected %02x\n",
+		mismatch, mismatch, (unsigned char) actual[mismatch], expectedByte
+		);
+	return true;
+	}
+
+if (actualLength != expectedLength) {
+	fprintf(stderr, "verify: output is %llu bytes, expected %llu; it differs from byte %llu (0x%llx)\n",
+		actualLength, expectedLength, common, common
+		);
+	return true;
+	}
+
+fprintf(stderr, "verify: output matches (%llu bytes)\n", actualLength);
+return false;
+}
+
+
+/*	VerifyFile
+	Compare the given file with the contents of another
+*/
+bool VerifyFile(
+	const char	path[],
+	const char	expectedPath[]
+	)
+{
+const char *actual, *expected;
+size_t actualLength, expectedLength;
+if (MapReadOnlyFile(path, false, &actual, &actualLength)) return true;
+if (MapReadOnlyFile(expectedPath, false, &expected, &expectedLength)) {
+	UnmapReadOnlyFile(actual, actualLength);
+	return true;
+	}
+
+const size_t mismatch = FindMismatch(actual, expected, actualLength < expectedLength ? actualLength : expectedLength);
+const bool failed = ReportComparison(actual, actualLength, mismatch, mismatch < expectedLength ? (unsigned char) expected[mismatch] : 0, expectedLength);
+
+UnmapReadOnlyFile(expected, expectedLength);
+UnmapReadOnlyFile(actual, actualLength);
+
+return failed;
+}
+
+
+/*	VerifyFileWithSample
+	Compare the given file with what writing the sample should produce
+*/
+bool VerifyFileWithSample(
+	const char	path[],
+	const struct Sample *sample,
+	enum Mode	mode,
+	enum Encoding	encoding,
+	bool		withMark,
+	size_t		repeat
+	)
+{
+// the sample as it is written
+const struct SampleText text = GetSampleText(sample, mode);
+const char *unit = text.units;
+size_t unitLength = text.length;
+char *encoded = NULL;
+if (text.width > 1) {
+	if (!(encoded = malloc(EncodeBound(encoding, text.length)))) {
+		fprintf(stderr, "error: can't allocate encoding buffer\n");
+		return true;
+		}
+	
+	unitLength = EncodeUnits(encoding, text.units, text.width, text.length, encoded);
+	unit = encoded;
+	}
+
+const char *mark = NULL;
+const size_t markLength = withMark ? GetModeByteOrderMark(mode, &mark) : 0;
+const unsigned long long expectedLength = markLength + (unsigned long long) repeat * unitLength;
+
+const char *actual;
+size_t actualLength;
+if (MapReadOnlyFile(path, false, &actual, &actualLength)) {
+	free(encoded);
+	return true;
+	}
+
+// compare byte order mark, then each repeat of the sample
+const size_t common = actualLength < expectedLength ? actualLength : (size_t) expectedLength;
+size_t mismatch = FindMismatch(actual, mark, markLength < common ? markLength : common);
+unsigned char expectedByte = mismatch < markLength ? (unsigned char) mark[mismatch] : 0;
+if (mismatch == markLength)
+	for (size_t offset = markLength, compare; offset < common; offset += compare) {
+		compare = common - offset < unitLength ? common - offset : unitLength;
+		
+		const size_t found = FindMismatch(actual + offset, unit, compare);
+		mismatch = offset + found;
+		if (found < compare) {
+			expectedByte = (unsigned char) unit[found];
+			break;
+			}
+		}
+
+const bool failed = ReportComparison(actual, actualLength, mismatch, expectedByte, expectedLength);
+
+UnmapReadOnlyFile(actual, actualLength);
+free(encoded);
+
+return failed;
+}
@@ -0,0 +1,65 @@
+/*
+	Readback.h
+	
+	Inspection of the output file written by
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Encoding.h"
+#include "Transcode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	DumpFile
+	Print at most 'limit' bytes at the start of the given file as hexadecimal to standard output
+	Return whether the call failed
+*/
+extern bool DumpFile(const char path[], unsigned long long limit);
+
+
+/*	VerifyFile
+	Compare the given file with the contents of another, reporting the first difference
+	Return whether the call failed, or the files differ
+*/
+extern bool VerifyFile(const char path[], const char expectedPath[]);
+
+
+/*	VerifyFileWithSample
+	Compare the given file with what writing the sample 'repeat' times in the given Mode
+	should produce, its wide characters or code units encoded in the given encoding
+	(preceded by the Mode's byte order mark, if 'withMark', as it is in a file but not on
+	standard output), reporting the first difference
+	Return whether the call failed, or the file differs
+*/
+extern bool VerifyFileWithSample(const char path[], const struct Sample*, enum Mode, enum Encoding, bool withMark, size_t repeat);
+
+
+/*	GetHexKernelName
+	Name of the kernel that DumpFile() uses ("ssse3" or "scalar")
+*/
+extern const char *GetHexKernelName(void);
+
+
+#ifdef __cplusplus
+	}
+#endif
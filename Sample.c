@@ -0,0 +1,413 @@
+/*
+	Sample
+	
+	Text data sent by the tests in
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+
+#include <WINDOWS.H>
+
+#else
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#endif
+
+#include "Sample.h"
+#include "Transcode.h"
+
+
+
+/*	gDefaultNarrow
+	Bytes sent as text data
+	These are the same characters listed in gDefaultWide, but encoded as Code Page 437
+*/
+static const char gDefaultNarrow[] = { 0x41, '\xCE', '\xA3', '\xEB', '\x8C', 0x0A };
+
+
+/*	gDefaultWide
+	Wide characters sent as text data (with UTF-16 interpretation)
+	
+	Not using u8'' here because that has Unicode semantics; we really want to force exactly
+	the specific value here
+*/
+static const wchar_t gDefaultWide[] = {
+	0x0041,			// LATIN CAPITAL LETTER A
+	0x256C,			// BOX DRAWINGS DOUBLE VERTICAL AND HORIZONTAL
+	0x00FA,			// LATIN SMALL LETTER U WITH ACUTE
+	0x03B4,			// GREEK SMALL LETTER DELTA
+	0x00EE,			// LATIN SMALL LETTER I WITH CIRCUMFLEX
+	0x000A			// LINE FEED (LF)
+	};
+
+
+/*	gDefaultChar8, gDefaultChar16, gDefaultChar32
+	Code units sent as text data in the char8, char16 and char32 modes
+	
+	The characters of gDefaultWide, with two from the supplementary planes before the line feed;
+	each of those takes four bytes of UTF-8 and a surrogate pair of UTF-16.  Spelled out for the
+	same reason as gDefaultWide.
+*/
+static const char gDefaultChar8[] = {
+	0x41,
+	'\xE2', '\x95', '\xAC',
+	'\xC3', '\xBA',
+	'\xCE', '\xB4',
+	'\xC3', '\xAE',
+	'\xF0', '\x9F', '\x98', '\x80',
+	'\xF0', '\x90', '\x8D', '\x88',
+	0x0A
+	};
+
+static const char16_t gDefaultChar16[] = {
+	0x0041,
+	0x256C,
+	0x00FA,
+	0x03B4,
+	0x00EE,
+	0xD83D, 0xDE00,		// U+1F600
+	0xD800, 0xDF48,		// U+10348
+	0x000A
+	};
+
+static const char32_t gDefaultChar32[] = {
+	0x00000041,		// LATIN CAPITAL LETTER A
+	0x0000256C,		// BOX DRAWINGS DOUBLE VERTICAL AND HORIZONTAL
+	0x000000FA,		// LATIN SMALL LETTER U WITH ACUTE
+	0x000003B4,		// GREEK SMALL LETTER DELTA
+	0x000000EE,		// LATIN SMALL LETTER I WITH CIRCUMFLEX
+	0x0001F600,		// GRINNING FACE
+	0x00010348,		// GOTHIC LETTER HWAIR
+	0x0000000A		// LINE FEED (LF)
+	};
+
+
+/*	gDefaultSample
+	Sample used when no input file is given
+*/
+const struct Sample gDefaultSample = {
+	gDefaultNarrow, sizeof gDefaultNarrow / sizeof *gDefaultNarrow,
+	gDefaultWide, sizeof gDefaultWide / sizeof *gDefaultWide,
+	gDefaultChar8, sizeof gDefaultChar8 / sizeof *gDefaultChar8,
+	gDefaultChar16, sizeof gDefaultChar16 / sizeof *gDefaultChar16,
+	gDefaultChar32, sizeof gDefaultChar32 / sizeof *gDefaultChar32,
+	NULL, NULL, NULL, NULL
+	};
+
+
+/*	IsCodeUnitMode
+	Whether the Mode is one of char8, char16 and char32
+*/
+bool IsCodeUnitMode(
+	enum Mode	mode
+	)
+{
+return mode == kModeChar8 || mode == kModeChar16 || mode == kModeChar32;
+}
+
+
+/*	GetSampleText
+	Form of the sample that the given Mode writes
+*/
+struct SampleText GetSampleText(
+	const struct Sample *sample,
+	enum Mode	mode
+	)
+{
+switch (mode) {
+	case kModeWide:
+	case kModeUnicode:
+	case kModeWideUnicode:	return (struct SampleText) { sample->wide, sizeof *sample->wide, sample->wideLength };
+	case kModeChar8:	return (struct SampleText) { sample->utf8, sizeof *sample->utf8, sample->utf8Length };
+	case kModeChar16:	return (struct SampleText) { sample->utf16, sizeof *sample->utf16, sample->utf16Length };
+	case kModeChar32:	return (struct SampleText) { sample->utf32, sizeof *sample->utf32, sample->utf32Length };
+	default:		return (struct SampleText) { sample->narrow, sizeof *sample->narrow, sample->narrowLength };
+	}
+}
+
+
+/*	GetNarrowChunk
+	Number of narrow characters of the remainder of the sample to hand to the method next
+*/
+size_t GetNarrowChunk(
+	size_t		remaining
+	)
+{
+return remaining < kSampleChunk ? remaining : kSampleChunk;
+}
+
+
+/*	GetWideChunk
+	Number of wide characters of the remainder of the sample to hand to the method next
+*/
+size_t GetWideChunk(
+	const wchar_t	*wide,
+	size_t		remaining
+	)
+{
+if (remaining <= kSampleChunk) return remaining;
+
+// don't end on a high surrogate
+const wchar_t last = wide[kSampleChunk - 1];
+return last >= 0xD800 && last < 0xDC00 ? kSampleChunk - 1 : kSampleChunk;
+}
+
+
+/*	GetTextChunk
+	Number of code units of the remainder of the sample to hand to the method next
+*/
+size_t GetTextChunk(
+	const struct SampleText *text,
+	size_t		offset
+	)
+{
+const size_t remaining = text->length - offset;
+if (remaining <= kSampleChunk) return remaining;
+
+// don't end on a high surrogate
+if (text->width == 2) {
+	const char16_t last = ((const char16_t*) text->units)[offset + kSampleChunk - 1];
+	return last >= 0xD800 && last < 0xDC00 ? kSampleChunk - 1 : kSampleChunk;
+	}
+
+return kSampleChunk;
+}
+
+
+/*	MapReadOnlyFile
+	Memory-map the whole of the given file for reading
+*/
+bool MapReadOnlyFile(
+	const char	path[],
+	bool		populate,
+	const char	**view,
+	size_t		*length
+	)
+{
+*view = NULL;
+*length = 0;
+
+#ifdef _WIN32
+HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL /* security */, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL /* template */);
+if (file == INVALID_HANDLE_VALUE) {
+	fprintf(stderr, "error: can't open \"%s\"\n", path);
+	return true;
+	}
+
+LARGE_INTEGER size;
+if (!GetFileSizeEx(file, &size) || (unsigned long long) size.QuadPart > SIZE_MAX) {
+	fprintf(stderr, "error: \"%s\" is too large to map\n", path);
+	CloseHandle(file);
+	return true;
+	}
+
+// nothing to map?
+if (size.QuadPart == 0) {
+	CloseHandle(file);
+	return false;
+	}
+
+/* The view keeps the mapping, and the mapping the file, open once the handles are closed */
+HANDLE mapping = CreateFileMappingA(file, NULL /* security */, PAGE_READONLY, 0, 0, NULL /* name */);
+void *const mapped = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+if (mapping) CloseHandle(mapping);
+CloseHandle(file);
+
+if (!mapped) {
+	fprintf(stderr, "error: can't map \"%s\"\n", path);
+	return true;
+	}
+
+/* Windows has no equivalent of MAP_POPULATE short of touching the pages */
+if (populate) {
+	volatile char sum = 0;
+	for (size_t offset = 0; offset < (size_t) size.QuadPart; offset += 4096) sum += ((const char*) mapped)[offset];
+	}
+
+*view = mapped;
+*length = (size_t) size.QuadPart;
+
+#else
+const int fd = open(path, O_RDONLY);
+if (fd == -1) {
+	fprintf(stderr, "error: can't open \"%s\"\n", path);
+	return true;
+	}
+
+struct stat status;
+if (fstat(fd, &status) == -1) {
+	fprintf(stderr, "error: can't get the size of \"%s\"\n", path);
+	close(fd);
+	return true;
+	}
+
+// nothing to map?
+if (status.st_size == 0) {
+	close(fd);
+	return false;
+	}
+
+/* Fault the pages in now if asked, so that it happens outside any measurement */
+int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+if (populate) flags |= MAP_POPULATE;
+#endif
+void *const mapped = mmap(NULL, (size_t) status.st_size, PROT_READ, flags, fd, 0);
+close(fd);
+
+if (mapped == MAP_FAILED) {
+	fprintf(stderr, "error: can't map \"%s\"\n", path);
+	return true;
+	}
+
+*view = mapped;
+*length = (size_t) status.st_size;
+#endif
+
+return false;
+}
+
+
+/*	UnmapReadOnlyFile
+	Release a mapping made by MapReadOnlyFile()
+*/
+void UnmapReadOnlyFile(
+	const char	*view,
+	size_t		length
+	)
+{
+if (!view) return;
+
+#ifdef _WIN32
+UnmapViewOfFile(view);
+#else
+munmap((void*) view, length);
+#endif
+}
+
+
+/*	OpenSampleFile
+	Memory-map the given file as the narrow form of a sample
+*/
+bool OpenSampleFile(
+	struct Sample	*sample,
+	const char	path[]
+	)
+{
+*sample = (struct Sample) { 0 };
+
+const char *view;
+size_t length;
+if (MapReadOnlyFile(path, true, &view, &length)) return true;
+
+if (length == 0) {
+	fprintf(stderr, "error: input file \"%s\" is empty\n", path);
+	return true;
+	}
+
+sample->mapping = (void*) view;
+sample->narrow = sample->utf8 = view;
+sample->narrowLength = sample->utf8Length = length;
+
+return false;
+}
+
+
+/*	DecodeSampleWide
+	Provide the wide form of a sample read from a file
+*/
+bool DecodeSampleWide(
+	struct Sample	*sample
+	)
+{
+// already have it?
+if (sample->wide) return false;
+
+/* No more wide characters than there are bytes */
+if (!(sample->decoded = malloc(sample->narrowLength * sizeof *sample->decoded))) {
+	fprintf(stderr, "error: can't allocate %zu bytes to decode input\n", sample->narrowLength * sizeof *sample->decoded);
+	return true;
+	}
+
+sample->wideLength = DecodeUTF8(sample->narrow, sample->narrowLength, sample->decoded);
+sample->wide = sample->decoded;
+
+return false;
+}
+
+
+/*	DecodeSampleUnits
+	Provide the char16 or char32 form of a sample read from a file
+*/
+bool DecodeSampleUnits(
+	struct Sample	*sample,
+	size_t		width
+	)
+{
+// already have it?
+if (width == 2 ? sample->utf16 != NULL : sample->utf32 != NULL) return false;
+
+/* No more code units than there are bytes */
+void *const decoded = malloc(sample->narrowLength * width);
+if (!decoded) {
+	fprintf(stderr, "error: can't allocate %zu bytes to decode input\n", sample->narrowLength * width);
+	return true;
+	}
+
+const size_t length = DecodeUTF8Units(sample->narrow, sample->narrowLength, width, decoded);
+if (width == 2) {
+	sample->utf16 = sample->decoded16 = decoded;
+	sample->utf16Length = length;
+	}
+
+else {
+	sample->utf32 = sample->decoded32 = decoded;
+	sample->utf32Length = length;
+	}
+
+return false;
+}
+
+
+/*	CloseSample
+	Release whatever a sample read from a file holds
+*/
+void CloseSample(
+	struct Sample	*sample
+	)
+{
+UnmapReadOnlyFile(sample->mapping, sample->narrowLength);
+
+free(sample->decoded);
+free(sample->decoded16);
+free(sample->decoded32);
+
+*sample = (struct Sample) { 0 };
+}
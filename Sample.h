@@ -0,0 +1,76 @@
+/*
+	Sample.h
+	
+	Text data sent by the tests in
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Encoding.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	MapReadOnlyFile
+	Memory-map the whole of the given file for reading, faulting it in first if 'populate'; an
+	empty file gives a NULL view
+	Return whether the call failed
+*/
+extern bool MapReadOnlyFile(const char path[], bool populate, const char **view, size_t *length);
+
+
+/*	UnmapReadOnlyFile
+	Release a mapping made by MapReadOnlyFile()
+*/
+extern void UnmapReadOnlyFile(const char *view, size_t length);
+
+
+/*	OpenSampleFile
+	Memory-map the given file as the narrow form of a sample
+	Return whether the call failed
+*/
+extern bool OpenSampleFile(struct Sample*, const char path[]);
+
+
+/*	DecodeSampleWide
+	Provide the wide form of a sample read from a file, by decoding it once as UTF-8
+	Return whether the call failed
+*/
+extern bool DecodeSampleWide(struct Sample*);
+
+
+/*	DecodeSampleUnits
+	Provide the char16 or char32 form of a sample read from a file (by code unit width, 2 or
+	4), by decoding it once as UTF-8; its char8 form is the file itself
+	Return whether the call failed
+*/
+extern bool DecodeSampleUnits(struct Sample*, size_t width);
+
+
+/*	CloseSample
+	Release whatever a sample read from a file holds
+*/
+extern void CloseSample(struct Sample*);
+
+
+#ifdef __cplusplus
+	}
+#endif
@@ -0,0 +1,421 @@
+/*
+	Startup
+	
+	Process startup and first-write latency harness for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	Each run is a new invocation of this program with its standard output going to a pipe that
+	the harness reads, so that the time to the first byte is what a program reading its output
+	would see.  The monotonic clock is shared between processes; the process hands back the
+	times at which its main() was entered and its writes began over a second pipe, which divide
+	the time to the first byte into
+	
+	* init: loading the program and its libraries, and the C library's and the C++ library's
+	  static initialization (std::ios_base::Init) up to main()
+	* setup: parsing the arguments, preparing the sample, setting the locale and opening the
+	  output (which for the C++ methods constructs the std::locale that the stream is imbued
+	  with)
+	* write: from the first write call until its first byte reaches the pipe
+	
+	and the lifetime runs on until the process has exited and been reaped.  The first run of
+	each combination is reported as the cold one, the median of the others as warm; the page
+	cache isn't dropped in between, so 'cold' is only the first run of that combination, and
+	only the very first run of all may have loaded the program from storage.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+#endif
+
+#include "Encoding.h"
+#include "Startup.h"
+
+
+
+/*	kStartupVariable
+	Environment variable that tells a process started by the harness which file descriptor
+	to report its times on
+*/
+static const char kStartupVariable[] = "ENCEXP_STARTUP";
+
+
+/*	kStartupDescriptor
+	File descriptor that the process finds the report pipe at
+*/
+enum { kStartupDescriptor = 3 };
+
+
+/*	kStartupDefaultRuns
+	Number of times each combination is run when not given
+*/
+enum { kStartupDefaultRuns = 10 };
+
+
+/*	Phase
+	Part of a run that is timed
+*/
+enum Phase {
+	kPhaseInit,				// from spawning to main()
+	kPhaseSetup,				// from main() to the first write
+	kPhaseWrite,				// from the first write to its first byte at the pipe
+	kPhaseFirst,				// from spawning to the first byte
+	kPhaseLifetime,				// from spawning to having reaped the process
+	kPhases
+	};
+
+
+/*	ReportStartup
+	Write the times to the descriptor named by the environment variable
+*/
+void ReportStartup(
+	double		entered,
+	double		writing,
+	double		finished
+	)
+{
+if (!getenv(kStartupVariable)) return;
+
+#ifdef _WIN32
+/* the harness doesn't run on Windows */
+(void) entered, (void) writing, (void) finished;
+
+#else
+char line[96];
+const int length = snprintf(line, sizeof line, "%.9f %.9f %.9f\n", entered, writing, finished);
+if (write(atoi(getenv(kStartupVariable)), line, length) != length)
+	fprintf(stderr, "warning: can't report startup times\n");
+#endif
+}
+
+
+#ifndef _WIN32
+/*	RunOnce
+	Run the program once with the given arguments, timing each Phase in seconds (negative
+	where it couldn't be timed)
+	Return whether the call failed
+*/
+static bool RunOnce(
+	const char	*program,
+	const char *const arguments[],
+	double		times[kPhases],
+	int		*status
+	)
+{
+int output[2], report[2];
+if (pipe(output) == -1) {
+	fprintf(stderr, "error: can't create pipe\n");
+	return true;
+	}
+
+if (pipe(report) == -1) {
+	fprintf(stderr, "error: can't create pipe\n");
+	close(output[0]);
+	close(output[1]);
+	return true;
+	}
+
+/* The read ends are closed first, since the report pipe may be duplicated onto one of them */
+posix_spawn_file_actions_t actions;
+posix_spawn_file_actions_init(&actions);
+posix_spawn_file_actions_addclose(&actions, output[0]);
+posix_spawn_file_actions_addclose(&actions, report[0]);
+posix_spawn_file_actions_adddup2(&actions, output[1], 1);
+if (output[1] != 1) posix_spawn_file_actions_addclose(&actions, output[1]);
+posix_spawn_file_actions_adddup2(&actions, report[1], kStartupDescriptor);
+if (report[1] != kStartupDescriptor) posix_spawn_file_actions_addclose(&actions, report[1]);
+posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+
+const double spawned = Now();
+pid_t process;
+const bool failed = posix_spawnp(&process, program, &actions, NULL, (char *const*) arguments, environ) != 0;
+
+posix_spawn_file_actions_destroy(&actions);
+close(output[1]);
+close(report[1]);
+
+if (failed) {
+	fprintf(stderr, "error: can't start process\n");
+	close(output[0]);
+	close(report[0]);
+	return true;
+	}
+
+// the first byte, and then the rest of the output
+for (int phase = 0; phase < kPhases; phase++) times[phase] = -1;
+
+char buffer[4096];
+for (ssize_t n; (n = read(output[0], buffer, sizeof buffer)) != 0;)
+	if (n > 0) {
+		if (times[kPhaseFirst] < 0) times[kPhaseFirst] = Now() - spawned;
+		}
+	
+	else if (errno != EINTR)
+		break;
+
+int waited;
+while (waitpid(process, &waited, 0) == -1)
+	if (errno != EINTR) {
+		fprintf(stderr, "error: can't wait for process\n");
+		close(output[0]);
+		close(report[0]);
+		return true;
+		}
+
+times[kPhaseLifetime] = Now() - spawned;
+*status = WIFEXITED(waited) ? WEXITSTATUS(waited) : -1;
+
+// when main() was entered and the writes began, if the process got that far
+/* The pipe holds the line until it is read, now that the process is gone */
+char line[128];
+const ssize_t length = read(report[0], line, sizeof line - 1);
+double entered, writing, finished;
+if (length > 0 && (line[length] = '\0', sscanf(line, "%lf %lf %lf", &entered, &writing, &finished) == 3)) {
+	times[kPhaseInit] = entered - spawned;
+	times[kPhaseSetup] = writing - entered;
+	if (times[kPhaseFirst] >= 0) times[kPhaseWrite] = spawned + times[kPhaseFirst] - writing;
+	}
+
+close(output[0]);
+close(report[0]);
+
+return false;
+}
+
+
+/*	CompareTimes
+	qsort() comparison of two times
+*/
+static int CompareTimes(
+	const void	*a,
+	const void	*b
+	)
+{
+const double x = *(const double*) a, y = *(const double*) b;
+
+return (x > y) - (x < y);
+}
+
+
+/*	GetMedian
+	Median of the times that were taken (not negative), sorting them in place
+	Return negative if there are none
+*/
+static double GetMedian(
+	double		times[],
+	size_t		count
+	)
+{
+qsort(times, count, sizeof *times, CompareTimes);
+
+// skip the ones that weren't taken
+size_t skipped = 0;
+while (skipped < count && times[skipped] < 0) skipped++;
+if (skipped == count) return -1;
+
+times += skipped;
+count -= skipped;
+
+return count % 2 ? times[count / 2] : (times[count / 2 - 1] + times[count / 2]) / 2;
+}
+
+
+/*	PrintTimes
+	Print a row's worth of Phase times in milliseconds
+*/
+static void PrintTimes(
+	const double	times[kPhases]
+	)
+{
+for (int phase = 0; phase < kPhases; phase++)
+	if (times[phase] >= 0)
+		printf(" %7.2f", times[phase] * 1e3);
+	
+	else
+		printf(" %7s", "-");
+}
+#endif
+
+
+/*	RunStartup
+	Run each combination the given number of times, one process after another
+*/
+bool RunStartup(
+	const char	*argv0,
+	const char *const methods[],
+	size_t		methodCount,
+	const char *const modes[],
+	size_t		modeCount,
+	bool		(*supported)(size_t method, size_t mode, const char *locale),
+	int		argc,
+	const char	*argv[]
+	)
+{
+#ifdef _WIN32
+(void) argv0, (void) methods, (void) methodCount, (void) modes, (void) modeCount, (void) supported, (void) argc, (void) argv;
+fprintf(stderr, "error: startup is only available on POSIX systems\n");
+return true;
+
+#else
+/* argv[0] needn't be a path at all */
+const char *const program = access("/proc/self/exe", X_OK) == 0 ? "/proc/self/exe" : argv0;
+unsigned long runs = kStartupDefaultRuns;
+
+// harness options; pass everything else on to the processes
+const char **const arguments = calloc(argc + 4, sizeof *arguments);
+if (!arguments) {
+	fprintf(stderr, "error: can't allocate arguments\n");
+	return true;
+	}
+
+size_t passedCount = 0;
+for (int i = 0; i < argc; i++) {
+	const char *const arg = argv[i];
+	
+	// number of runs?
+	if (strncmp(arg, "runs=", 5) == 0) {
+		if ((runs = strtoul(arg + 5, NULL, 10)) == 0) {
+			fprintf(stderr, "warning: option runs=#### needs a number of runs\n");
+			runs = kStartupDefaultRuns;
+			}
+		}
+	
+	// the output has to go to the pipe
+	else if (strcmp(arg, "file") == 0 || strcmp(arg, "pty") == 0)
+		fprintf(stderr, "warning: startup writes to a pipe; ignoring \"%s\"\n", arg);
+	
+	/* the interposer's seccomp filter can't be removed, and would be inherited by every run */
+	else if (strcmp(arg, "syscalls") == 0) {
+		fprintf(stderr, "error: 'syscalls' can't be combined with 'startup'; count one combination at a time\n");
+		free(arguments);
+		return true;
+		}
+	
+	else
+		arguments[3 + passedCount++] = arg;
+	}
+
+double *const warm = calloc(runs, sizeof *warm * kPhases);
+if (!warm) {
+	fprintf(stderr, "error: can't allocate times\n");
+	free(arguments);
+	return true;
+	}
+
+// the processes find the report pipe here
+char descriptor[16];
+snprintf(descriptor, sizeof descriptor, "%d", kStartupDescriptor);
+setenv(kStartupVariable, descriptor, 1);
+
+// a locale among the options (l####, as main() takes it) decides which combinations can run
+const char *locale = NULL;
+for (size_t i = 0; i < passedCount; i++)
+	if (arguments[3 + i][0] == 'l' && strncmp(arguments[3 + i], "latency", 7) != 0) locale = arguments[3 + i] + 1;
+
+size_t applicable = 0;
+for (size_t method = 0; method < methodCount; method++)
+	for (size_t mode = 0; mode < modeCount; mode++)
+		applicable += supported(method, mode, locale);
+
+fprintf(stderr, "info: running %zu combinations %lu times each\n", applicable, runs);
+
+printf("# ms from starting the process: init (to main), setup (locale and output, to the first write), write (to the first byte)\n");
+printf("# and the first byte in all, and exit; warm is the median of the other %lu runs, and cold just the first run of each\n", runs - 1);
+printf("# combination: the page cache isn't dropped, so only the first combination may load the program from storage\n");
+printf("%-19s %-12s %-6s %39s %39s\n", "", "", "", "cold", "warm");
+printf("%-19s %-12s %-6s", "method", "mode", "result");
+for (int run = 0; run < 2; run++) printf(" %7s %7s %7s %7s %7s", "init", "setup", "write", "first", "exit");
+printf("\n");
+
+arguments[0] = program;
+size_t passed = 0;
+bool failed = false;
+for (size_t method = 0; !failed && method < methodCount; method++)
+	for (size_t mode = 0; !failed && mode < modeCount; mode++) {
+		// can't run here at all?
+		if (!supported(method, mode, locale)) {
+			printf("%-19s %-12s %-6s\n", methods[method], modes[mode], "n/a");
+			continue;
+			}
+		
+		arguments[1] = methods[method];
+		arguments[2] = modes[mode];
+		arguments[3 + passedCount] = NULL;
+		
+		double cold[kPhases];
+		int result = 0;
+		for (unsigned long run = 0; run < runs; run++) {
+			double times[kPhases];
+			int status;
+			if ((failed = RunOnce(program, arguments, times, &status))) break;
+			
+			if (status && !result) result = status;
+			
+			if (run == 0)
+				memcpy(cold, times, sizeof cold);
+			
+			else
+				for (int phase = 0; phase < kPhases; phase++) warm[phase * runs + run - 1] = times[phase];
+			}
+		
+		if (failed) break;
+		
+		char outcome[8] = "ok";
+		if (result) snprintf(outcome, sizeof outcome, "%d", result);
+		else passed++;
+		
+		printf("%-19s %-12s %-6s", methods[method], modes[mode], outcome);
+		PrintTimes(cold);
+		
+		double median[kPhases];
+		for (int phase = 0; phase < kPhases; phase++)
+			median[phase] = runs > 1 ? GetMedian(warm + phase * runs, runs - 1) : -1;
+		PrintTimes(median);
+		
+		printf("\n");
+		fflush(stdout);
+		}
+
+if (!failed) {
+	printf("%zu of %zu passed", passed, applicable);
+	if (applicable < methodCount * modeCount) printf(" (%zu not applicable here)", methodCount * modeCount - applicable);
+	printf("\n");
+	}
+
+unsetenv(kStartupVariable);
+free(warm);
+free(arguments);
+
+return failed || passed < applicable;
+#endif
+}
@@ -0,0 +1,52 @@
+/*
+	Startup.h
+	
+	Process startup and first-write latency harness for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	RunStartup
+	Run every combination of the given Method and Mode names with the other options in 'argv'
+	repeatedly, each time as a new process writing to a pipe, and print how long it took to
+	start, to set up, to get the first byte out and to exit; a combination that 'supported'
+	rejects, as for RunMatrix(), isn't run and is listed as not applicable
+	Return whether the call failed, or any combination that ran did
+*/
+extern bool RunStartup(const char *argv0, const char *const methods[], size_t methodCount, const char *const modes[], size_t modeCount, bool (*supported)(size_t method, size_t mode, const char *locale), int argc, const char *argv[]);
+
+
+/*	ReportStartup
+	Hand the times at which main() was entered, the writes began and the test finished to the
+	harness that started this process, if one did
+*/
+extern void ReportStartup(double entered, double writing, double finished);
+
+
+#ifdef __cplusplus
+	}
+#endif
@@ -0,0 +1,146 @@
+/*
+	Syscalls
+	
+	Output system call accounting for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+#include "Syscalls.h"
+
+
+
+/*	gGetSyscallCounts, gResetSyscallCounts
+	The interposer's functions, once found
+*/
+static GetSyscallCountsFunction *gGetSyscallCounts;
+static ResetSyscallCountsFunction *gResetSyscallCounts;
+
+
+/*	gTakenSyscallCounts
+	What TakeSyscallCounts() found on each file descriptor
+*/
+static struct SyscallCounts gTakenSyscallCounts[kSyscallFdLimit];
+
+
+/*	OpenSyscallCounts
+	Find the interposer's functions among those already loaded
+*/
+bool OpenSyscallCounts(void)
+{
+#ifndef _WIN32
+gGetSyscallCounts = (GetSyscallCountsFunction*) dlsym(RTLD_DEFAULT, kGetSyscallCountsName);
+gResetSyscallCounts = (ResetSyscallCountsFunction*) dlsym(RTLD_DEFAULT, kResetSyscallCountsName);
+if (gGetSyscallCounts && gResetSyscallCounts) return false;
+
+fprintf(stderr, "warning: system calls are only counted with the interposer preloaded (LD_PRELOAD=libencexp-syscalls.so)\n");
+
+#else
+fprintf(stderr, "warning: system calls can't be counted on this platform\n");
+#endif
+
+return true;
+}
+
+
+/*	ResetSyscallCounts
+	Start counting from zero
+*/
+void ResetSyscallCounts(void)
+{
+if (gResetSyscallCounts) gResetSyscallCounts();
+}
+
+
+/*	TakeSyscallCounts
+	Copy what has been counted on each file descriptor
+*/
+void TakeSyscallCounts(void)
+{
+if (!gGetSyscallCounts) return;
+
+for (int fd = 0; fd < kSyscallFdLimit; fd++) gTakenSyscallCounts[fd] = *gGetSyscallCounts(fd);
+}
+
+
+/*	PrintSizeClass
+	Print the range of sizes of a histogram class
+*/
+static void PrintSizeClass(
+	unsigned	sizeClass
+	)
+{
+if (sizeClass == 0)
+	fprintf(stderr, "0");
+
+else if (sizeClass == kSyscallSizeBuckets - 1)
+	fprintf(stderr, "%llu+", 1ull << (sizeClass - 1));
+
+else
+	fprintf(stderr, "%llu-%llu", 1ull << (sizeClass - 1), (1ull << sizeClass) - 1);
+}
+
+
+/*	ReportSyscallCounts
+	Print what was taken on each file descriptor
+*/
+void ReportSyscallCounts(
+	const char	*method,
+	const char	*mode,
+	unsigned long long lines
+	)
+{
+if (!gGetSyscallCounts) return;
+
+for (int fd = 0; fd < kSyscallFdLimit; fd++) {
+	const struct SyscallCounts *const counts = &gTakenSyscallCounts[fd];
+	if (!counts->writes && !counts->writevs && !counts->fsyncs && !counts->fdatasyncs) continue;
+	
+	fprintf(stderr,
+		"syscalls: %s %s: fd %d: %llu write (%llu bytes), %llu writev (%llu bytes), %llu fsync, %llu fdatasync\n",
+		method, mode, fd,
+		counts->writes, counts->writeBytes, counts->writevs, counts->writevBytes, counts->fsyncs, counts->fdatasyncs
+		);
+	
+	// histogram of the write sizes
+	if (counts->writes || counts->writevs) {
+		fprintf(stderr, "syscalls: %s %s: fd %d: sizes", method, mode, fd);
+		
+		for (unsigned sizeClass = 0; sizeClass < kSyscallSizeBuckets; sizeClass++)
+			if (counts->sizes[sizeClass]) {
+				fprintf(stderr, " ");
+				PrintSizeClass(sizeClass);
+				fprintf(stderr, ": %llu", counts->sizes[sizeClass]);
+				}
+		
+		fprintf(stderr, "\n");
+		}
+	
+	/* a write per line is how line buffering (or flushing at every newline) shows */
+	if (lines > 1 && counts->writes + counts->writevs >= lines)
+		fprintf(stderr, "warning: fd %d was written a line at a time (%llu writes for %llu lines)\n", fd, counts->writes + counts->writevs, lines);
+	}
+}
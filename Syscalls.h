@@ -0,0 +1,100 @@
+/*
+	Syscalls.h
+	
+	Output system call accounting for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	The counting is done by the interposer library (Interposer.c), preloaded into the program
+	with LD_PRELOAD; the program finds the library's functions at run time, so that it runs
+	the same without it.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	kSyscallFdLimit
+	File descriptors below this are counted individually; the rest are not counted
+*/
+enum { kSyscallFdLimit = 1024 };
+
+
+/*	kSyscallSizeBuckets
+	Number of size classes in the histogram: zero bytes, then [2^(n-1), 2^n) bytes in class n,
+	with the last class holding everything larger
+*/
+enum { kSyscallSizeBuckets = 32 };
+
+
+/*	SyscallCounts
+	Calls made on one file descriptor, and the bytes they wrote
+*/
+struct SyscallCounts {
+	unsigned long long writes, writeBytes;
+	unsigned long long writevs, writevBytes;
+	unsigned long long fsyncs, fdatasyncs;
+	unsigned long long sizes[kSyscallSizeBuckets];	// writes and writevs by size class
+	};
+
+
+/*	GetSyscallCountsFunction, ResetSyscallCountsFunction
+	Functions that the interposer exports, by the names given
+*/
+#define kGetSyscallCountsName "EncexpGetSyscallCounts"
+#define kResetSyscallCountsName "EncexpResetSyscallCounts"
+typedef const struct SyscallCounts *GetSyscallCountsFunction(int fd);
+typedef void ResetSyscallCountsFunction(void);
+
+
+/*	OpenSyscallCounts
+	Find the interposer
+	Return whether it isn't loaded (having said how to load it)
+*/
+extern bool OpenSyscallCounts(void);
+
+
+/*	ResetSyscallCounts
+	Start counting from zero
+*/
+extern void ResetSyscallCounts(void);
+
+
+/*	TakeSyscallCounts
+	Keep what has been counted since the reset, so that what is written after it (such as the
+	other reports, on standard error) isn't reported
+*/
+extern void TakeSyscallCounts(void);
+
+
+/*	ReportSyscallCounts
+	Print to standard error what was counted on each file descriptor between the reset and
+	TakeSyscallCounts(), and warn about one that was written a line at a time, given the
+	number of lines handed to the method
+*/
+extern void ReportSyscallCounts(const char *method, const char *mode, unsigned long long lines);
+
+
+#ifdef __cplusplus
+	}
+#endif
@@ -0,0 +1,247 @@
+/*
+	Terminal
+	
+	Pseudo-terminal output target for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	This is as near as POSIX comes to the Windows console: the method writes to standard output
+	as it would to a terminal (so that stdio, for one, line-buffers it), and a thread reads the
+	other end as a terminal emulator would.  Output processing is turned off, so that the bytes
+	read are the bytes written (rather than having each LF become CR LF).
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#endif
+
+#include "Encoding.h"
+#include "Terminal.h"
+
+
+
+#ifndef _WIN32
+
+/*	kTerminalReadSize
+	Most bytes taken from the terminal at once
+*/
+enum { kTerminalReadSize = 64 << 10 };
+
+
+/*	Drain
+	Read the master side until there is no slave side left
+*/
+static void *Drain(
+	void		*argument
+	)
+{
+struct Terminal *const terminal = argument;
+
+char *const buffer = malloc(kTerminalReadSize);
+if (!buffer) {
+	fprintf(stderr, "error: can't allocate terminal buffer\n");
+	terminal->failed = true;
+	return NULL;
+	}
+
+for (;;) {
+	const ssize_t received = read(terminal->master, buffer, kTerminalReadSize);
+	
+	/* Linux reports EIO once the last of the slave side is closed */
+	if (received == 0 || (received == -1 && errno == EIO)) break;
+	
+	if (received == -1) {
+		if (errno == EINTR) continue;
+		
+		fprintf(stderr, "error: can't read terminal (%s)\n", strerror(errno));
+		terminal->failed = true;
+		break;
+		}
+	
+	terminal->last = Now();
+	terminal->bytes += received;
+	terminal->reads++;
+	
+	if (terminal->capture != -1 && write(terminal->capture, buffer, received) != received) {
+		fprintf(stderr, "error: can't write terminal capture\n");
+		terminal->failed = true;
+		}
+	}
+
+free(buffer);
+
+return NULL;
+}
+
+
+/*	OpenTerminal
+	Attach standard output to a new pseudo-terminal
+*/
+bool OpenTerminal(
+	struct Terminal	*terminal,
+	const char	*capturePath
+	)
+{
+*terminal = (struct Terminal) { -1, -1, -1, -1, NULL, 0, 0, 0, false };
+
+// allocate the pair
+const char *slaveName;
+if (
+	(terminal->master = posix_openpt(O_RDWR | O_NOCTTY)) == -1 ||
+	grantpt(terminal->master) != 0 ||
+	unlockpt(terminal->master) != 0 ||
+	!(slaveName = ptsname(terminal->master)) ||
+	(terminal->slave = open(slaveName, O_WRONLY | O_NOCTTY)) == -1
+	) {
+	fprintf(stderr, "error: can't allocate pseudo-terminal (%s)\n", strerror(errno));
+	if (terminal->master != -1) close(terminal->master);
+	return true;
+	}
+
+// pass bytes through unchanged
+struct termios attributes;
+if (tcgetattr(terminal->slave, &attributes) == 0) {
+	attributes.c_oflag &= ~OPOST;
+	tcsetattr(terminal->slave, TCSANOW, &attributes);
+	}
+
+if (capturePath && (terminal->capture = open(capturePath, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+	fprintf(stderr, "error: can't open \"%s\" for the terminal capture\n", capturePath);
+	close(terminal->slave);
+	close(terminal->master);
+	return true;
+	}
+
+// start reading before anything is written, or the writer would soon block
+pthread_t *const thread = malloc(sizeof *thread);
+if (!thread || pthread_create(thread, NULL, Drain, terminal) != 0) {
+	fprintf(stderr, "error: can't start terminal thread\n");
+	free(thread);
+	if (terminal->capture != -1) close(terminal->capture);
+	close(terminal->slave);
+	close(terminal->master);
+	return true;
+	}
+terminal->drain = thread;
+
+// attach standard output
+fflush(stdout);
+if ((terminal->savedOutput = dup(STDOUT_FILENO)) == -1 || dup2(terminal->slave, STDOUT_FILENO) == -1) {
+	fprintf(stderr, "error: can't attach standard output to the terminal\n");
+	CloseTerminal(terminal);
+	return true;
+	}
+
+return false;
+}
+
+
+/*	CloseTerminal
+	Detach standard output, and wait for the rest to be read
+*/
+bool CloseTerminal(
+	struct Terminal	*terminal
+	)
+{
+// whatever stdio still holds goes to the terminal first
+fflush(stdout);
+
+if (terminal->savedOutput != -1) {
+	dup2(terminal->savedOutput, STDOUT_FILENO);
+	close(terminal->savedOutput);
+	}
+
+// with the slave side closed, the thread reads what is left and then stops
+close(terminal->slave);
+if (terminal->drain) {
+	pthread_join(*(pthread_t*) terminal->drain, NULL);
+	free(terminal->drain);
+	}
+
+close(terminal->master);
+if (terminal->capture != -1) close(terminal->capture);
+
+return terminal->failed;
+}
+
+
+#else
+
+/*	OpenTerminal
+	Windows has the console instead
+*/
+bool OpenTerminal(
+	struct Terminal	*terminal,
+	const char	*capturePath
+	)
+{
+fprintf(stderr, "error: there are no pseudo-terminals on this platform; write to the console instead\n");
+
+return true;
+}
+
+
+/*	CloseTerminal
+	There is nothing to close
+*/
+bool CloseTerminal(
+	struct Terminal	*terminal
+	)
+{
+return true;
+}
+
+#endif
+
+
+/*	ReportTerminal
+	Print what the terminal received
+*/
+void ReportTerminal(
+	const struct Terminal *terminal,
+	const char	*method,
+	const char	*mode,
+	double		start,
+	double		finished
+	)
+{
+const double elapsed = terminal->last - start;
+
+fprintf(stderr, "pty: %s %s: %llu bytes received in %llu reads (%.0f bytes per read)",
+	method, mode, terminal->bytes, terminal->reads, terminal->reads ? (double) terminal->bytes / terminal->reads : 0.);
+
+if (terminal->bytes && elapsed > 0)
+	fprintf(stderr, " in %.3f s: %.1f MB/s, the last %.1f us after the write finished",
+		elapsed, terminal->bytes / elapsed / 1e6, terminal->last > finished ? (terminal->last - finished) * 1e6 : 0.);
+
+fprintf(stderr, "\n");
+}
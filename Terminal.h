@@ -0,0 +1,72 @@
+/*
+	Terminal.h
+	
+	Pseudo-terminal output target for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	Terminal
+	Pseudo-terminal that standard output is attached to, and what was read from it
+*/
+struct Terminal {
+	int		master, slave;
+	int		savedOutput;		// standard output before
+	int		capture;		// file the received bytes go into, or -1
+	void		*drain;			// thread reading the master
+	
+	// kept by the thread
+	unsigned long long bytes, reads;
+	double		last;			// time of the last read
+	bool		failed;
+	};
+
+
+/*	OpenTerminal
+	Allocate a pseudo-terminal that passes bytes through unchanged, start a thread reading
+	everything written to it (into the named file, if not NULL), and attach standard output to it
+	Return whether the call failed
+*/
+extern bool OpenTerminal(struct Terminal*, const char *capturePath);
+
+
+/*	CloseTerminal
+	Put standard output back, and wait for the thread to read whatever is still in the terminal
+	Return whether the call failed, or the thread did
+*/
+extern bool CloseTerminal(struct Terminal*);
+
+
+/*	ReportTerminal
+	Print to standard error what the terminal received, and how long after the write began
+	('start') and ended ('finished') it had all been read
+*/
+extern void ReportTerminal(const struct Terminal*, const char *method, const char *mode, double start, double finished);
+
+
+#ifdef __cplusplus
+	}
+#endif
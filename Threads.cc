@@ -0,0 +1,726 @@
+/*
+	Threads
+	
+	Multi-threaded shared output benchmark for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	Each thread writes its share of the messages (one message being one write of the sample,
+	already encoded as the Mode writes it, so that only the sharing is measured) to the same
+	output, in one of four ways, and with the C++ methods a fifth:
+	
+	* fwrite: straight to the shared FILE, each call taking its lock (or with fprintf())
+	* ostream: straight to a shared std::ofstream, under a lock taken for each write, so that
+	  every write also pays for the stream's sentry, as a program writing to one stream from
+	  several threads would
+	* unlocked: into a buffer of the thread's own, which goes to the FILE a buffer at a time
+	  with fwrite_unlocked() under flockfile()
+	* syncstream: to a shared std::ofstream, a message at a time through a buffer that hands it
+	  over whole under a lock when it is destroyed, as C++20's std::osyncstream does
+	* merged: into buffers of the thread's own, handed over a queue to one more thread that is
+	  the only one to write to the FILE
+	
+	The time a thread spends waiting for a lock that another holds (and with 'merged', for room
+	in the queue) is added up, and reported as a share of all the threads' time.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Threads.h"
+#include "Transcode.h"
+
+
+
+/*	kThreadBuffer
+	Size of each thread's own buffer when no buffer size is given
+*/
+enum { kThreadBuffer = 64 << 10 };
+
+
+/*	Result
+	Outcome of one strategy at one number of threads
+*/
+struct Result {
+	double		elapsed;
+	double		wait;			// summed over the threads
+	};
+
+
+/*	Strategy
+	Way of sharing the output between the threads
+*/
+enum Strategy {
+	kStrategyFwrite,
+	kStrategyOstream,
+	kStrategyUnlocked,
+	kStrategySyncstream,
+	kStrategyMerged,
+	kStrategies
+	};
+
+
+/*	gStrategyNames
+	Table column name of each Strategy
+*/
+static const char *const gStrategyNames[] = {
+	"fwrite",
+	"ostream",
+	"unlocked",
+	"syncstream",
+	"merged"
+	};
+
+
+/*	Work
+	What every thread is given to do
+*/
+struct Work {
+	const std::string &message;
+	unsigned long long messages;		// all threads together
+	bool		isMethodFormatted;
+	bool		isMethodCPlusPlus;
+	size_t		buffer;			// size of each thread's own buffer
+	
+	/*	GetCount
+		Number of messages that the given one of the threads writes
+	*/
+	unsigned long long GetCount(unsigned int thread, unsigned int threads) const
+		{ return messages / threads + (thread < messages % threads); }
+	};
+
+
+/*	LockFile, UnlockFile
+	Take the FILE's lock, adding the time spent waiting for it to 'wait' if another thread held
+	it; and release it
+*/
+static void LockFile(
+	FILE		*file,
+	double		&wait
+	)
+{
+#ifdef _WIN32
+/* There is no way to try the lock first, so this counts taking it even when it is free */
+const double start = Now();
+_lock_file(file);
+wait += Now() - start;
+
+#else
+if (ftrylockfile(file) != 0) {
+	const double start = Now();
+	flockfile(file);
+	wait += Now() - start;
+	}
+#endif
+}
+
+static void UnlockFile(
+	FILE		*file
+	)
+{
+#ifdef _WIN32
+_unlock_file(file);
+#else
+funlockfile(file);
+#endif
+}
+
+
+/*	WriteUnlocked
+	fwrite() for a caller that holds the FILE's lock already
+	Return whether the call failed
+*/
+static bool WriteUnlocked(
+	const std::string &buffer,
+	FILE		*file
+	)
+{
+#if defined(_WIN32)
+return _fwrite_nolock(buffer.data(), 1, buffer.size(), file) != buffer.size();
+#elif defined(__GLIBC__)
+return fwrite_unlocked(buffer.data(), 1, buffer.size(), file) != buffer.size();
+#else
+/* elsewhere fwrite() takes the lock again, recursively */
+return fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size();
+#endif
+}
+
+
+/*	Lock
+	Take the mutex, adding the time spent waiting for it to 'wait' if another thread held it
+*/
+static std::unique_lock<std::mutex> Lock(
+	std::mutex	&mutex,
+	double		&wait
+	)
+{
+std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+if (!lock.owns_lock()) {
+	const double start = Now();
+	lock.lock();
+	wait += Now() - start;
+	}
+
+return lock;
+}
+
+
+/*	RunThreads
+	Run the given function on that many threads at once, until the last of them finishes
+*/
+template <typename Function>
+static void RunThreads(
+	unsigned int	threads,
+	Function	function
+	)
+{
+std::vector<std::thread> pool;
+pool.reserve(threads);
+
+for (unsigned int thread = 0; thread < threads; thread++)
+	pool.emplace_back(function, thread);
+for (std::thread &thread : pool)
+	thread.join();
+}
+
+
+/*	SharedFile
+	Output file opened for all the threads to share, with the given buffering
+*/
+class SharedFile {
+public:
+	SharedFile(const Buffering &buffering)
+		{
+		if (!(file = fopen(gFileName, "wb"))) throw "can't open file for output";
+		if (SetCBuffering(file, &buffering)) { fclose(file); throw "can't apply buffering to output file"; }
+		}
+	
+	~SharedFile() { fclose(file); }
+	
+	/*	Flush
+		Write out the FILE's buffer, and find whether any write failed
+		*/
+	void Flush() { if (fflush(file) != 0 || ferror(file)) throw "unable to write entire output"; }
+	
+	FILE		*file;
+	};
+
+
+/*	TestFwrite
+	Every thread writes each message to the shared FILE
+*/
+static Result TestFwrite(
+	const Work	&work,
+	unsigned int	threads,
+	const Buffering	&buffering
+	)
+{
+SharedFile shared(buffering);
+std::vector<double> waits(threads);
+std::vector<char> failures(threads);
+
+const double start = Now();
+RunThreads(threads, [&](unsigned int thread) {
+	double wait = 0;
+	bool failed = false;
+	
+	/* The lock is taken here only to time the wait for it; fwrite() takes it again,
+	   recursively, which costs little next to the first time */
+	for (unsigned long long count = work.GetCount(thread, threads); count && !failed; count--) {
+		LockFile(shared.file, wait);
+		if (!work.isMethodFormatted)
+			failed = fwrite(work.message.data(), 1, work.message.size(), shared.file) != work.message.size();
+		
+		else
+			failed = fprintf(shared.file, "%.*s", (int) work.message.size(), work.message.data()) < 0;
+		UnlockFile(shared.file);
+		}
+	
+	waits[thread] = wait;
+	failures[thread] = failed;
+	});
+
+shared.Flush();
+
+Result result;
+result.elapsed = Now() - start;
+
+for (char failed : failures)
+	if (failed) throw "unable to write entire output";
+
+result.wait = 0;
+for (double wait : waits) result.wait += wait;
+
+return result;
+}
+
+
+/*	TestOstream
+	Every thread writes each message to the shared stream, under a lock of its own since the
+	stream doesn't take one
+*/
+static Result TestOstream(
+	const Work	&work,
+	unsigned int	threads
+	)
+{
+std::ofstream shared(gFileName, std::ios::binary);
+if (!shared.is_open()) throw "can't open file for output";
+
+std::mutex mutex;
+std::vector<double> waits(threads);
+
+const double start = Now();
+RunThreads(threads, [&](unsigned int thread) {
+	double wait = 0;
+	
+	for (unsigned long long count = work.GetCount(thread, threads); count; count--) {
+		std::unique_lock<std::mutex> lock = Lock(mutex, wait);
+		if (!shared) break;
+		
+		if (!work.isMethodFormatted)
+			shared.write(work.message.data(), work.message.size());
+		
+		else
+			shared << work.message;
+		}
+	
+	waits[thread] = wait;
+	});
+
+shared.flush();
+
+Result result;
+result.elapsed = Now() - start;
+
+if (shared.fail()) throw "output stream has failed";
+
+result.wait = 0;
+for (double wait : waits) result.wait += wait;
+
+return result;
+}
+
+
+/*	TestUnlocked
+	Every thread collects messages in a buffer of its own, and writes it to the shared FILE
+	under its lock when it is full
+*/
+static Result TestUnlocked(
+	const Work	&work,
+	unsigned int	threads,
+	const Buffering	&buffering
+	)
+{
+SharedFile shared(buffering);
+std::vector<double> waits(threads);
+std::vector<char> failures(threads);
+
+const double start = Now();
+RunThreads(threads, [&](unsigned int thread) {
+	double wait = 0;
+	bool failed = false;
+	
+	std::string buffer;
+	buffer.reserve(work.buffer);
+	
+	const auto flush = [&]() {
+		LockFile(shared.file, wait);
+		failed |= WriteUnlocked(buffer, shared.file);
+		UnlockFile(shared.file);
+		buffer.clear();
+		};
+	
+	for (unsigned long long count = work.GetCount(thread, threads); count; count--) {
+		if (!buffer.empty() && buffer.size() + work.message.size() > work.buffer) flush();
+		buffer += work.message;
+		}
+	
+	if (!buffer.empty()) flush();
+	
+	waits[thread] = wait;
+	failures[thread] = failed;
+	});
+
+shared.Flush();
+
+Result result;
+result.elapsed = Now() - start;
+
+for (char failed : failures)
+	if (failed) throw "unable to write entire output";
+
+result.wait = 0;
+for (double wait : waits) result.wait += wait;
+
+return result;
+}
+
+
+/*	SyncBuffer
+	Stand-in for C++20's std::syncbuf: collects what is written to it, and hands it to the
+	wrapped stream buffer in one piece, under the lock that goes with that buffer, when it is
+	destroyed
+*/
+class SyncBuffer : public std::streambuf {
+public:
+	SyncBuffer(std::streambuf &wrapped, std::mutex &mutex, double &wait, bool &failed) :
+		wrapped(wrapped), mutex(mutex), wait(wait), failed(failed) {}
+	
+	~SyncBuffer() override
+		{
+		std::unique_lock<std::mutex> lock = Lock(mutex, wait);
+		failed |= wrapped.sputn(pending.data(), pending.size()) != (std::streamsize) pending.size();
+		}
+
+protected:
+	int_type overflow(int_type c) override
+		{
+		if (!traits_type::eq_int_type(c, traits_type::eof())) pending += traits_type::to_char_type(c);
+		return traits_type::not_eof(c);
+		}
+	
+	std::streamsize xsputn(const char *characters, std::streamsize count) override
+		{
+		pending.append(characters, count);
+		return count;
+		}
+
+private:
+	std::streambuf	&wrapped;
+	std::mutex	&mutex;
+	double		&wait;
+	bool		&failed;
+	std::string	pending;
+	};
+
+
+/*	SyncStream
+	Stand-in for C++20's std::osyncstream, over a SyncBuffer
+*/
+class SyncStream : public std::ostream {
+public:
+	SyncStream(std::ostream &wrapped, std::mutex &mutex, double &wait, bool &failed) :
+		std::ostream(&buffer), buffer(*wrapped.rdbuf(), mutex, wait, failed) {}
+
+private:
+	SyncBuffer	buffer;
+	};
+
+
+/*	TestSyncstream
+	Every thread writes each message to the shared stream through a synchronized stream of
+	its own, as with std::osyncstream(stream) << message
+*/
+static Result TestSyncstream(
+	const Work	&work,
+	unsigned int	threads
+	)
+{
+std::ofstream shared(gFileName, std::ios::binary);
+if (!shared.is_open()) throw "can't open file for output";
+
+std::mutex mutex;
+std::vector<double> waits(threads);
+std::vector<char> failures(threads);
+
+const double start = Now();
+RunThreads(threads, [&](unsigned int thread) {
+	double wait = 0;
+	bool failed = false;
+	
+	for (unsigned long long count = work.GetCount(thread, threads); count; count--) {
+		SyncStream stream(shared, mutex, wait, failed);
+		if (!work.isMethodFormatted)
+			stream.write(work.message.data(), work.message.size());
+		
+		else
+			stream << work.message;
+		}
+	
+	waits[thread] = wait;
+	failures[thread] = failed;
+	});
+
+shared.flush();
+
+Result result;
+result.elapsed = Now() - start;
+
+if (shared.fail()) throw "output stream has failed";
+for (char failed : failures)
+	if (failed) throw "unable to write entire output";
+
+result.wait = 0;
+for (double wait : waits) result.wait += wait;
+
+return result;
+}
+
+
+/*	Merge
+	Queue of full buffers from the threads to the one that writes them, with the emptied ones
+	kept for reuse
+*/
+struct Merge {
+	std::mutex	mutex;
+	std::condition_variable ready, room;
+	std::deque<std::string> queue;
+	std::vector<std::string> spare;
+	size_t		limit;			// buffers queued at most
+	unsigned int	producers;		// threads still writing
+	};
+
+
+/*	TestMerged
+	Every thread collects messages in a buffer of its own, and hands it over when it is full
+	to a writer thread, the only one to touch the FILE
+*/
+static Result TestMerged(
+	const Work	&work,
+	unsigned int	threads,
+	const Buffering	&buffering
+	)
+{
+SharedFile shared(buffering);
+std::vector<double> waits(threads);
+
+Merge merge;
+merge.limit = 2 * threads;
+merge.producers = threads;
+bool failed = false;
+
+const double start = Now();
+
+// write whatever is handed over, until every thread is done
+std::thread writer([&]() {
+	std::unique_lock<std::mutex> lock(merge.mutex);
+	for (;;) {
+		merge.ready.wait(lock, [&] { return !merge.queue.empty() || !merge.producers; });
+		if (merge.queue.empty()) break;
+		
+		std::string buffer = std::move(merge.queue.front());
+		merge.queue.pop_front();
+		merge.room.notify_one();
+		
+		/* only this thread writes to the FILE, so its lock is never contended */
+		lock.unlock();
+		failed |= fwrite(buffer.data(), 1, buffer.size(), shared.file) != buffer.size();
+		buffer.clear();
+		lock.lock();
+		
+		merge.spare.push_back(std::move(buffer));
+		}
+	});
+
+RunThreads(threads, [&](unsigned int thread) {
+	double wait = 0;
+	
+	std::string buffer;
+	buffer.reserve(work.buffer);
+	
+	// queue the buffer, and take an empty one in its place
+	const auto handOver = [&]() {
+		std::unique_lock<std::mutex> lock = Lock(merge.mutex, wait);
+		if (merge.queue.size() >= merge.limit) {
+			const double waiting = Now();
+			merge.room.wait(lock, [&] { return merge.queue.size() < merge.limit; });
+			wait += Now() - waiting;
+			}
+		
+		merge.queue.push_back(std::move(buffer));
+		if (!merge.spare.empty()) {
+			buffer = std::move(merge.spare.back());
+			merge.spare.pop_back();
+			}
+		
+		else {
+			buffer = std::string();
+			buffer.reserve(work.buffer);
+			}
+		
+		merge.ready.notify_one();
+		};
+	
+	for (unsigned long long count = work.GetCount(thread, threads); count; count--) {
+		if (!buffer.empty() && buffer.size() + work.message.size() > work.buffer) handOver();
+		buffer += work.message;
+		}
+	
+	if (!buffer.empty()) handOver();
+	
+	// the last one out lets the writer finish
+	std::unique_lock<std::mutex> lock = Lock(merge.mutex, wait);
+	if (!--merge.producers) merge.ready.notify_one();
+	
+	waits[thread] = wait;
+	});
+
+writer.join();
+shared.Flush();
+
+Result result;
+result.elapsed = Now() - start;
+
+if (failed) throw "unable to write entire output";
+
+result.wait = 0;
+for (double wait : waits) result.wait += wait;
+
+return result;
+}
+
+
+/*	TestStrategy
+	Run the given strategy on the given number of threads
+*/
+static Result TestStrategy(
+	enum Strategy	strategy,
+	const Work	&work,
+	unsigned int	threads,
+	const Buffering	&buffering
+	)
+{
+switch (strategy) {
+	case kStrategyFwrite:	return TestFwrite(work, threads, buffering);
+	case kStrategyOstream:	return TestOstream(work, threads);
+	case kStrategyUnlocked:	return TestUnlocked(work, threads, buffering);
+	case kStrategySyncstream: return TestSyncstream(work, threads);
+	default:		return TestMerged(work, threads, buffering);
+	}
+}
+
+
+/*	IsStrategyApplicable
+	Whether the strategy is measured for the method
+*/
+static bool IsStrategyApplicable(
+	enum Strategy	strategy,
+	const Work	&work
+	)
+{
+return strategy != kStrategyOstream || work.isMethodCPlusPlus;
+}
+
+
+/*	MeasureThreads
+	Print the throughput of each strategy from one thread up to the given number
+*/
+extern "C"
+bool MeasureThreads(
+	bool		isMethodFormatted,
+	bool		isMethodCPlusPlus,
+	enum Mode	mode,
+	const struct Sample *sample,
+	unsigned int	threads,
+	unsigned long long volume,
+	const struct Buffering *buffering
+	)
+{
+bool failed = false;
+
+try {
+	// the message, as the Mode writes it
+	const struct SampleText text = GetSampleText(sample, mode);
+	std::string message;
+	if (text.width > 1) {
+		const enum Encoding encoding = gModeEncodings[mode];
+		message.resize(EncodeUnitsLength(encoding, text.units, text.width, text.length));
+		EncodeUnits(encoding, text.units, text.width, text.length, &message[0]);
+		}
+	
+	else
+		message.assign(static_cast<const char*>(text.units), text.length);
+	
+	if (message.empty()) throw "sample is empty";
+	
+	/* fprintf() would stop at the first null byte of a UTF-16 message */
+	const bool formatted = isMethodFormatted && message.find('\0') == std::string::npos;
+	if (isMethodFormatted && !formatted)
+		fprintf(stderr, "info: the encoded sample holds null bytes, so it is written unformatted\n");
+	
+	const Work work = {
+		message,
+		(volume + message.size() - 1) / message.size(),
+		formatted,
+		isMethodCPlusPlus,
+		buffering->size ? buffering->size : static_cast<size_t>(kThreadBuffer)
+		};
+	
+	fprintf(stderr, "info: %u processors; %llu messages of %zu bytes, and buffers of %zu bytes\n",
+		std::thread::hardware_concurrency(), work.messages, message.size(), work.buffer
+		);
+	
+	printf("# MB/s written by number of threads and strategy, with the %% of thread time spent waiting\n");
+	printf("%8s", "threads");
+	for (int strategy = 0; strategy < kStrategies; strategy++)
+		if (IsStrategyApplicable(static_cast<enum Strategy>(strategy), work))
+			printf(" %10s %6s", gStrategyNames[strategy], "wait");
+	printf("\n");
+	
+	// one thread, and powers of two up to the number asked for
+	double single[kStrategies];
+	double throughput[kStrategies];
+	for (unsigned int count = 1; ; count = count * 2 < threads ? count * 2 : threads) {
+		printf("%8u", count);
+		
+		for (int strategy = 0; strategy < kStrategies; strategy++) {
+			if (!IsStrategyApplicable(static_cast<enum Strategy>(strategy), work)) continue;
+			
+			const Result result = TestStrategy(static_cast<enum Strategy>(strategy), work, count, *buffering);
+			throughput[strategy] = work.messages * message.size() / result.elapsed / 1e6;
+			if (count == 1) single[strategy] = throughput[strategy];
+			
+			printf(" %10.1f %5.1f%%", throughput[strategy], result.wait / (count * result.elapsed) * 100);
+			fflush(stdout);
+			}
+		
+		printf("\n");
+		if (count == threads) break;
+		}
+	
+	// how far each scaled
+	printf("# at %u threads, relative to one:", threads);
+	for (int strategy = 0; strategy < kStrategies; strategy++)
+		if (IsStrategyApplicable(static_cast<enum Strategy>(strategy), work))
+			printf(" %s %.2fx", gStrategyNames[strategy], throughput[strategy] / single[strategy]);
+	printf("\n");
+	}
+
+catch (const char error[]) {
+	fprintf(stderr, "error: %s\n", error);
+	
+	failed = true;
+	}
+
+catch (...) {
+	fprintf(stderr, "error\n");
+	
+	failed = true;
+	}
+
+return failed;
+}
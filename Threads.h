@@ -0,0 +1,47 @@
+/*
+	Threads.h
+	
+	Multi-threaded shared output benchmark for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "Encoding.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	MeasureThreads
+	Write the sample to one shared output file from 1 up to 'threads' threads at once, in each
+	of the ways that a program can share a stream between threads (with a shared std::ostream
+	too, for the C++ methods), and print the throughput
+	(MB/s written) and the share of the threads' time spent waiting for the lock as a table to
+	standard output
+	Return whether the call failed
+*/
+extern bool MeasureThreads(bool isMethodFormatted, bool isMethodCPlusPlus, enum Mode, const struct Sample*, unsigned int threads, unsigned long long volume, const struct Buffering*);
+
+
+#ifdef __cplusplus
+	}
+#endif
@@ -0,0 +1,468 @@
+/*
+	Transcode
+	
+	Explicit character set conversion for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <wchar.h>
+
+#include "Transcode.h"
+
+
+
+/*	gModeEncodings
+	Encoding that the Windows CRT applies to wide-character text in each Mode
+*/
+const enum Encoding gModeEncodings[] = {
+	/* kNone */		kEncodingNone,
+	/* kBinary */		kEncodingNone,
+	/* kText */		kEncodingNone,
+	/* kWide */		kEncodingUTF16LE,
+	/* kUnicode */		kEncodingUTF8,
+	/* kWideUnicode */	kEncodingUTF16LE,
+	/* kChar8 */		kEncodingUTF8,
+	/* kChar16 */		kEncodingUTF8,
+	/* kChar32 */		kEncodingUTF8
+	};
+
+
+/*	SPECIALIZE
+	Inline the marked function into every caller, so that where the code unit width is a
+	constant the loop compiles for units of that width alone
+*/
+#if defined(__GNUC__)
+#define SPECIALIZE __attribute__((always_inline)) inline
+#elif defined(_MSC_VER)
+#define SPECIALIZE __forceinline
+#else
+#define SPECIALIZE inline
+#endif
+
+
+/*	kReplacementCharacter
+	Substituted for anything that isn't a valid code point
+*/
+static const uint32_t kReplacementCharacter = 0xFFFD;
+
+
+/*	GetUnit
+	Code unit of the given width (2 or 4 bytes) at the given index
+*/
+static SPECIALIZE uint32_t GetUnit(
+	const void	*input,
+	size_t		width,
+	size_t		index
+	)
+{
+return width == 2 ? ((const uint16_t*) input)[index] : ((const uint32_t*) input)[index];
+}
+
+
+/*	DecodeUnits
+	Decode the code point at the start of the given code units
+	Return the number of code units consumed
+*/
+static SPECIALIZE size_t DecodeUnits(
+	const void	*input,
+	size_t		width,
+	size_t		length,
+	uint32_t	*codePoint
+	)
+{
+const uint32_t c = GetUnit(input, width, 0);
+
+// high surrogate followed by low surrogate?
+/* In UTF-32 these don't normally occur, but accept them anyway */
+if (c >= 0xD800 && c < 0xDC00 && length > 1) {
+	const uint32_t c2 = GetUnit(input, width, 1);
+	if (c2 >= 0xDC00 && c2 < 0xE000) {
+		*codePoint = 0x10000 + ((c - 0xD800) << 10) + (c2 - 0xDC00);
+		return 2;
+		}
+	}
+
+// unpaired surrogate or out of range?
+if ((c >= 0xD800 && c < 0xE000) || c > 0x10FFFF)
+	*codePoint = kReplacementCharacter;
+
+else
+	*codePoint = c;
+
+return 1;
+}
+
+
+/*	EncodeUTF8
+	Encode code units as UTF-8
+*/
+static SPECIALIZE size_t EncodeUTF8(
+	const void	*input,
+	size_t		width,
+	size_t		length,
+	char		*output
+	)
+{
+unsigned char *o = (unsigned char*) output;
+
+for (const char *i = input, *const ie = i + length * width; i < ie;) {
+	uint32_t c;
+	i += width * DecodeUnits(i, width, (ie - i) / width, &c);
+	
+	if (c < 0x80)
+		*o++ = (unsigned char) c;
+	
+	else if (c < 0x800) {
+		*o++ = (unsigned char) (0xC0 | c >> 6);
+		*o++ = (unsigned char) (0x80 | (c & 0x3F));
+		}
+	
+	else if (c < 0x10000) {
+		*o++ = (unsigned char) (0xE0 | c >> 12);
+		*o++ = (unsigned char) (0x80 | (c >> 6 & 0x3F));
+		*o++ = (unsigned char) (0x80 | (c & 0x3F));
+		}
+	
+	else {
+		*o++ = (unsigned char) (0xF0 | c >> 18);
+		*o++ = (unsigned char) (0x80 | (c >> 12 & 0x3F));
+		*o++ = (unsigned char) (0x80 | (c >> 6 & 0x3F));
+		*o++ = (unsigned char) (0x80 | (c & 0x3F));
+		}
+	}
+
+return (char*) o - output;
+}
+
+
+/*	EncodeUTF16
+	Encode code units as UTF-16 of either byte order
+*/
+static SPECIALIZE size_t EncodeUTF16(
+	const void	*input,
+	size_t		width,
+	size_t		length,
+	bool		bigEndian,
+	char		*output
+	)
+{
+/* byte offsets of the low and high halves of each code unit */
+const unsigned lo = bigEndian, hi = !bigEndian;
+unsigned char *o = (unsigned char*) output;
+
+for (const char *i = input, *const ie = i + length * width; i < ie;) {
+	uint32_t c;
+	i += width * DecodeUnits(i, width, (ie - i) / width, &c);
+	
+	// supplementary plane needs surrogate pair
+	if (c >= 0x10000) {
+		const uint32_t high = 0xD800 + ((c - 0x10000) >> 10);
+		o[lo] = (unsigned char) high;
+		o[hi] = (unsigned char) (high >> 8);
+		o += 2;
+		
+		c = 0xDC00 + (c & 0x3FF);
+		}
+	
+	o[lo] = (unsigned char) c;
+	o[hi] = (unsigned char) (c >> 8);
+	o += 2;
+	}
+
+return (char*) o - output;
+}
+
+
+/*	EncodeUTF32LE
+	Encode code units as little-endian UTF-32
+*/
+static SPECIALIZE size_t EncodeUTF32LE(
+	const void	*input,
+	size_t		width,
+	size_t		length,
+	char		*output
+	)
+{
+unsigned char *o = (unsigned char*) output;
+
+for (const char *i = input, *const ie = i + length * width; i < ie;) {
+	uint32_t c;
+	i += width * DecodeUnits(i, width, (ie - i) / width, &c);
+	
+	*o++ = (unsigned char) c;
+	*o++ = (unsigned char) (c >> 8);
+	*o++ = (unsigned char) (c >> 16);
+	*o++ = 0;
+	}
+
+return (char*) o - output;
+}
+
+
+/*	PutUnit
+	Store a code unit of the given width (2 or 4 bytes) at the given index
+*/
+static inline void PutUnit(
+	void		*output,
+	size_t		width,
+	size_t		index,
+	uint32_t	unit
+	)
+{
+if (width == 2)
+	((uint16_t*) output)[index] = (uint16_t) unit;
+
+else
+	((uint32_t*) output)[index] = unit;
+}
+
+
+/*	DecodeUTF8Units
+	Decode UTF-8 into code units of the given width
+*/
+size_t DecodeUTF8Units(
+	const char	*input,
+	size_t		length,
+	size_t		width,
+	void		*output
+	)
+{
+const unsigned char *i = (const unsigned char*) input, *const ie = i + length;
+size_t o = 0;
+
+while (i < ie) {
+	uint32_t c = *i;
+	
+	// ASCII?
+	if (c < 0x80) {
+		PutUnit(output, width, o++, c);
+		i++;
+		continue;
+		}
+	
+	// length of sequence and smallest code point it may encode
+	size_t trail;
+	uint32_t minimum;
+	if (c >= 0xC2 && c < 0xE0) { trail = 1; minimum = 0x80; c &= 0x1F; }
+	else if (c >= 0xE0 && c < 0xF0) { trail = 2; minimum = 0x800; c &= 0x0F; }
+	else if (c >= 0xF0 && c < 0xF5) { trail = 3; minimum = 0x10000; c &= 0x07; }
+	else trail = 0, minimum = 0;
+	
+	// gather continuation bytes
+	size_t n = 0;
+	if (trail && (size_t) (ie - i) > trail)
+		for (; n < trail && (i[n + 1] & 0xC0) == 0x80; n++)
+			c = c << 6 | (i[n + 1] & 0x3F);
+	
+	// ill-formed, overlong, surrogate or out of range?
+	if (!trail || n != trail || c < minimum || (c >= 0xD800 && c < 0xE000) || c > 0x10FFFF) {
+		PutUnit(output, width, o++, kReplacementCharacter);
+		i++;
+		continue;
+		}
+	
+	i += 1 + trail;
+	
+	// supplementary plane needs surrogate pair in UTF-16
+	if (c >= 0x10000 && width == 2) {
+		PutUnit(output, width, o++, 0xD800 + ((c - 0x10000) >> 10));
+		c = 0xDC00 + (c & 0x3FF);
+		}
+	
+	PutUnit(output, width, o++, c);
+	}
+
+return o;
+}
+
+
+/*	DecodeUTF8
+	Decode UTF-8 into wide characters
+*/
+size_t DecodeUTF8(
+	const char	*input,
+	size_t		length,
+	wchar_t		*output
+	)
+{
+return DecodeUTF8Units(input, length, sizeof *output, output);
+}
+
+
+/*	EncodeBound
+	Largest number of bytes that encoding the given number of wide characters can produce
+*/
+size_t EncodeBound(
+	enum Encoding	encoding,
+	size_t		length
+	)
+{
+/* Either encoding needs at most four bytes for any one wide character (a supplementary
+   character is four bytes in both, but if wchar_t is UTF-16 it took two wide characters) */
+return length * 4;
+}
+
+
+/*	MeasureUnits
+	Number of bytes that encoding the given code units produces
+*/
+static SPECIALIZE size_t MeasureUnits(
+	enum Encoding	encoding,
+	const void	*input,
+	size_t		width,
+	size_t		length
+	)
+{
+size_t result = 0;
+
+for (const char *i = input, *const ie = i + length * width; i < ie;) {
+	uint32_t c;
+	i += width * DecodeUnits(i, width, (ie - i) / width, &c);
+	
+	switch (encoding) {
+		case kEncodingUTF8:	result += c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4; break;
+		case kEncodingUTF16LE:
+		case kEncodingUTF16BE:	result += c < 0x10000 ? 2 : 4; break;
+		case kEncodingUTF32LE:	result += 4; break;
+		default:		break;
+		}
+	}
+
+return result;
+}
+
+
+/*	EncodeUnitsLength
+	Number of bytes that encoding the given code units produces
+*/
+size_t EncodeUnitsLength(
+	enum Encoding	encoding,
+	const void	*input,
+	size_t		width,
+	size_t		length
+	)
+{
+return width == 2 ? MeasureUnits(encoding, input, 2, length) : MeasureUnits(encoding, input, 4, length);
+}
+
+
+/*	EncodeLength
+	Number of bytes that encoding the given wide characters produces
+*/
+size_t EncodeLength(
+	enum Encoding	encoding,
+	const wchar_t	*input,
+	size_t		length
+	)
+{
+return EncodeUnitsLength(encoding, input, sizeof *input, length);
+}
+
+
+/*	EncodeWidth
+	Encode code units of the given width into the given buffer
+*/
+static SPECIALIZE size_t EncodeWidth(
+	enum Encoding	encoding,
+	const void	*input,
+	size_t		width,
+	size_t		length,
+	char		*output
+	)
+{
+switch (encoding) {
+	case kEncodingUTF8:	return EncodeUTF8(input, width, length, output);
+	case kEncodingUTF16LE:	return EncodeUTF16(input, width, length, false, output);
+	case kEncodingUTF16BE:	return EncodeUTF16(input, width, length, true, output);
+	case kEncodingUTF32LE:	return EncodeUTF32LE(input, width, length, output);
+	default:		return 0;
+	}
+}
+
+
+/*	EncodeUnits
+	Encode code units of the given width into the given buffer
+*/
+size_t EncodeUnits(
+	enum Encoding	encoding,
+	const void	*input,
+	size_t		width,
+	size_t		length,
+	char		*output
+	)
+{
+return width == 2 ? EncodeWidth(encoding, input, 2, length, output) : EncodeWidth(encoding, input, 4, length, output);
+}
+
+
+/*	Encode
+	Encode wide characters into the given buffer
+*/
+size_t Encode(
+	enum Encoding	encoding,
+	const wchar_t	*input,
+	size_t		length,
+	char		*output
+	)
+{
+return EncodeUnits(encoding, input, sizeof *input, length, output);
+}
+
+
+/*	GetByteOrderMark
+	Byte order mark that the Windows CRT writes at the start of a file in the given encoding
+*/
+size_t GetByteOrderMark(
+	enum Encoding	encoding,
+	const char	**mark
+	)
+{
+static const char
+	kUTF8[] = { '\xEF', '\xBB', '\xBF' },
+	kUTF16LE[] = { '\xFF', '\xFE' },
+	kUTF16BE[] = { '\xFE', '\xFF' },
+	kUTF32LE[] = { '\xFF', '\xFE', '\0', '\0' };
+
+switch (encoding) {
+	case kEncodingUTF8:	*mark = kUTF8; return sizeof kUTF8;
+	case kEncodingUTF16LE:	*mark = kUTF16LE; return sizeof kUTF16LE;
+	case kEncodingUTF16BE:	*mark = kUTF16BE; return sizeof kUTF16BE;
+	case kEncodingUTF32LE:	*mark = kUTF32LE; return sizeof kUTF32LE;
+	default:		*mark = NULL; return 0;
+	}
+}
+
+
+/*	GetModeByteOrderMark
+	Byte order mark that a file written in the given Mode starts with
+*/
+size_t GetModeByteOrderMark(
+	enum Mode	mode,
+	const char	**mark
+	)
+{
+switch (mode) {
+	/* these are written in binary, not by a CRT Unicode mode */
+	case kModeChar8:
+	case kModeChar16:
+	case kModeChar32:	*mark = NULL; return 0;
+	
+	default:		return GetByteOrderMark(gModeEncodings[mode], mark);
+	}
+}
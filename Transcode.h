@@ -0,0 +1,137 @@
+/*
+	Transcode.h
+	
+	Explicit character set conversion for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+#include "Encoding.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	Encoding
+	Byte encodings produced from wide-character text
+	
+	The Windows CRT only produces UTF-8 and UTF-16LE; the others are there for the codecvt facet.
+*/
+enum Encoding {
+	kEncodingNone,
+	kEncodingUTF8,
+	kEncodingUTF16LE,
+	kEncodingUTF16BE,
+	kEncodingUTF32LE
+	};
+
+
+/*	gModeEncodings
+	Encoding that the Windows CRT applies to wide-character text in each Mode
+	
+	The narrow modes are passed through unchanged; the wide ones are what _O_WTEXT/ccs=unicode,
+	_O_U8TEXT/ccs=utf-8 and _O_U16TEXT/ccs=utf-16le produce.  The char8, char16 and char32 modes
+	aren't the CRT's, and all write UTF-8.
+*/
+extern const enum Encoding gModeEncodings[];
+
+
+/*	EncodeBound
+	Largest number of bytes that encoding the given number of wide characters can produce
+*/
+extern size_t EncodeBound(enum Encoding, size_t length);
+
+
+/*	Encode
+	Encode wide characters (UTF-16 or UTF-32, whichever wchar_t holds) into the given buffer,
+	which must be at least EncodeBound() bytes; unpaired surrogates become U+FFFD
+	Return the number of bytes produced
+*/
+extern size_t Encode(enum Encoding, const wchar_t *input, size_t length, char *output);
+
+
+/*	EncodeUnits
+	As Encode(), but from code units of the given width in bytes whatever wchar_t is: 2 (UTF-16,
+	as in char16_t) or 4 (UTF-32, as in char32_t)
+*/
+extern size_t EncodeUnits(enum Encoding, const void *input, size_t width, size_t length, char *output);
+
+
+/*	EncodeLength, EncodeUnitsLength
+	Number of bytes that Encode() or EncodeUnits() produces for the given text
+*/
+extern size_t EncodeLength(enum Encoding, const wchar_t *input, size_t length);
+extern size_t EncodeUnitsLength(enum Encoding, const void *input, size_t width, size_t length);
+
+
+/*	DecodeUTF8
+	Decode UTF-8 into wide characters (UTF-16 or UTF-32, whichever wchar_t holds); the buffer
+	must have room for as many wide characters as there are bytes.  Each byte that isn't part
+	of a well-formed sequence becomes U+FFFD
+	Return the number of wide characters produced
+*/
+extern size_t DecodeUTF8(const char *input, size_t length, wchar_t *output);
+
+
+/*	DecodeUTF8Units
+	As DecodeUTF8(), but into code units of the given width in bytes (2 or 4)
+	Return the number of code units produced
+*/
+extern size_t DecodeUTF8Units(const char *input, size_t length, size_t width, void *output);
+
+
+/*	EncodeSIMD
+	As Encode(), but using the vectorized kernel best suited to this processor
+*/
+extern size_t EncodeSIMD(enum Encoding, const wchar_t *input, size_t length, char *output);
+
+
+/*	EncodeSIMDUnits
+	As EncodeUnits(), but using the vectorized kernels
+*/
+extern size_t EncodeSIMDUnits(enum Encoding, const void *input, size_t width, size_t length, char *output);
+
+
+/*	GetSIMDKernelName
+	Name of the kernel that EncodeSIMD() dispatches to ("avx2", "sse2" or "scalar")
+*/
+extern const char *GetSIMDKernelName(void);
+
+
+/*	GetByteOrderMark
+	Byte order mark that the Windows CRT writes at the start of a file in the given encoding
+	Return its length in bytes
+*/
+extern size_t GetByteOrderMark(enum Encoding, const char **mark);
+
+
+/*	GetModeByteOrderMark
+	Byte order mark that a file written in the given Mode starts with: that of its encoding, but
+	none for the char8, char16 and char32 modes, which are written in binary
+	Return its length in bytes
+*/
+extern size_t GetModeByteOrderMark(enum Mode, const char **mark);
+
+
+#ifdef __cplusplus
+	}
+#endif
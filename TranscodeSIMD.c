@@ -0,0 +1,580 @@
+/*
+	TranscodeSIMD
+	
+	Vectorized character set conversion for
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	The kernels convert whole blocks of code units (UTF-16 or UTF-32; wchar_t is whichever of
+	the two the platform has) at once where the block allows it, and hand anything else
+	(characters needing three or four bytes of UTF-8, surrogates, supplementary characters) to
+	the scalar EncodeUnits() a block at a time:
+	
+	* SSE2: ASCII blocks to UTF-8; BMP blocks to UTF-16LE
+	* AVX2: the same at twice the width, plus blocks below U+0800 to UTF-8
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TRANSCODE_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#include "Transcode.h"
+
+
+/*	IsHighSurrogate
+	Whether the code unit of the given width (2 or 4 bytes) at the given index is the first half
+	of a surrogate pair
+*/
+static inline bool IsHighSurrogate(
+	const void	*input,
+	size_t		width,
+	size_t		index
+	)
+{
+const uint32_t c = width == 2 ? ((const uint16_t*) input)[index] : ((const uint32_t*) input)[index];
+
+return c >= 0xD800 && c < 0xDC00;
+}
+
+
+/*	EncodeScalarBlock
+	Encode one block that the vector kernel can't, without splitting a surrogate pair
+	Return the number of code units consumed
+*/
+static size_t EncodeScalarBlock(
+	enum Encoding	encoding,
+	const void	*input,
+	size_t		width,
+	size_t		block,
+	size_t		remaining,
+	char		**output
+	)
+{
+// don't split a surrogate pair at the end of the block
+while (block < remaining && IsHighSurrogate(input, width, block - 1))
+	block++;
+
+*output += EncodeUnits(encoding, input, width, block, *output);
+
+return block;
+}
+
+
+#ifdef TRANSCODE_X86
+
+/*	TARGET_AVX2
+	Allow AVX2 instructions in the marked function only, so that the rest of the program
+	still runs on processors without it
+*/
+#ifdef __GNUC__
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+
+/*	PackASCIISSE2
+	Store sixteen code units as bytes, if they are all ASCII
+	Return whether they were
+*/
+static inline bool PackASCIISSE2(
+	const void	*input,
+	size_t		width,
+	char		*output
+	)
+{
+if (width == 4) {
+	const __m128i
+		v0 = _mm_loadu_si128((const __m128i*) input),
+		v1 = _mm_loadu_si128((const __m128i*) input + 1),
+		v2 = _mm_loadu_si128((const __m128i*) input + 2),
+		v3 = _mm_loadu_si128((const __m128i*) input + 3),
+		nonASCII = _mm_and_si128(_mm_or_si128(_mm_or_si128(v0, v1), _mm_or_si128(v2, v3)), _mm_set1_epi32(~0x7F));
+	if (_mm_movemask_epi8(_mm_cmpeq_epi32(nonASCII, _mm_setzero_si128())) != 0xFFFF) return false;
+	
+	/* values are below 0x80, so the signed saturating pack is exact */
+	_mm_storeu_si128((__m128i*) output, _mm_packus_epi16(_mm_packs_epi32(v0, v1), _mm_packs_epi32(v2, v3)));
+	}
+
+else {
+	const __m128i
+		v0 = _mm_loadu_si128((const __m128i*) input),
+		v1 = _mm_loadu_si128((const __m128i*) input + 1),
+		nonASCII = _mm_and_si128(_mm_or_si128(v0, v1), _mm_set1_epi16(~0x7F));
+	if (_mm_movemask_epi8(_mm_cmpeq_epi16(nonASCII, _mm_setzero_si128())) != 0xFFFF) return false;
+	
+	_mm_storeu_si128((__m128i*) output, _mm_packus_epi16(v0, v1));
+	}
+
+return true;
+}
+
+
+/*	PackBMPSSE2
+	Store eight code units as UTF-16LE, if none is a surrogate or supplementary character
+	Return whether that was the case
+*/
+static inline bool PackBMPSSE2(
+	const void	*input,
+	size_t		width,
+	char		*output
+	)
+{
+if (width == 4) {
+	const __m128i
+		v0 = _mm_loadu_si128((const __m128i*) input),
+		v1 = _mm_loadu_si128((const __m128i*) input + 1),
+		supplementary = _mm_srli_epi32(_mm_or_si128(v0, v1), 16),
+		surrogate = _mm_or_si128(
+			_mm_cmpeq_epi32(_mm_and_si128(v0, _mm_set1_epi32(0xF800)), _mm_set1_epi32(0xD800)),
+			_mm_cmpeq_epi32(_mm_and_si128(v1, _mm_set1_epi32(0xF800)), _mm_set1_epi32(0xD800))
+			);
+	if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_or_si128(supplementary, surrogate), _mm_setzero_si128())) != 0xFFFF) return false;
+	
+	/* SSE2 only has a signed saturating pack, so bias the values into its range and back again */
+	const __m128i bias = _mm_set1_epi32(0x8000);
+	const __m128i packed = _mm_packs_epi32(_mm_sub_epi32(v0, bias), _mm_sub_epi32(v1, bias));
+	_mm_storeu_si128((__m128i*) output, _mm_xor_si128(packed, _mm_set1_epi16((short) 0x8000)));
+	}
+
+else {
+	const __m128i
+		v = _mm_loadu_si128((const __m128i*) input),
+		surrogate = _mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16((short) 0xF800)), _mm_set1_epi16((short) 0xD800));
+	if (_mm_movemask_epi8(surrogate) != 0) return false;
+	
+	_mm_storeu_si128((__m128i*) output, v);
+	}
+
+return true;
+}
+
+
+/*	EncodeUTF8SSE2
+	Encode code units as UTF-8, sixteen at a time where they are all ASCII
+*/
+static size_t EncodeUTF8SSE2(
+	const void	*input,
+	size_t		width,
+	size_t		length,
+	char		*output
+	)
+{
+char *o = output;
+const char *i = input, *const ie = i + length * width;
+
+while ((size_t) (ie - i) >= 16 * width)
+	if (PackASCIISSE2(i, width, o)) {
+		i += 16 * width;
+		o += 16;
+		}
+	
+	else
+		i += width * EncodeScalarBlock(kEncodingUTF8, i, width, 16, (ie - i) / width, &o);
+
+// remainder
+o += EncodeUnits(kEncodingUTF8, i, width, (ie - i) / width, o);
+
+return o - output;
+}
+
+
+/*	EncodeUTF16LESSE2
+	Encode code units as UTF-16LE, eight at a time where there are no surrogates
+	or supplementary characters
+*/
+static size_t EncodeUTF16LESSE2(
+	const void	*input,
+	size_t		width,
+	size_t		length,
+	char		*output
+	)
+{
+char *o = output;
+const char *i = input, *const ie = i + length * width;
+
+while ((size_t) (ie - i) >= 8 * width)
+	if (PackBMPSSE2(i, width, o)) {
+		i += 8 * width;
+		o += 16;
+		}
+	
+	else
+		i += width * EncodeScalarBlock(kEncodingUTF16LE, i, width, 8, (ie - i) / width, &o);
+
+// remainder
+o += EncodeUnits(kEncodingUTF16LE, i, width, (ie - i) / width, o);
+
+return o - output;
+}
+
+
+/*	gTwoByteShuffles
+	For each bitmap of which of eight characters are ASCII, the byte shuffle that keeps
+	one byte of each ASCII character's pair and both of every other, and its length
+*/
+static uint8_t gTwoByteShuffles[256][16];
+static uint8_t gTwoByteLengths[256];
+
+
+/*	InitializeTwoByteShuffles
+	Fill in the gTwoByteShuffles table
+*/
+static void InitializeTwoByteShuffles(void)
+{
+for (unsigned ascii = 0; ascii < 256; ascii++) {
+	uint8_t *const shuffle = gTwoByteShuffles[ascii];
+	unsigned length = 0;
+	
+	for (unsigned i = 0; i < 8; i++) {
+		shuffle[length++] = (uint8_t) (2 * i);
+		if (!(ascii & 1u << i)) shuffle[length++] = (uint8_t) (2 * i + 1);
+		}
+	
+	gTwoByteLengths[ascii] = (uint8_t) length;
+	
+	// unused positions produce zero
+	while (length < 16) shuffle[length++] = 0x80;
+	}
+}
+
+
+/*	PackASCIIAVX2
+	Store thirty-two code units as bytes, if they are all ASCII
+	Return whether they were
+*/
+TARGET_AVX2
+static inline bool PackASCIIAVX2(
+	const void	*input,
+	size_t		width,
+	char		*output
+	)
+{
+if (width == 4) {
+	const __m256i
+		v0 = _mm256_loadu_si256((const __m256i*) input),
+		v1 = _mm256_loadu_si256((const __m256i*) input + 1),
+		v2 = _mm256_loadu_si256((const __m256i*) input + 2),
+		v3 = _mm256_loadu_si256((const __m256i*) input + 3);
+	if (!_mm256_testz_si256(_mm256_or_si256(_mm256_or_si256(v0, v1), _mm256_or_si256(v2, v3)), _mm256_set1_epi32(~0x7F))) return false;
+	
+	/* the packs work within each 128-bit lane, so the result needs putting back in order */
+	const __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(v0, v1), _mm256_packus_epi32(v2, v3));
+	_mm256_storeu_si256((__m256i*) output, _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)));
+	}
+
+else {
+	const __m256i
+		v0 = _mm256_loadu_si256((const __m256i*) input),
+		v1 = _mm256_loadu_si256((const __m256i*) input + 1);
+	if (!_mm256_testz_si256(_mm256_or_si256(v0, v1), _mm256_set1_epi16(~0x7F))) return false;
+	
+	_mm256_storeu_si256((__m256i*) output, _mm256_permute4x64_epi64(_mm256_packus_epi16(v0, v1), 0xD8));
+	}
+
+return true;
+}
+
+
+/*	PackTwoByteAVX2
+	Store eight code units as UTF-8, if they are all below U+0800
+	Return the number of bytes produced (though sixteen are always written), or zero
+*/
+TARGET_AVX2
+static inline size_t PackTwoByteAVX2(
+	const void	*input,
+	size_t		width,
+	char		*output
+	)
+{
+// get the characters as eight 16-bit words
+__m128i v;
+if (width == 4) {
+	const __m128i
+		v0 = _mm_loadu_si128((const __m128i*) input),
+		v1 = _mm_loadu_si128((const __m128i*) input + 1);
+	if (!_mm_testz_si128(_mm_or_si128(v0, v1), _mm_set1_epi32(~0x7FF))) return 0;
+	
+	v = _mm_packus_epi32(v0, v1);
+	}
+
+else {
+	v = _mm_loadu_si128((const __m128i*) input);
+	if (!_mm_testz_si128(v, _mm_set1_epi16(~0x7FF))) return 0;
+	}
+
+// lead byte in the low half of each word, continuation byte in the high half; ASCII as is
+const __m128i
+	ascii = _mm_cmplt_epi16(v, _mm_set1_epi16(0x80)),
+	lead = _mm_or_si128(_mm_srli_epi16(v, 6), _mm_set1_epi16(0xC0)),
+	trail = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x3F)), 8), _mm_set1_epi16((short) 0x8000)),
+	pairs = _mm_blendv_epi8(_mm_or_si128(lead, trail), v, ascii);
+
+// squeeze out the unused high half of the ASCII characters' words
+const unsigned bitmap = (unsigned) _mm_movemask_epi8(_mm_packs_epi16(ascii, _mm_setzero_si128())) & 0xFF;
+_mm_storeu_si128((__m128i*) output, _mm_shuffle_epi8(pairs, _mm_loadu_si128((const __m128i*) gTwoByteShuffles[bitmap])));
+
+return gTwoByteLengths[bitmap];
+}
+
+
+/*	PackBMPAVX2
+	Store sixteen code units as UTF-16LE, if none is a surrogate or supplementary character
+	Return whether that was the case
+*/
+TARGET_AVX2
+static inline bool PackBMPAVX2(
+	const void	*input,
+	size_t		width,
+	char		*output
+	)
+{
+if (width == 4) {
+	const __m256i
+		v0 = _mm256_loadu_si256((const __m256i*) input),
+		v1 = _mm256_loadu_si256((const __m256i*) input + 1),
+		surrogate = _mm256_or_si256(
+			_mm256_cmpeq_epi32(_mm256_and_si256(v0, _mm256_set1_epi32(0xF800)), _mm256_set1_epi32(0xD800)),
+			_mm256_cmpeq_epi32(_mm256_and_si256(v1, _mm256_set1_epi32(0xF800)), _mm256_set1_epi32(0xD800))
+			);
+	if (!_mm256_testz_si256(_mm256_or_si256(v0, v1), _mm256_set1_epi32(~0xFFFF)) || !_mm256_testz_si256(surrogate, surrogate)) return false;
+	
+	_mm256_storeu_si256((__m256i*) output, _mm256_permute4x64_epi64(_mm256_packus_epi32(v0, v1), 0xD8));
+	}
+
+else {
+	const __m256i
+		v = _mm256_loadu_si256((const __m256i*) input),
+		surrogate = _mm256_cmpeq_epi16(_mm256_and_si256(v, _mm256_set1_epi16((short) 0xF800)), _mm256_set1_epi16((short) 0xD800));
+	if (!_mm256_testz_si256(surrogate, surrogate)) return false;
+	
+	_mm256_storeu_si256((__m256i*) output, v);
+	}
+
+return true;
+}
+
+
+/*	EncodeUTF8AVX2
+	Encode code units as UTF-8, thirty-two at a time where they are all ASCII and
+	eight at a time where they are all below U+0800
+*/
+TARGET_AVX2
+static size_t EncodeUTF8AVX2(
+	const void	*input,
+	size_t		width,
+	size_t		length,
+	char		*output
+	)
+{
+char *o = output;
+const char *i = input, *const ie = i + length * width;
+
+while ((size_t) (ie - i) >= 32 * width)
+	if (PackASCIIAVX2(i, width, o)) {
+		i += 32 * width;
+		o += 32;
+		}
+	
+	// not all ASCII; try eight at a time
+	else
+		for (const char *const blocke = i + 32 * width; i < blocke && (size_t) (ie - i) >= 8 * width;) {
+			const size_t packed = PackTwoByteAVX2(i, width, o);
+			if (packed) {
+				i += 8 * width;
+				o += packed;
+				}
+			
+			else
+				i += width * EncodeScalarBlock(kEncodingUTF8, i, width, 8, (ie - i) / width, &o);
+			}
+
+// remainder
+o += EncodeUnits(kEncodingUTF8, i, width, (ie - i) / width, o);
+
+return o - output;
+}
+
+
+/*	EncodeUTF16LEAVX2
+	Encode code units as UTF-16LE, sixteen at a time where there are no surrogates
+	or supplementary characters
+*/
+TARGET_AVX2
+static size_t EncodeUTF16LEAVX2(
+	const void	*input,
+	size_t		width,
+	size_t		length,
+	char		*output
+	)
+{
+char *o = output;
+const char *i = input, *const ie = i + length * width;
+
+while ((size_t) (ie - i) >= 16 * width)
+	if (PackBMPAVX2(i, width, o)) {
+		i += 16 * width;
+		o += 32;
+		}
+	
+	else
+		i += width * EncodeScalarBlock(kEncodingUTF16LE, i, width, 16, (ie - i) / width, &o);
+
+// remainder
+o += EncodeUnits(kEncodingUTF16LE, i, width, (ie - i) / width, o);
+
+return o - output;
+}
+
+
+/*	HasAVX2
+	Whether both the processor and the operating system support AVX2
+*/
+static bool HasAVX2(void)
+{
+#ifdef _MSC_VER
+int registers[4];
+
+// processor has OSXSAVE and AVX?
+__cpuid(registers, 1);
+if ((registers[2] & (1 << 27 | 1 << 28)) != (1 << 27 | 1 << 28)) return false;
+
+// operating system saves the YMM registers?
+if ((_xgetbv(0) & 6) != 6) return false;
+
+// processor has AVX2?
+__cpuidex(registers, 7, 0);
+return (registers[1] & 1 << 5) != 0;
+
+#else
+return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+
+/*	EncodeFunction
+	Signature shared by the encoding kernels for one Encoding
+*/
+typedef size_t (*EncodeFunction)(const void*, size_t width, size_t length, char*);
+
+
+/*	gSIMDKernel
+	Kernels selected for this processor
+*/
+static struct {
+	const char	*name;
+	EncodeFunction	utf8, utf16LE;
+	} gSIMDKernel;
+
+
+#ifndef TRANSCODE_X86
+
+/*	EncodeUTF8Scalar, EncodeUTF16LEScalar
+	Scalar fallback kernels
+*/
+static size_t EncodeUTF8Scalar(const void *input, size_t width, size_t length, char *output) { return EncodeUnits(kEncodingUTF8, input, width, length, output); }
+static size_t EncodeUTF16LEScalar(const void *input, size_t width, size_t length, char *output) { return EncodeUnits(kEncodingUTF16LE, input, width, length, output); }
+
+#endif
+
+
+/*	SelectSIMDKernel
+	Choose the best kernels that this processor supports
+*/
+static void SelectSIMDKernel(void)
+{
+#ifdef TRANSCODE_X86
+if (HasAVX2()) {
+	InitializeTwoByteShuffles();
+	
+	gSIMDKernel.utf8 = EncodeUTF8AVX2;
+	gSIMDKernel.utf16LE = EncodeUTF16LEAVX2;
+	gSIMDKernel.name = "avx2";
+	}
+
+else {
+	/* SSE2 is part of the x86-64 baseline */
+	gSIMDKernel.utf8 = EncodeUTF8SSE2;
+	gSIMDKernel.utf16LE = EncodeUTF16LESSE2;
+	gSIMDKernel.name = "sse2";
+	}
+
+#else
+gSIMDKernel.utf8 = EncodeUTF8Scalar;
+gSIMDKernel.utf16LE = EncodeUTF16LEScalar;
+gSIMDKernel.name = "scalar";
+#endif
+}
+
+
+/*	GetSIMDKernelName
+	Name of the kernel that EncodeSIMD() dispatches to
+*/
+const char *GetSIMDKernelName(void)
+{
+if (!gSIMDKernel.name) SelectSIMDKernel();
+
+return gSIMDKernel.name;
+}
+
+
+/*	EncodeSIMDUnits
+	Encode code units of the given width into the given buffer using the vectorized kernels
+*/
+size_t EncodeSIMDUnits(
+	enum Encoding	encoding,
+	const void	*input,
+	size_t		width,
+	size_t		length,
+	char		*output
+	)
+{
+if (!gSIMDKernel.name) SelectSIMDKernel();
+
+switch (encoding) {
+	case kEncodingUTF8:	return gSIMDKernel.utf8(input, width, length, output);
+	case kEncodingUTF16LE:	return gSIMDKernel.utf16LE(input, width, length, output);
+	
+	/* no vector kernels for these (yet) */
+	default:		return EncodeUnits(encoding, input, width, length, output);
+	}
+}
+
+
+/*	EncodeSIMD
+	Encode wide characters into the given buffer using the vectorized kernels
+*/
+size_t EncodeSIMD(
+	enum Encoding	encoding,
+	const wchar_t	*input,
+	size_t		length,
+	char		*output
+	)
+{
+return EncodeSIMDUnits(encoding, input, sizeof *input, length, output);
+}
@@ -0,0 +1,992 @@
+/*
+	Validate
+	
+	Well-formedness checking of the output of
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	The kernels check whole blocks at once, and find the exact offset of a sequence that isn't
+	well-formed with the scalar check, from the start of the sequence that the block began in:
+	
+	* SSE2: skips blocks of ASCII (UTF-8), or without surrogates (UTF-16)
+	* SSSE3: UTF-8 checked sixteen bytes at a time with three table lookups on the high and low
+	  nibbles of each byte and the one before it, after Keiser and Lemire ("Validating UTF-8 in
+	  less than one instruction per byte", 2021)
+	* AVX2: the same at twice the width
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define VALIDATE_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#include "Encoding.h"
+#include "Sample.h"
+#include "Validate.h"
+
+
+
+/*	gEncodingNames
+	Name of each Encoding
+*/
+static const char *const gEncodingNames[] = {
+	/* kEncodingNone */	"bytes",
+	/* kEncodingUTF8 */	"UTF-8",
+	/* kEncodingUTF16LE */	"UTF-16LE",
+	/* kEncodingUTF16BE */	"UTF-16BE",
+	/* kEncodingUTF32LE */	"UTF-32LE"
+	};
+
+
+/*	kValidateBenchSeconds
+	Time spent finding the throughput of the validator
+*/
+static const double kValidateBenchSeconds = 0.25;
+
+
+/*	kSplitCheckBytes
+	Most bytes of the file that CheckSplits() hands to the Validator
+*/
+enum { kSplitCheckBytes = 1 << 20 };
+
+
+/*	GetEncodingName
+	Name of the encoding
+*/
+const char *GetEncodingName(
+	enum Encoding	encoding
+	)
+{
+return gEncodingNames[encoding];
+}
+
+
+/*	FindInvalidUTF8Scalar
+	Offset of the first sequence that isn't well-formed UTF-8 (Unicode table 3-7), one
+	sequence at a time
+*/
+static size_t FindInvalidUTF8Scalar(
+	const unsigned char *input,
+	size_t		length,
+	bool		*truncated
+	)
+{
+*truncated = false;
+
+for (size_t offset = 0; offset < length;) {
+	const unsigned char lead = input[offset];
+	if (lead < 0x80) {
+		offset++;
+		continue;
+		}
+	
+	// length of the sequence, and the range its second byte is restricted to
+	size_t count;
+	unsigned char low = 0x80, high = 0xBF;
+	if (lead >= 0xC2 && lead <= 0xDF)
+		count = 2;
+	
+	else if (lead >= 0xE0 && lead <= 0xEF) {
+		count = 3;
+		if (lead == 0xE0) low = 0xA0;		// overlong
+		else if (lead == 0xED) high = 0x9F;	// surrogate
+		}
+	
+	else if (lead >= 0xF0 && lead <= 0xF4) {
+		count = 4;
+		if (lead == 0xF0) low = 0x90;		// overlong
+		else if (lead == 0xF4) high = 0x8F;	// beyond U+10FFFF
+		}
+	
+	else
+		return offset;
+	
+	for (size_t i = 1; i < count; i++) {
+		if (offset + i == length) {
+			*truncated = true;
+			return offset;
+			}
+		
+		const unsigned char trail = input[offset + i];
+		if (i == 1 ? trail < low || trail > high : (trail & 0xC0) != 0x80) return offset;
+		}
+	
+	offset += count;
+	}
+
+return length;
+}
+
+
+/*	FindInvalidUTF16Scalar
+	Offset of the first unit that isn't part of well-formed UTF-16, in either byte order
+*/
+static size_t FindInvalidUTF16Scalar(
+	const unsigned char *input,
+	size_t		length,
+	bool		bigEndian,
+	bool		*truncated
+	)
+{
+*truncated = false;
+
+size_t offset = 0;
+while (length - offset >= 2) {
+	const unsigned unit = bigEndian ? input[offset] << 8 | input[offset + 1] : input[offset + 1] << 8 | input[offset];
+	if (unit < 0xD800 || unit > 0xDFFF) {
+		offset += 2;
+		continue;
+		}
+	
+	// low surrogate without a high one?
+	if (unit >= 0xDC00) return offset;
+	
+	if (length - offset < 4) {
+		*truncated = true;
+		return offset;
+		}
+	
+	const unsigned next = bigEndian ? input[offset + 2] << 8 | input[offset + 3] : input[offset + 3] << 8 | input[offset + 2];
+	if (next < 0xDC00 || next > 0xDFFF) return offset;
+	
+	offset += 4;
+	}
+
+// odd byte at the end
+if (offset < length) *truncated = true;
+
+return offset;
+}
+
+
+/*	FindInvalidUTF32Scalar
+	Offset of the first UTF-32LE unit that isn't a Unicode scalar value
+*/
+static size_t FindInvalidUTF32Scalar(
+	const unsigned char *input,
+	size_t		length,
+	bool		*truncated
+	)
+{
+size_t offset = 0;
+for (; length - offset >= 4; offset += 4) {
+	const uint32_t unit = (uint32_t) input[offset + 3] << 24 | (uint32_t) input[offset + 2] << 16 | input[offset + 1] << 8 | input[offset];
+	if (unit > 0x10FFFF || (unit >= 0xD800 && unit < 0xE000)) break;
+	}
+
+*truncated = offset < length && length - offset < 4;
+
+return offset;
+}
+
+
+#ifdef VALIDATE_X86
+
+/*	TARGET_SSSE3, TARGET_AVX2
+	Allow SSSE3 and AVX2 instructions in the marked functions only, so that the rest of the
+	program still runs on processors without them
+*/
+#ifdef __GNUC__
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#endif
+
+
+/*	Error classes
+	What a pair of consecutive bytes can be wrong with; a pair is wrong if all three lookups
+	in gUTF8Byte1High, gUTF8Byte1Low and gUTF8Byte2High share a class
+*/
+enum {
+	kTooShort = 1 << 0,			// 11______ 0_______, 11______ 11______
+	kTooLong = 1 << 1,			// 0_______ 10______
+	kOverlong3 = 1 << 2,			// 11100000 100_____
+	kTooLarge = 1 << 3,			// 11110100 1001____ and above
+	kSurrogate = 1 << 4,			// 11101101 101_____
+	kOverlong2 = 1 << 5,			// 1100000_ 10______
+	kTooLarge1000 = 1 << 6,			// 11110101 1000____ and above
+	kOverlong4 = 1 << 6,			// 11110000 1000____
+	kTwoContinuations = 1 << 7,		// 10______ 10______
+	kCarry = kTooShort | kTooLong | kTwoContinuations
+	};
+
+
+/*	gUTF8Byte1High, gUTF8Byte1Low, gUTF8Byte2High
+	Error classes by the high and low nibbles of the first byte of a pair, and the high nibble
+	of the second
+*/
+static const uint8_t gUTF8Byte1High[16] = {
+	/* 0___ */	kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong,
+	/* 10__ */	kTwoContinuations, kTwoContinuations, kTwoContinuations, kTwoContinuations,
+	/* 1100 */	kTooShort | kOverlong2,
+	/* 1101 */	kTooShort,
+	/* 1110 */	kTooShort | kOverlong3 | kSurrogate,
+	/* 1111 */	kTooShort | kTooLarge | kTooLarge1000 | kOverlong4
+	};
+
+static const uint8_t gUTF8Byte1Low[16] = {
+	/* 0000 */	kCarry | kOverlong3 | kOverlong2 | kOverlong4,
+	/* 0001 */	kCarry | kOverlong2,
+	/* 001_ */	kCarry, kCarry,
+	/* 0100 */	kCarry | kTooLarge,
+	/* 0101 */	kCarry | kTooLarge | kTooLarge1000,
+	/* 011_ */	kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000,
+	/* 1___ */	kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000,
+			kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000,
+			kCarry | kTooLarge | kTooLarge1000,
+	/* 1101 */	kCarry | kTooLarge | kTooLarge1000 | kSurrogate,
+			kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000
+	};
+
+static const uint8_t gUTF8Byte2High[16] = {
+	/* 0___ */	kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort,
+	/* 1000 */	kTooLong | kOverlong2 | kTwoContinuations | kOverlong3 | kTooLarge1000 | kOverlong4,
+	/* 1001 */	kTooLong | kOverlong2 | kTwoContinuations | kOverlong3 | kTooLarge,
+	/* 101_ */	kTooLong | kOverlong2 | kTwoContinuations | kSurrogate | kTooLarge,
+			kTooLong | kOverlong2 | kTwoContinuations | kSurrogate | kTooLarge,
+	/* 11__ */	kTooShort, kTooShort, kTooShort, kTooShort
+	};
+
+
+/*	gUTF8Incomplete
+	Largest byte that can end a block without leaving a sequence unfinished, by its position
+	from the end of the block
+*/
+static const uint8_t gUTF8Incomplete[32] = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xEF, 0xDF, 0xBF
+	};
+
+
+/*	FindSequenceStart
+	Back up from the given offset to the start of the sequence that it is in, if that is a
+	lead byte no more than three bytes before it
+*/
+static size_t FindSequenceStart(
+	const unsigned char *input,
+	size_t		offset
+	)
+{
+for (size_t back = 1; back <= 3 && back <= offset; back++) {
+	const unsigned char byte = input[offset - back];
+	if (byte >= 0xC0) return offset - back;
+	if (byte < 0x80) break;
+	}
+
+return offset;
+}
+
+
+/*	FinishUTF8
+	Find the first sequence that isn't well-formed from the block at the given offset on,
+	with the scalar check from the start of the sequence that it begins in
+*/
+static size_t FinishUTF8(
+	const unsigned char *input,
+	size_t		length,
+	size_t		offset,
+	bool		*truncated
+	)
+{
+const size_t start = FindSequenceStart(input, offset);
+
+return start + FindInvalidUTF8Scalar(input + start, length - start, truncated);
+}
+
+
+/*	FindInvalidUTF8SSE2
+	Offset of the first sequence that isn't well-formed UTF-8, skipping blocks of ASCII
+*/
+static size_t FindInvalidUTF8SSE2(
+	const unsigned char *input,
+	size_t		length,
+	bool		*truncated
+	)
+{
+size_t offset = 0;
+while (length - offset >= 16)
+	if (!_mm_movemask_epi8(_mm_loadu_si128((const __m128i*) (input + offset))))
+		offset += 16;
+	
+	// through the block, and any sequence that runs over its end
+	else {
+		bool cut;
+		const size_t found = offset + FindInvalidUTF8Scalar(input + offset, 16, &cut);
+		if (!cut && found < offset + 16) {
+			*truncated = false;
+			return found;
+			}
+		
+		offset = found;
+		}
+
+return offset + FindInvalidUTF8Scalar(input + offset, length - offset, truncated);
+}
+
+
+/*	FindInvalidUTF16SSE2
+	Offset of the first unit that isn't part of well-formed UTF-16, skipping blocks without
+	surrogates
+*/
+static size_t FindInvalidUTF16SSE2(
+	const unsigned char *input,
+	size_t		length,
+	bool		bigEndian,
+	bool		*truncated
+	)
+{
+// the high byte of each unit, whichever half of the lane it is in
+const __m128i
+	mask = _mm_set1_epi16(bigEndian ? 0x00F8 : (short) 0xF800),
+	surrogate = _mm_set1_epi16(bigEndian ? 0x00D8 : (short) 0xD800);
+
+size_t offset = 0;
+while (length - offset >= 16) {
+	const __m128i units = _mm_loadu_si128((const __m128i*) (input + offset));
+	if (!_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(units, mask), surrogate)))
+		offset += 16;
+	
+	// through the block, and any pair that runs over its end
+	else {
+		bool cut;
+		const size_t found = offset + FindInvalidUTF16Scalar(input + offset, 16, bigEndian, &cut);
+		if (!cut && found < offset + 16) {
+			*truncated = false;
+			return found;
+			}
+		
+		offset = found;
+		}
+	}
+
+return offset + FindInvalidUTF16Scalar(input + offset, length - offset, bigEndian, truncated);
+}
+
+
+/*	FindInvalidUTF8SSSE3
+	Offset of the first sequence that isn't well-formed UTF-8, checking sixteen bytes at a time
+*/
+TARGET_SSSE3
+static size_t FindInvalidUTF8SSSE3(
+	const unsigned char *input,
+	size_t		length,
+	bool		*truncated
+	)
+{
+const __m128i
+	byte1High = _mm_loadu_si128((const __m128i*) gUTF8Byte1High),
+	byte1Low = _mm_loadu_si128((const __m128i*) gUTF8Byte1Low),
+	byte2High = _mm_loadu_si128((const __m128i*) gUTF8Byte2High),
+	incompleteLimits = _mm_loadu_si128((const __m128i*) (gUTF8Incomplete + 16)),
+	nibble = _mm_set1_epi8(0x0F),
+	zero = _mm_setzero_si128();
+
+__m128i previous = zero, previousIncomplete = zero;
+size_t offset = 0;
+for (; length - offset >= 16; offset += 16) {
+	const __m128i current = _mm_loadu_si128((const __m128i*) (input + offset));
+	__m128i error;
+	
+	// all ASCII? then only a sequence left unfinished by the last block is wrong
+	if (!_mm_movemask_epi8(current)) {
+		error = previousIncomplete;
+		previousIncomplete = zero;
+		}
+	
+	else {
+		// each byte with the one, two and three before it
+		const __m128i
+			prev1 = _mm_alignr_epi8(current, previous, 15),
+			prev2 = _mm_alignr_epi8(current, previous, 14),
+			prev3 = _mm_alignr_epi8(current, previous, 13);
+		
+		// errors in each pair of bytes
+		const __m128i special = _mm_and_si128(
+			_mm_and_si128(
+				_mm_shuffle_epi8(byte1High, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+				_mm_shuffle_epi8(byte1Low, _mm_and_si128(prev1, nibble))
+				),
+			_mm_shuffle_epi8(byte2High, _mm_and_si128(_mm_srli_epi16(current, 4), nibble))
+			);
+		
+		// third and fourth bytes of three- and four-byte sequences must be continuations, and nothing else may be
+		const __m128i continuation = _mm_and_si128(
+			_mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8((char) (0xE0 - 0x80))), _mm_subs_epu8(prev3, _mm_set1_epi8((char) (0xF0 - 0x80)))),
+			_mm_set1_epi8((char) 0x80)
+			);
+		
+		error = _mm_xor_si128(continuation, special);
+		previousIncomplete = _mm_subs_epu8(current, incompleteLimits);
+		}
+	
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) != 0xFFFF) break;
+	previous = current;
+	}
+
+return FinishUTF8(input, length, offset, truncated);
+}
+
+
+/*	FindInvalidUTF8AVX2
+	Offset of the first sequence that isn't well-formed UTF-8, checking 32 bytes at a time
+*/
+TARGET_AVX2
+static size_t FindInvalidUTF8AVX2(
+	const unsigned char *input,
+	size_t		length,
+	bool		*truncated
+	)
+{
+const __m256i
+	byte1High = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) gUTF8Byte1High)),
+	byte1Low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) gUTF8Byte1Low)),
+	byte2High = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) gUTF8Byte2High)),
+	incompleteLimits = _mm256_loadu_si256((const __m256i*) gUTF8Incomplete),
+	nibble = _mm256_set1_epi8(0x0F),
+	zero = _mm256_setzero_si256();
+
+__m256i previous = zero, previousIncomplete = zero;
+size_t offset = 0;
+for (; length - offset >= 32; offset += 32) {
+	const __m256i current = _mm256_loadu_si256((const __m256i*) (input + offset));
+	__m256i error;
+	
+	// all ASCII? then only a sequence left unfinished by the last block is wrong
+	if (!_mm256_movemask_epi8(current)) {
+		error = previousIncomplete;
+		previousIncomplete = zero;
+		}
+	
+	else {
+		// each byte with the one, two and three before it, across the middle of the register
+		const __m256i
+			shifted = _mm256_permute2x128_si256(previous, current, 0x21),
+			prev1 = _mm256_alignr_epi8(current, shifted, 15),
+			prev2 = _mm256_alignr_epi8(current, shifted, 14),
+			prev3 = _mm256_alignr_epi8(current, shifted, 13);
+		
+		// errors in each pair of bytes
+		const __m256i special = _mm256_and_si256(
+			_mm256_and_si256(
+				_mm256_shuffle_epi8(byte1High, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+				_mm256_shuffle_epi8(byte1Low, _mm256_and_si256(prev1, nibble))
+				),
+			_mm256_shuffle_epi8(byte2High, _mm256_and_si256(_mm256_srli_epi16(current, 4), nibble))
+			);
+		
+		// third and fourth bytes of three- and four-byte sequences must be continuations, and nothing else may be
+		const __m256i continuation = _mm256_and_si256(
+			_mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8((char) (0xE0 - 0x80))), _mm256_subs_epu8(prev3, _mm256_set1_epi8((char) (0xF0 - 0x80)))),
+			_mm256_set1_epi8((char) 0x80)
+			);
+		
+		error = _mm256_xor_si256(continuation, special);
+		previousIncomplete = _mm256_subs_epu8(current, incompleteLimits);
+		}
+	
+	if (!_mm256_testz_si256(error, error)) break;
+	previous = current;
+	}
+
+return FinishUTF8(input, length, offset, truncated);
+}
+
+
+/*	FindInvalidUTF16AVX2
+	Offset of the first unit that isn't part of well-formed UTF-16, skipping blocks of sixteen
+	units without surrogates
+*/
+TARGET_AVX2
+static size_t FindInvalidUTF16AVX2(
+	const unsigned char *input,
+	size_t		length,
+	bool		bigEndian,
+	bool		*truncated
+	)
+{
+// the high byte of each unit, whichever half of the lane it is in
+const __m256i
+	mask = _mm256_set1_epi16(bigEndian ? 0x00F8 : (short) 0xF800),
+	surrogate = _mm256_set1_epi16(bigEndian ? 0x00D8 : (short) 0xD800);
+
+size_t offset = 0;
+while (length - offset >= 32) {
+	const __m256i units = _mm256_loadu_si256((const __m256i*) (input + offset));
+	if (!_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(units, mask), surrogate)))
+		offset += 32;
+	
+	// through the block, and any pair that runs over its end
+	else {
+		bool cut;
+		const size_t found = offset + FindInvalidUTF16Scalar(input + offset, 32, bigEndian, &cut);
+		if (!cut && found < offset + 32) {
+			*truncated = false;
+			return found;
+			}
+		
+		offset = found;
+		}
+	}
+
+return offset + FindInvalidUTF16Scalar(input + offset, length - offset, bigEndian, truncated);
+}
+
+
+/*	HasSSSE3, HasAVX2
+	Whether the processor (and for AVX2, the operating system) supports the instructions
+*/
+static bool HasSSSE3(void)
+{
+#ifdef _MSC_VER
+int registers[4];
+__cpuid(registers, 1);
+return (registers[2] & 1 << 9) != 0;
+
+#else
+return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+static bool HasAVX2(void)
+{
+#ifdef _MSC_VER
+int registers[4];
+
+// processor has OSXSAVE and AVX?
+__cpuid(registers, 1);
+if ((registers[2] & (1 << 27 | 1 << 28)) != (1 << 27 | 1 << 28)) return false;
+
+// operating system saves the YMM registers?
+if ((_xgetbv(0) & 6) != 6) return false;
+
+// processor has AVX2?
+__cpuidex(registers, 7, 0);
+return (registers[1] & 1 << 5) != 0;
+
+#else
+return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+
+/*	UTF8Function, UTF16Function
+	Signatures shared by the kernels for each encoding
+*/
+typedef size_t (*UTF8Function)(const unsigned char*, size_t, bool*);
+typedef size_t (*UTF16Function)(const unsigned char*, size_t, bool, bool*);
+
+
+/*	gValidateKernel
+	Kernels selected for this processor
+*/
+static struct {
+	const char	*name;
+	UTF8Function	utf8;
+	UTF16Function	utf16;
+	} gValidateKernel;
+
+
+/*	SelectValidateKernel
+	Choose the best kernels that this processor supports
+*/
+static void SelectValidateKernel(void)
+{
+#ifdef VALIDATE_X86
+if (HasAVX2()) {
+	gValidateKernel.utf8 = FindInvalidUTF8AVX2;
+	gValidateKernel.utf16 = FindInvalidUTF16AVX2;
+	gValidateKernel.name = "avx2";
+	}
+
+else if (HasSSSE3()) {
+	gValidateKernel.utf8 = FindInvalidUTF8SSSE3;
+	gValidateKernel.utf16 = FindInvalidUTF16SSE2;
+	gValidateKernel.name = "ssse3";
+	}
+
+else {
+	/* SSE2 is part of the x86-64 baseline */
+	gValidateKernel.utf8 = FindInvalidUTF8SSE2;
+	gValidateKernel.utf16 = FindInvalidUTF16SSE2;
+	gValidateKernel.name = "sse2";
+	}
+
+#else
+gValidateKernel.utf8 = FindInvalidUTF8Scalar;
+gValidateKernel.utf16 = FindInvalidUTF16Scalar;
+gValidateKernel.name = "scalar";
+#endif
+}
+
+
+/*	GetValidateKernelName
+	Name of the kernel that FindInvalid() dispatches to
+*/
+const char *GetValidateKernelName(void)
+{
+if (!gValidateKernel.name) SelectValidateKernel();
+
+return gValidateKernel.name;
+}
+
+
+/*	FindInvalid
+	Offset of the first sequence in the text that isn't well-formed in the given encoding
+*/
+size_t FindInvalid(
+	enum Encoding	encoding,
+	const char	*input,
+	size_t		length,
+	bool		*truncated
+	)
+{
+if (!gValidateKernel.name) SelectValidateKernel();
+
+const unsigned char *const bytes = (const unsigned char*) input;
+switch (encoding) {
+	case kEncodingUTF8:	return gValidateKernel.utf8(bytes, length, truncated);
+	case kEncodingUTF16LE:	return gValidateKernel.utf16(bytes, length, false, truncated);
+	case kEncodingUTF16BE:	return gValidateKernel.utf16(bytes, length, true, truncated);
+	case kEncodingUTF32LE:	return FindInvalidUTF32Scalar(bytes, length, truncated);
+	
+	/* any bytes will do */
+	default:
+		*truncated = false;
+		return length;
+	}
+}
+
+
+/*	StartValidator
+	Start checking a stream of text in the given encoding
+*/
+void StartValidator(
+	struct Validator *validator,
+	enum Encoding	encoding
+	)
+{
+validator->encoding = encoding;
+validator->offset = 0;
+validator->failed = false;
+validator->invalid = 0;
+validator->carried = 0;
+}
+
+
+/*	Validate
+	Check the next buffer of the stream
+*/
+bool Validate(
+	struct Validator *validator,
+	const char	*buffer,
+	size_t		length
+	)
+{
+if (validator->failed) return true;
+
+bool truncated;
+
+// finish the sequence carried over from the last buffer, a byte at a time
+while (validator->carried && length) {
+	validator->carry[validator->carried++] = (unsigned char) *buffer++;
+	length--;
+	
+	const size_t found = FindInvalid(validator->encoding, (const char*) validator->carry, validator->carried, &truncated);
+	if (found == validator->carried) {
+		validator->offset += validator->carried;
+		validator->carried = 0;
+		}
+	
+	else if (!truncated || validator->carried == sizeof validator->carry) {
+		validator->failed = true;
+		validator->invalid = validator->offset + found;
+		return true;
+		}
+	}
+
+/* the carried sequence may still be incomplete, and it is kept as it is */
+if (!length) return false;
+
+const size_t found = FindInvalid(validator->encoding, buffer, length, &truncated);
+if (found < length && !truncated) {
+	validator->failed = true;
+	validator->invalid = validator->offset + found;
+	return true;
+	}
+
+// keep a sequence cut short for the next buffer
+validator->offset += found;
+validator->carried = (unsigned int) (length - found);
+memcpy(validator->carry, buffer + found, validator->carried);
+
+return false;
+}
+
+
+/*	FinishValidator
+	End the stream
+*/
+bool FinishValidator(
+	struct Validator *validator
+	)
+{
+if (!validator->failed && validator->carried) {
+	validator->failed = true;
+	validator->invalid = validator->offset;
+	}
+
+return validator->failed;
+}
+
+
+/*	gInlineValidator
+	Validator that CheckOutput() hands the buffers to, if any
+*/
+static struct Validator *gInlineValidator;
+
+
+/*	StartInlineValidation
+	Have CheckOutput() hand every buffer to the validator
+*/
+void StartInlineValidation(
+	struct Validator *validator
+	)
+{
+gInlineValidator = validator;
+}
+
+
+/*	StopInlineValidation
+	Stop handing the buffers to the validator
+*/
+void StopInlineValidation(void)
+{
+gInlineValidator = NULL;
+}
+
+
+/*	CheckOutput
+	Check a buffer that the method is about to write
+*/
+bool CheckOutput(
+	const void	*buffer,
+	size_t		length
+	)
+{
+if (!gInlineValidator) return false;
+
+const bool failed = gInlineValidator->failed;
+if (!Validate(gInlineValidator, buffer, length)) return false;
+
+if (!failed)
+	fprintf(stderr, "error: output isn't well-formed %s at byte %llu; it wasn't written\n",
+		gEncodingNames[gInlineValidator->encoding], gInlineValidator->invalid
+		);
+
+return true;
+}
+
+
+/*	MeasureValidator
+	Throughput of the validator (bytes/s) on the given text
+*/
+static double MeasureValidator(
+	enum Encoding	encoding,
+	const char	*text,
+	size_t		length
+	)
+{
+unsigned long long bytes = 0;
+double elapsed;
+const double start = Now();
+do {
+	bool truncated;
+	if (FindInvalid(encoding, text, length, &truncated) != length) return 0;
+	bytes += length;
+	} while ((elapsed = Now() - start) < kValidateBenchSeconds);
+
+return bytes / elapsed;
+}
+
+
+/*	ReportInlineValidation
+	Print the result of inline validation
+*/
+bool ReportInlineValidation(
+	struct Validator *validator,
+	const struct Sample *sample,
+	enum Mode	mode,
+	double		elapsed
+	)
+{
+const enum Encoding encoding = validator->encoding;
+const unsigned long long checked = validator->offset + validator->carried;
+
+if (FinishValidator(validator)) {
+	fprintf(stderr, "validate: output isn't well-formed %s from byte %llu (0x%llx) of what the method wrote\n",
+		gEncodingNames[encoding], validator->invalid, validator->invalid
+		);
+	return true;
+	}
+
+if (!checked) {
+	fprintf(stderr, "warning: validate=inline: the method has no buffers of its own to check; validate the file instead\n");
+	return false;
+	}
+
+fprintf(stderr, "validate: %llu bytes of %s checked inline with the %s kernel: well-formed\n",
+	checked, gEncodingNames[encoding], GetValidateKernelName()
+	);
+
+// the share of the write that checking took, by the validator's throughput on the sample as it is written
+if (elapsed) {
+	const struct SampleText text = GetSampleText(sample, mode);
+	const char *bytes = text.units;
+	size_t length = text.length;
+	char *encoded = NULL;
+	if (text.width > 1) {
+		if (!(encoded = malloc(EncodeBound(encoding, text.length)))) {
+			fprintf(stderr, "error: can't allocate encoding buffer\n");
+			return true;
+			}
+		
+		length = EncodeUnits(encoding, text.units, text.width, text.length, encoded);
+		bytes = encoded;
+		}
+	
+	const double rate = MeasureValidator(encoding, bytes, length);
+	if (rate)
+		fprintf(stderr, "validate: %.2f GB/s (%.3f ns/byte); about %.1f%% of the write\n",
+			rate / 1e9, 1e9 / rate, checked / rate / elapsed * 100
+			);
+	
+	free(encoded);
+	}
+
+return false;
+}
+
+
+/*	CheckSplits
+	Hand the text to a Validator in buffers of random length, mostly of a few bytes so that
+	sequences are cut across several of them, and check that it finds what FindInvalid() does
+	on the text as a whole
+	Return whether they disagree
+*/
+static bool CheckSplits(
+	enum Encoding	encoding,
+	const char	*text,
+	size_t		length
+	)
+{
+if (length > kSplitCheckBytes) length = kSplitCheckBytes;
+
+bool truncated;
+const size_t found = FindInvalid(encoding, text, length, &truncated);
+
+struct Validator validator;
+StartValidator(&validator, encoding);
+
+// the same splits every run
+size_t buffers = 0;
+uint32_t state = 0x9e3779b9u;
+for (size_t offset = 0; offset < length;) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	
+	size_t piece = state % 4 ? state >> 8 & 3 : state >> 8 & 255;
+	if (piece > length - offset) piece = length - offset;
+	
+	buffers++;
+	if (Validate(&validator, text + offset, piece)) break;
+	offset += piece;
+	}
+
+const bool failed = FinishValidator(&validator);
+if (failed != (found < length) || (failed && validator.invalid != found)) {
+	fprintf(stderr, "error: validating %zu bytes in %zu buffers found %llu, but %zu as a whole\n",
+		length, buffers, failed ? validator.invalid : (unsigned long long) length, found
+		);
+	return true;
+	}
+
+fprintf(stderr, "validate: %zu bytes handed to the inline validator in %zu buffers of random length: it agrees\n", length, buffers);
+
+return false;
+}
+
+
+/*	ValidateFile
+	Check the given file in the given encoding
+*/
+bool ValidateFile(
+	const char	path[],
+	enum Encoding	encoding,
+	bool		withMark,
+	bool		splits
+	)
+{
+const char *view;
+size_t length;
+if (MapReadOnlyFile(path, true, &view, &length)) return true;
+
+// skip the byte order mark
+const char *mark;
+size_t markLength = withMark ? GetByteOrderMark(encoding, &mark) : 0;
+if (markLength > length || (markLength && memcmp(view, mark, markLength) != 0)) markLength = 0;
+
+bool truncated;
+const double start = Now();
+const size_t found = markLength + FindInvalid(encoding, view + markLength, length - markLength, &truncated);
+const double elapsed = Now() - start;
+
+const bool failed = found < length;
+if (failed)
+	fprintf(stderr, "validate: output isn't well-formed %s from byte %zu (0x%zx)%s\n",
+		gEncodingNames[encoding], found, found, truncated ? ", where it is cut short" : ""
+		);
+
+else
+	fprintf(stderr, "validate: output is well-formed %s (%zu bytes in %.3f ms, %.2f GB/s with the %s kernel)\n",
+		gEncodingNames[encoding], length, elapsed * 1e3, elapsed ? (length - markLength) / elapsed / 1e9 : 0, GetValidateKernelName()
+		);
+
+// cross-check the validator of inline validation?
+const bool disagrees = splits && CheckSplits(encoding, view + markLength, length - markLength);
+
+UnmapReadOnlyFile(view, length);
+
+return failed || disagrees;
+}
@@ -0,0 +1,121 @@
+/*
+	Validate.h
+	
+	Well-formedness checking of the output of
+	Encoding Explorer
+	
+	Copyright © 2023 by: Ben Hekster
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	The output can be checked inline, by the methods that have each buffer in hand before they
+	write it (see CheckOutput() in Encoding.h), or afterwards in the output file.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "Transcode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	Validator
+	Check of a stream of text in one encoding, handed over a buffer at a time
+*/
+struct Validator {
+	enum Encoding	encoding;
+	unsigned long long offset;		// bytes checked, up to the carried sequence
+	bool		failed;
+	unsigned long long invalid;		// if failed, offset of the first sequence that isn't well-formed
+	unsigned char	carry[4];		// sequence left incomplete at the end of the last buffer
+	unsigned int	carried;
+	};
+
+
+/*	GetEncodingName
+	Name of the encoding, for messages
+*/
+extern const char *GetEncodingName(enum Encoding);
+
+
+/*	GetValidateKernelName
+	Name of the kernel that FindInvalid() dispatches to ("avx2", "ssse3", "sse2" or "scalar")
+*/
+extern const char *GetValidateKernelName(void);
+
+
+/*	FindInvalid
+	Offset of the first sequence in the text that isn't well-formed in the given encoding
+	(UTF-8, UTF-16LE, UTF-16BE or UTF-32LE); 'truncated' tells whether it is only cut short by
+	the end of the text
+	Return the length if there is none
+*/
+extern size_t FindInvalid(enum Encoding, const char *input, size_t length, bool *truncated);
+
+
+/*	StartValidator
+	Start checking a stream of text in the given encoding
+*/
+extern void StartValidator(struct Validator*, enum Encoding);
+
+
+/*	Validate
+	Check the next buffer of the stream; a sequence cut short by its end is carried over to
+	the next
+	Return whether the stream isn't well-formed
+*/
+extern bool Validate(struct Validator*, const char *buffer, size_t length);
+
+
+/*	FinishValidator
+	End the stream, where a sequence still carried over is cut short
+	Return whether the stream isn't well-formed
+*/
+extern bool FinishValidator(struct Validator*);
+
+
+/*	StartInlineValidation, StopInlineValidation
+	Have CheckOutput() hand every buffer to the validator from now on; and stop
+*/
+extern void StartInlineValidation(struct Validator*);
+extern void StopInlineValidation(void);
+
+
+/*	ReportInlineValidation
+	Print the result of inline validation to standard error, with the share of the write that
+	it took by the validator's throughput on the sample as the given Mode writes it, if
+	'elapsed' isn't zero
+	Return whether the output wasn't well-formed
+*/
+extern bool ReportInlineValidation(struct Validator*, const struct Sample*, enum Mode, double elapsed);
+
+
+/*	ValidateFile
+	Check the given file in the given encoding, after its byte order mark if 'withMark', and
+	print the result and the time taken to standard error; if 'splits', also hand its first
+	1 MiB to a Validator in buffers of random length, and check that it agrees
+	Return whether the call failed, the file isn't well-formed, or the Validator disagrees
+*/
+extern bool ValidateFile(const char path[], enum Encoding, bool withMark, bool splits);
+
+
+#ifdef __cplusplus
+	}
+#endif
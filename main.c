@@ -22,7 +22,14 @@
 	
 	
 	Usage:
-		encexp method mode [cp####] [l####] [file]
+		encexp method mode [cp####] [l####] [file] [output=####] [bench[=####]] [input=####] [msync] [depth=####]
+		[buffer=####] [buffering=full|line|none] [sweep] [threads=####] [facet=standard|project] [chunk=####]
+		[batch=####] [messages=####] [interval=####] [fallocate] [direct] [sync=none|end|####|range|all] [datasync]
+		[dump=####] [verify[=####]] [validate[=inline|splits]] [counters] [syscalls] [latency[=####]] [pty]
+		encexp all [jobs=####] [locales=####,...] [codepages=####,...] [keep] [options...]
+		encexp locale [####...]
+		encexp codecvt [####]
+		encexp startup [runs=####] [options...]
 	
 	where method determines the API used to generate output:
 	
@@ -32,6 +39,13 @@
 		formatted	Formatted C I/O (fopen with fprintf/fwprintf)
 		unformatted++	Unformatted C++ I/O (ostream/wostream with .write())
 		formatted++	Formatted C++ I/O (ostream/wostream with operator<<())
+		simd		Vectorized transcoder (SSE2/AVX2) with binary _write
+		mmap		Encoding straight into the memory-mapped output file
+		io_uring	Asynchronous writes from registered buffers (Linux only)
+		streambuf	Unformatted C++ I/O through a stream buffer of our own that _writes directly
+		streambuf-formatted	Formatted C++ I/O through the same
+		iconv		Conversion by iconv() with binary _write (not the binary and text modes)
+		batch		Coalescing writer: messages gathered in an arena and written a batch at a time
 	
 	and mode is one of
 	
@@ -40,29 +54,161 @@
 		wide		Wide-character text
 		unicode		Narrow-character Unicode mode
 		wideunicode	Wide-character Unicode mode
+		char8		UTF-8 code units (char), written in binary as they are
+		char16		UTF-16 code units (char16_t), written in binary as UTF-8
+		char32		UTF-32 code units (char32_t), written in binary as UTF-8
 	
-	cp#### causes the Console Output Code Page to be set to #### (e.g. cp1252)
+	The wide modes hold the sample in wchar_t, which is UTF-16 on Windows but UTF-32 elsewhere;
+	the char8, char16 and char32 modes hold it in code units of the same width everywhere, and
+	bench reports the memory the sample takes in each, per character
+	
+	cp#### causes the Console Output Code Page to be set to #### (e.g. cp1252); where there
+	is no console to convert to it, the narrow modes instead write the sample exported from its
+	wide form into code page #### (437, 850, 866, 1250, 1251, 1252, 28591 or 65001), and with
+	bench report how fast that conversion goes each way
 	
 	l#### causes the locale to be set to #### (e.g. lC)
 	
 	file causes output to a file (named output) that is read back and printed
 	as hexadecimal bytes; if not specified, data is written to standard output
+	
+	pty attaches standard output to a pseudo-terminal instead (POSIX only), whose other end
+	a thread reads as fast as it can into the file, and reports what it received and how soon;
+	the file is then read back and verified as with file, but without a byte order mark
+	
+	output=#### names the file something other than output
+	
+	dump=#### limits the hexadecimal readback to the first #### bytes (and with bench,
+	asks for it); verify compares the file with the sample as the Mode encodes it, and
+	verify=#### with the contents of the file ####, reporting the first difference
+	
+	validate checks that the file is well-formed in the Mode's encoding (UTF-8 for the narrow
+	modes) and reports the offset of the first sequence that isn't; validate=inline checks
+	each buffer before the method writes it instead (the methods that have the bytes in hand:
+	posix, unformatted, formatted, simd, mmap, io_uring, streambuf, iconv and batch), failing the
+	write, and with bench reports what share of the write the check took;
+	validate=splits also hands the file to the inline validator in buffers of random
+	length, as a check that sequences cut across buffers are carried over
+	
+	bench repeats the write until #### bytes of input (default 1G; suffixes K, M and G
+	are accepted) have been handed to the method, and reports the throughput to standard
+	error instead of reading back the output; the methods that write through a sink (winapi,
+	posix, C and C++) open and close it outside the time measured, and report those separately
+	
+	latency=#### writes the sample #### times (default 1M; with bench, as many as that
+	takes), timing each write from the end of the previous one, and reports the mean, p50, p90,
+	p99, p99.9 and maximum to standard error instead of reading back the output
+	
+	input=#### writes the contents of the file #### instead of the built-in sample; it is
+	memory-mapped, and decoded from UTF-8 for the wide-character, char16 and char32 modes
+	
+	msync makes the mmap method flush the mapping to storage before closing it
+	
+	depth=#### sets the number of writes the io_uring method keeps in flight (default 8)
+	
+	chunk=#### sets the number of code units the iconv method converts at a time
+	(default 64K)
+	
+	batch=#### sets the size of the batch method's arena (default 64K), which goes out in a
+	single write (or writev, with a message too large for it) when the next message wouldn't
+	fit; messages=#### also writes it once it holds that many messages, and interval=#### once
+	its oldest has waited that many microseconds; each write of the sample is a message
+	
+	fallocate, direct and sync= make the output file of the posix, simd, iconv and batch
+	methods durable: fallocate allocates its blocks up front (Linux only), direct opens it
+	with O_DIRECT and writes it a whole number of aligned blocks at a time (the simd method
+	encoding straight into the aligned buffer), and sync= syncs it to storage never
+	(none, the default), at the end, every #### bytes and at the end, or starts writeback
+	of every 1M with sync_file_range() and waits for the previous (range, Linux only) and
+	syncs it at the end; with fsync(), or fdatasync() with datasync.  What the syncs took is
+	reported to standard error, and sync=all prints a table of the throughput (MB/s) and
+	the latency of each write under each policy to standard output
+	
+	counters counts the processor cycles, instructions, branch and cache misses and context
+	switches of the write with perf_event_open() (Linux only), and reports them to standard
+	error with instructions per cycle and the count per byte of input; where they can't be
+	counted the test runs without them
+	
+	syscalls reports the write(), writev(), fsync() and fdatasync() calls made on each file
+	descriptor during the write, with a histogram of their sizes, and warns of output written a
+	line at a time; it needs the interposer library preloaded (LD_PRELOAD=libencexp-syscalls.so),
+	and counts a single combination (not with all or startup)
+	
+	buffer=#### and buffering=full|line|none configure the stream buffer of the C, C++ and
+	streambuf methods (setvbuf, pubsetbuf); sweep measures the throughput of those methods across
+	buffer sizes of 512 bytes to 16M under each policy, writing to the file, and prints the
+	resulting table (MB/s) to standard output
+	
+	threads=#### has the C and C++ methods write the sample (16M, or as much as bench
+	asks for) to the one file from 1, 2, 4 and up to #### threads at once, sharing it by locked
+	fwrite (or fprintf), by a shared std::ofstream under a lock per write (C++ methods only), by
+	per-thread buffers written with fwrite_unlocked, by a synchronized stream per write (as std::osyncstream), and by per-thread buffers that a single
+	writer thread merges, and prints the throughput (MB/s) and share of the threads' time spent
+	waiting for the lock as a table to standard output
+	
+	all runs every method with every mode, locale (locales=; an empty entry means none)
+	and code page (codepages=) in worker processes, jobs=#### at a time (default: one
+	per processor); each writes to a file (output-#) and log (output-#.log) of its own,
+	which are removed afterwards unless keep is given.  The remaining options are passed on
+	to every worker, and a table of the results is printed to standard output; combinations
+	that can't run on this platform or by design are listed as n/a, and don't count
+	
+	startup runs every method with every mode runs=#### times (default 10), each as a new
+	process writing to a pipe, and prints a table to standard output of the time it took to
+	reach main(), to set up the locale and the output, to get the first byte of the write
+	through the pipe, and to exit; for the first run (cold, though the page cache isn't
+	dropped) and the median of the others (warm).  Combinations that can't run here, which
+	include the mmap and io_uring methods, are listed as n/a.  The remaining options are
+	passed on to every process (POSIX only).
+	
+	locale prints the time taken (ns) to construct each of the named locales (default: C
+	and the environment's, ), to look it up in the cache the C++ methods use, to compose it
+	with a codecvt facet, to imbue a stream with it, and to setlocale() it.
+	
+	facet=project has the C++ methods convert wide-character output with the project's own
+	codecvt facet, which converts the stream's whole buffer at once, instead of the standard
+	std::codecvt_utf8/std::codecvt_utf16 (facet=standard); codecvt compares the throughput
+	of the two on the contents of the file #### (or the built-in sample) in each encoding.
 */
 
 #define _CRT_SECURE_NO_WARNINGS
 
+#include <ctype.h>
 #include <locale.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+
 #define WIN32_LEAN_AND_MEAN
 
 #include <WINDOWS.H>
 #include <CONSOLEAPI.H>
 
+#else
+
+#include <time.h>
+
+#endif
+
+#include "CodePage.h"
+#include "Codecvt.h"
+#include "Counters.h"
+#include "Durable.h"
 #include "Encoding.h"
+#include "Latency.h"
+#include "Locales.h"
+#include "Matrix.h"
+#include "Readback.h"
+#include "Sample.h"
+#include "Startup.h"
+#include "Syscalls.h"
+#include "Terminal.h"
+#include "Threads.h"
+#include "Transcode.h"
+#include "Validate.h"
 
 
 /*	gMethodNames
@@ -75,7 +221,14 @@ static const char *const gMethodNames[] = {
 	"unformatted",
 	"formatted",
 	"unformatted++",
-	"formatted++"
+	"formatted++",
+	"simd",
+	"mmap",
+	"io_uring",
+	"streambuf",
+	"streambuf-formatted",
+	"iconv",
+	"batch"
 	};
 
 
@@ -89,10 +242,61 @@ static const bool gMethodUsesCLocale[] = {
 	true,
 	true,
 	false,
+	false,
+	false,
+	false,
+	false,
+	false,
+	false,
+	false,
+	false
+	};
+
+
+/*	gMethodHasSink
+	Whether the given API method writes through a Sink (see Encoding.h), which is opened
+	before the test and closed after it
+*/
+static const bool gMethodHasSink[] = {
+	false,
+	true,
+	true,
+	true,
+	true,
+	true,
+	true,
+	false,
+	false,
+	false,
+	false,
+	false,
+	false,
 	false
 	};
 
 
+/*	gMethodWritesOutputFile
+	Whether the given API method writes the output file through OpenOutputFile() (see
+	Encoding.h), and so can make it durable
+*/
+static const bool gMethodWritesOutputFile[] = {
+	false,
+	false,
+	true,
+	false,
+	false,
+	false,
+	false,
+	true,
+	false,
+	false,
+	false,
+	false,
+	true,
+	true
+	};
+
+
 /*	ParseMethod
 	Parse the given Method name string into its corresponding enumerator
 */
@@ -106,7 +310,7 @@ enum Method result = kMethodNone;
 for (
 	const char *const
 		*methodNamep = gMethodNames,
-		*const methodNamepe = gMethodNames + sizeof gMethodNames / sizeof *gMethodNames;
+		*const *const methodNamepe = gMethodNames + sizeof gMethodNames / sizeof *gMethodNames;
 	methodNamep < methodNamepe;
 	methodNamep++
 	)
@@ -128,7 +332,10 @@ static const char *const gModeNames[] = {
 	"text",
 	"wide",
 	"unicode",
-	"wideunicode"
+	"wideunicode",
+	"char8",
+	"char16",
+	"char32"
 	};
 
 
@@ -141,7 +348,10 @@ static const bool gModeIsWide[] = {
 	false,
 	true,
 	true,
-	true
+	true,
+	false,
+	false,
+	false
 	};
 
 
@@ -158,7 +368,7 @@ enum Mode result = kModeNone;
 for (
 	const char *const
 		*modeNamep = gModeNames,
-		*const modeNamepe = gModeNames + sizeof gModeNames / sizeof *gModeNames;
+		*const *const modeNamepe = gModeNames + sizeof gModeNames / sizeof *gModeNames;
 	modeNamep < modeNamepe;
 	modeNamep++
 	)
@@ -174,9 +384,342 @@ return result;
 /*	gFileName
 	Name of file used when not writing to standard output
 */
-const char gFileName[] = "output";
+const char *gFileName = "output";
+
+
+/*	kBenchmarkDefaultVolume
+	Number of input bytes written by 'bench' when no volume is given
+*/
+static const unsigned long long kBenchmarkDefaultVolume = 1ull << 30;
+
+
+/*	kLatencyDefaultWrites
+	Number of writes timed by 'latency' when no count is given
+*/
+static const unsigned long long kLatencyDefaultWrites = 1ull << 20;
 
 
+/*	kSweepDefaultVolume
+	Number of input bytes written at each point of a 'sweep' when no volume is given
+*/
+static const unsigned long long kSweepDefaultVolume = 16ull << 20;
+
+
+/*	kSweepSmallest, kSweepLargest
+	Range of stream buffer sizes covered by 'sweep', in steps of a factor of two
+*/
+static const size_t kSweepSmallest = 512, kSweepLargest = 16 << 20;
+
+
+
+/*	kURingDefaultDepth
+	Number of writes the io_uring method keeps in flight when no depth is given
+*/
+static const unsigned int kURingDefaultDepth = 8;
+
+
+/*	kIconvDefaultChunk
+	Number of wide characters the iconv method converts per call when no chunk size is given
+*/
+static const size_t kIconvDefaultChunk = 64 << 10;
+
+
+/*	kBatchDefaultBytes
+	Size of the batch method's arena when none is given
+*/
+static const size_t kBatchDefaultBytes = 64 << 10;
+
+
+/*	gDefaultLocales
+	Locales measured by 'locale' when none are named: the classic one and the environment's
+*/
+static const char *const gDefaultLocales[] = { "C", "" };
+
+
+/*	gBufferingNames
+	Command-line argument names for stream buffering policies
+*/
+static const char *const gBufferingNames[] = {
+	"",
+	"full",
+	"line",
+	"none"
+	};
+
+
+/*	ParseBuffering
+	Parse the given buffering policy name into its corresponding enumerator
+*/
+static enum BufferingPolicy ParseBuffering(
+	const char	arg[]
+	)
+{
+enum BufferingPolicy result = kBufferingDefault;
+
+// find its offset in the list
+for (
+	const char *const
+		*namep = gBufferingNames,
+		*const *const namepe = gBufferingNames + sizeof gBufferingNames / sizeof *gBufferingNames;
+	namep < namepe;
+	namep++
+	)
+	if (strcmp(arg, *namep) == 0) {
+		result = namep - gBufferingNames;
+		break;
+		}
+
+return result;
+}
+
+
+/*	Options
+	Settings from the command line that only apply to particular Methods
+*/
+struct Options {
+	bool		sync;			// mmap: flush mapping before closing
+	unsigned int	depth;			// io_uring: writes kept in flight
+	struct Buffering buffering;		// C and C++: stream buffer
+	enum Facet	facet;			// C++: wide-character conversion facet
+	size_t		chunk;			// iconv: characters per conversion
+	struct Batching	batching;		// batch: when to write
+	};
+
+
+/*	ParseVolume
+	Parse a byte count with optional binary K, M or G suffix
+	Return zero if the string isn't a valid volume
+*/
+static unsigned long long ParseVolume(
+	const char	arg[]
+	)
+{
+char *end;
+unsigned long long result = strtoull(arg, &end, 10);
+
+switch (*end) {
+	case 'G': case 'g':	result <<= 10;	/* fall through */
+	case 'M': case 'm':	result <<= 10;	/* fall through */
+	case 'K': case 'k':	result <<= 10; end++;
+	}
+
+// anything left over makes it invalid
+return *end ? 0 : result;
+}
+
+
+/*	Now
+	Monotonic clock in seconds
+*/
+double Now(void)
+{
+#ifdef _WIN32
+static LARGE_INTEGER frequency;
+if (!frequency.QuadPart) QueryPerformanceFrequency(&frequency);
+
+LARGE_INTEGER counter;
+QueryPerformanceCounter(&counter);
+
+return (double) counter.QuadPart / frequency.QuadPart;
+
+#else
+struct timespec now;
+clock_gettime(CLOCK_MONOTONIC, &now);
+
+return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+
+/*	GetSampleBytes
+	Size in memory of the form of the sample that the Mode writes
+*/
+static size_t GetSampleBytes(
+	const struct Sample *sample,
+	enum Mode	mode
+	)
+{
+const struct SampleText text = GetSampleText(sample, mode);
+
+return text.length * text.width;
+}
+
+
+/*	CountCodePoints
+	Number of characters in the given code units, counting each sequence or surrogate pair once
+*/
+static size_t CountCodePoints(
+	const struct SampleText *text
+	)
+{
+size_t count = 0;
+
+switch (text->width) {
+	case 1:
+		for (size_t i = 0; i < text->length; i++) count += (((const unsigned char*) text->units)[i] & 0xC0) != 0x80;
+		break;
+	
+	case 2:
+		for (size_t i = 0; i < text->length; i++) count += (((const char16_t*) text->units)[i] & 0xFC00) != 0xDC00;
+		break;
+	
+	default:
+		count = text->length;
+		break;
+	}
+
+return count;
+}
+
+
+/*	ReportBenchmark
+	Print throughput of a completed benchmark run, and the time taken to open and close its sink
+*/
+static void ReportBenchmark(
+	enum Method	method,
+	enum Mode	mode,
+	const struct Sample *sample,
+	size_t		repeat,
+	double		elapsed,
+	double		setup,
+	double		teardown
+	)
+{
+// volume as presented to the method
+/* the char8, char16 and char32 modes count characters rather than code units, to compare them */
+const struct SampleText text = GetSampleText(sample, mode);
+const size_t sampleCharacters = IsCodeUnitMode(mode) ? CountCodePoints(&text) : text.length;
+const unsigned long long
+	characters = (unsigned long long) repeat * sampleCharacters,
+	bytes = (unsigned long long) repeat * text.length * text.width;
+
+fprintf(stderr,
+	"bench: %s %s: %llu bytes (%llu characters) in %.3f s: %.1f MB/s, %.1f Mchar/s, %.2f ns/char\n",
+	gMethodNames[method], gModeNames[mode],
+	bytes, characters, elapsed,
+	bytes / elapsed / 1e6, characters / elapsed / 1e6, elapsed * 1e9 / characters
+	);
+
+// the methods with a sink open and close their output outside the time measured
+if (gMethodHasSink[method])
+	fprintf(stderr,
+		"bench: %s %s: opening %.3f ms, closing %.3f ms (not included above)\n",
+		gMethodNames[method], gModeNames[mode], setup * 1e3, teardown * 1e3
+		);
+
+// memory the sample takes at this width
+if (IsCodeUnitMode(mode) && sampleCharacters)
+	fprintf(stderr,
+		"bench: %s %s: %zu-bit code units, %zu bytes in memory for %zu characters (%.2f bytes/char)\n",
+		gMethodNames[method], gModeNames[mode],
+		text.width * 8, text.length * text.width, sampleCharacters, (double) (text.length * text.width) / sampleCharacters
+		);
+}
+
+
+
+/*	CountLines
+	Number of line feeds in the form of the sample that the Mode writes
+*/
+static unsigned long long CountLines(
+	const struct Sample *sample,
+	enum Mode	mode
+	)
+{
+unsigned long long lines = 0;
+
+const struct SampleText text = GetSampleText(sample, mode);
+switch (text.width) {
+	case 1:
+		for (size_t i = 0; i < text.length; i++) lines += ((const char*) text.units)[i] == '\n';
+		break;
+	
+	case 2:
+		for (size_t i = 0; i < text.length; i++) lines += ((const char16_t*) text.units)[i] == '\n';
+		break;
+	
+	default:
+		for (size_t i = 0; i < text.length; i++) lines += ((const char32_t*) text.units)[i] == '\n';
+		break;
+	}
+
+return lines;
+}
+
+
+/*	kCodePageBenchSeconds
+	Minimum time spent measuring each direction of the code page conversion
+*/
+static const double kCodePageBenchSeconds = 0.2;
+
+
+/*	ExportSample
+	Stand in for the Console Output Code Page where there is no console: make the narrow form of
+	the sample its wide form encoded in the code page, as a legacy export would; with 'bench',
+	also measure how fast that goes, and decoding it again
+	Return whether the function failed
+*/
+static bool ExportSample(
+	unsigned int	codePage,
+	struct Sample	*sample,
+	bool		bench,
+	char		**exported
+	)
+{
+if (!IsCodePageKnown(codePage)) {
+	fprintf(stderr, "error: no table for code page %u (known: %s)\n", codePage, gCodePageNames);
+	return true;
+	}
+
+/* one more byte, so that an empty sample still allocates */
+if (!(*exported = malloc(CodePageBound(codePage, sample->wideLength) + 1))) {
+	fprintf(stderr, "error: can't allocate code page buffer\n");
+	return true;
+	}
+
+size_t unmappable;
+sample->narrow = *exported;
+sample->narrowLength = EncodeCodePage(codePage, sample->wide, sample->wideLength, *exported, &unmappable);
+fprintf(stderr, "info: sample exported to code page %u (%zu characters not in it written as '?')\n", codePage, unmappable);
+
+if (!bench || !sample->wideLength) return false;
+
+wchar_t *const decoded = malloc((sample->narrowLength + 1) * sizeof *decoded);
+if (!decoded) {
+	fprintf(stderr, "error: can't allocate code page buffer\n");
+	return true;
+	}
+
+// encode repeatedly
+unsigned long long encodes = 0;
+double start = Now(), encodeElapsed;
+do {
+	EncodeCodePage(codePage, sample->wide, sample->wideLength, *exported, NULL);
+	encodes++;
+	} while ((encodeElapsed = Now() - start) < kCodePageBenchSeconds);
+
+// decode repeatedly
+unsigned long long decodes = 0;
+size_t decodedLength;
+double decodeElapsed;
+start = Now();
+do {
+	decodedLength = DecodeCodePage(codePage, sample->narrow, sample->narrowLength, decoded);
+	decodes++;
+	} while ((decodeElapsed = Now() - start) < kCodePageBenchSeconds);
+
+fprintf(stderr,
+	"codepage: cp%u: encode %.1f Mchar/s (%.2f ns/char), decode %.1f Mchar/s (%.2f ns/char)\n",
+	codePage,
+	encodes * sample->wideLength / encodeElapsed / 1e6, encodeElapsed * 1e9 / (encodes * sample->wideLength),
+	decodes * decodedLength / decodeElapsed / 1e6, decodeElapsed * 1e9 / (decodes * decodedLength)
+	);
+
+free(decoded);
+
+return false;
+}
+
 
 /*	Test
 	Test specified configuration
@@ -186,10 +729,18 @@ static bool Test(
 	bool		standardOutput,
 	enum Method	method,
 	enum Mode	mode,
-	UINT		codePage,
-	const char	*locale
+	unsigned int	codePage,
+	const char	*locale,
+	const struct Sample *sample,
+	size_t		repeat,
+	const struct Options *options,
+	struct Counters	*counters,
+	double		*elapsed,
+	double		*setup,
+	double		*teardown
 	)
 {
+#ifdef _WIN32
 // print console code page status before setting it
 DWORD ccp, cocp;
 if ((ccp = GetConsoleCP()) != 437)
@@ -208,6 +759,12 @@ if (codePage) {
 	SetConsoleOutputCP(codePage);
 	}
 
+#else
+// only Windows consoles have a code page; the narrow modes' sample was exported to it instead
+if (codePage && (gModeIsWide[mode] || IsCodeUnitMode(mode)))
+	fprintf(stderr, "warning: cp#### only affects the binary and text modes on this platform\n");
+#endif
+
 // set C locale globally (C++ locale is set on the specific stream object)
 if (locale && gMethodUsesCLocale[method])
 	if (!setlocale(LC_ALL, locale)) {
@@ -218,17 +775,50 @@ if (locale && gMethodUsesCLocale[method])
 // is wide-character input mode?
 const bool isWideMode = gModeIsWide[mode];
 
+// open the output ahead of the test, for the methods that keep it in a sink
+/* so that only the writes, and the final flush, are measured */
+struct Sink *sink = NULL;
+*setup = *teardown = 0;
+if (gMethodHasSink[method]) {
+	const struct SinkOptions sinkOptions = { standardOutput, locale, options->facet, options->buffering };
+	const double opening = Now();
+	if (!(sink = CreateSink(method, mode, &sinkOptions))) return true;
+	*setup = Now() - opening;
+	}
+
 // run test based on requested method
-bool result;
+if (counters) StartCounters(counters);
+const double start = Now();
+bool result = true;
 switch (method) {
-	case kMethodWindowsAPI:		result = TestWindowsAPI(standardOutput, mode); break;
-	case kMethodPOSIX:		result = TestPOSIX(standardOutput, mode, isWideMode); break;
-	case kMethodCUnformatted:	result = TestC(standardOutput, mode, isWideMode, false); break;
-	case kMethodCFormatted:		result = TestC(standardOutput, mode, isWideMode, true); break;
-	case kMethodCPPUnformatted:	result = TestCPlusPlusStream(standardOutput, mode, isWideMode, locale, false); break;
-	case kMethodCPPFormatted:	result = TestCPlusPlusStream(standardOutput, mode, isWideMode, locale, true); break;
-	} if (result) return true;
+	case kMethodWindowsAPI:
+	case kMethodPOSIX:
+	case kMethodCUnformatted:
+	case kMethodCFormatted:
+	case kMethodCPPUnformatted:
+	case kMethodCPPFormatted:	result = TestSink(sink, sample, repeat); break;
+	case kMethodSIMD:		result = TestSIMD(standardOutput, mode, sample, repeat); break;
+	case kMethodMmap:		result = TestMmap(standardOutput, mode, sample, repeat, options->sync); break;
+	case kMethodURing:		result = TestURing(standardOutput, mode, sample, repeat, options->depth); break;
+	case kMethodStreambuf:		result = TestStreambuf(standardOutput, mode, isWideMode, locale, false, &options->buffering, sample, repeat); break;
+	case kMethodStreambufFormatted:	result = TestStreambuf(standardOutput, mode, isWideMode, locale, true, &options->buffering, sample, repeat); break;
+	case kMethodIconv:		result = TestIconv(standardOutput, mode, sample, repeat, options->chunk); break;
+	case kMethodBatch:		result = TestBatch(standardOutput, mode, sample, repeat, &options->batching); break;
+	
+	default:
+		fprintf(stderr, "error: no test for this method\n");
+		break;
+	}
+*elapsed = Now() - start;
+if (counters) StopCounters(counters);
+if (sink) {
+	const double closing = Now();
+	result |= DestroySink(sink);
+	*teardown = Now() - closing;
+	}
+if (result) return true;
 
+#ifdef _WIN32
 // print console code page status after setting it
 if ((ccp = GetConsoleCP()) != 437)
 	fprintf(stderr, "info: console code page is now %d\n", ccp);
@@ -237,11 +827,268 @@ if ((cocp = GetConsoleOutputCP()) != 437)
 	   Console Output Code Page; whereas in Command Prompt it affects both.
 	   Still have no idea what effect the Console Code Page has. */
 	fprintf(stderr, "info: console output code page is now %d\n", cocp);
+#endif
+
+return false;
+}
+
+
+/*	GetRepeat
+	Number of times to write the sample to hand the given volume to the method
+*/
+static size_t GetRepeat(
+	const struct Sample *sample,
+	enum Mode	mode,
+	unsigned long long volume
+	)
+{
+const size_t sampleBytes = GetSampleBytes(sample, mode);
+
+return (size_t) ((volume + sampleBytes - 1) / sampleBytes);
+}
+
+
+/*	Sweep
+	Measure a C or C++ method across stream buffer sizes and policies
+	Return whether the function failed
+*/
+static bool Sweep(
+	bool		standardOutput,
+	enum Method	method,
+	enum Mode	mode,
+	unsigned int	codePage,
+	const char	*locale,
+	const struct Sample *sample,
+	unsigned long long volume,
+	struct Options	options
+	)
+{
+switch (method) {
+	case kMethodCUnformatted:
+	case kMethodCFormatted:
+	case kMethodCPPUnformatted:
+	case kMethodCPPFormatted:
+	case kMethodStreambuf:
+	case kMethodStreambufFormatted:
+		break;
+	
+	default:
+		fprintf(stderr, "error: sweep applies only to the unformatted, formatted, unformatted++, formatted++ and streambuf methods\n");
+		return true;
+	}
+
+/* The table goes to standard output, and buffering can only be set before its first use */
+if (standardOutput) {
+	fprintf(stderr, "error: sweep requires the 'file' option\n");
+	return true;
+	}
+
+const size_t repeat = GetRepeat(sample, mode, volume);
+const double bytes = (double) repeat * GetSampleBytes(sample, mode);
+double elapsed, setup, teardown;
+
+// unbuffered doesn't depend on the size
+options.buffering = (struct Buffering) { kBufferingNone, 0 };
+if (Test(standardOutput, method, mode, codePage, locale, sample, repeat, &options, NULL, &elapsed, &setup, &teardown)) return true;
+const double unbuffered = bytes / elapsed / 1e6;
+
+printf("# %s %s: MB/s of input by stream buffer size and policy\n", gMethodNames[method], gModeNames[mode]);
+printf("%10s %10s %10s %10s\n", "buffer", "full", "line", "none");
+
+for (size_t size = kSweepSmallest; size <= kSweepLargest; size <<= 1) {
+	double throughput[2];
+	for (enum BufferingPolicy policy = kBufferingFull; policy <= kBufferingLine; policy++) {
+		options.buffering = (struct Buffering) { policy, size };
+		if (Test(standardOutput, method, mode, codePage, locale, sample, repeat, &options, NULL, &elapsed, &setup, &teardown)) return true;
+		throughput[policy - kBufferingFull] = bytes / elapsed / 1e6;
+		}
+	
+	printf("%10zu %10.1f %10.1f %10.1f\n", size, throughput[0], throughput[1], unbuffered);
+	fflush(stdout);
+	}
+
+return false;
+}
+
+
+/*	GetOutputBytes
+	Size that the output file is expected to reach, the sample being written the given number
+	of times as the Mode encodes it
+*/
+static unsigned long long GetOutputBytes(
+	const struct Sample *sample,
+	enum Mode	mode,
+	size_t		repeat
+	)
+{
+const struct SampleText text = GetSampleText(sample, mode);
+const enum Encoding encoding = text.width > 1 ? gModeEncodings[mode] : kEncodingNone;
+const char *mark;
+
+return GetModeByteOrderMark(mode, &mark) +
+	(unsigned long long) repeat * (encoding ? EncodeUnitsLength(encoding, text.units, text.width, text.length) : text.length);
+}
+
+
+/*	SweepDurability
+	Measure a method that writes the output file under each sync policy
+	Return whether the function failed
+*/
+static bool SweepDurability(
+	enum Method	method,
+	enum Mode	mode,
+	unsigned int	codePage,
+	const char	*locale,
+	const struct Sample *sample,
+	unsigned long long volume,
+	const struct Options *options,
+	struct Durability durability
+	)
+{
+const size_t repeat = GetRepeat(sample, mode, volume);
+const double bytes = (double) repeat * GetSampleBytes(sample, mode);
+durability.expected = GetOutputBytes(sample, mode, repeat);
+
+printf("# %s %s: MB/s of input, and latency of each write (us), by sync policy", gMethodNames[method], gModeNames[mode]);
+if (durability.preallocate) printf(", with fallocate");
+if (durability.direct) printf(", with O_DIRECT");
+printf("; %s, every %zu bytes\n", durability.data ? "fdatasync" : "fsync", durability.interval);
+printf("%8s %10s %10s %10s %10s %10s %8s %10s\n", "sync", "MB/s", "p50", "p99", "p99.9", "max", "syncs", "sync ms");
+
+static struct Histogram latency;
+for (enum SyncPolicy policy = kSyncNone; policy < kSyncPolicies; policy++) {
+	durability.policy = policy;
+	
+	double elapsed, setup, teardown;
+	struct DurableStatistics statistics;
+	StartLatency(&latency);
+	StartDurability(&durability);
+	const bool failed = Test(false, method, mode, codePage, locale, sample, repeat, options, NULL, &elapsed, &setup, &teardown);
+	StopDurability(&statistics);
+	StopLatency();
+	if (failed) return true;
+	
+	printf("%8s %10.1f %10.1f %10.1f %10.1f %10.1f %8llu %10.3f\n",
+		gSyncPolicyNames[policy], bytes / elapsed / 1e6,
+		GetPercentile(&latency, 0.5) / 1e3, GetPercentile(&latency, 0.99) / 1e3, GetPercentile(&latency, 0.999) / 1e3, latency.max / 1e3,
+		statistics.syncs, statistics.syncing * 1e3
+		);
+	fflush(stdout);
+	}
 
 return false;
 }
 
 
+/*	NamesUTF8Locale
+	Whether the locale name asks for UTF-8 (C.UTF-8, en_US.utf8, .65001 and the like)
+*/
+static bool NamesUTF8Locale(
+	const char	*locale
+	)
+{
+if (!locale) return false;
+
+for (const char *c = locale; *c; c++)
+	if (tolower(c[0]) == 'u' && tolower(c[1]) == 't' && tolower(c[2]) == 'f' && (c[3] == '8' || (c[3] == '-' && c[4] == '8')))
+		return true;
+
+return strstr(locale, "65001") != NULL;
+}
+
+
+/*	GetWrittenEncoding
+	Encoding that the Method writes the Mode's wide characters or code units in, in the
+	locale, and whether a file of it starts with a byte order mark; the narrow modes pass the
+	sample through, which is taken to be UTF-8
+	Return false if it can't be known
+*/
+static bool GetWrittenEncoding(
+	enum Method	method,
+	enum Mode	mode,
+	const char	*locale,
+	enum Encoding	*encoding,
+	bool		*withMark
+	)
+{
+// the C++ streams' 'wide' mode isn't emulated; it writes the locale's multibyte characters
+if ((method == kMethodCPPUnformatted || method == kMethodCPPFormatted) && mode == kModeWide) {
+	*encoding = kEncodingUTF8;
+	*withMark = false;
+	return NamesUTF8Locale(locale);
+	}
+
+*encoding = gModeEncodings[mode] ? gModeEncodings[mode] : kEncodingUTF8;
+*withMark = true;
+return true;
+}
+
+
+/*	IsSupported
+	Whether the Method can write the Mode in the locale, if any, on this platform at all;
+	winapi only runs on Windows, and its Console APIs ('text' and 'wide') only to a console;
+	io_uring and iconv only where they were built, and iconv has no encoding to convert the
+	binary and text modes to; the C++ methods' 'wide' mode converts through the locale, which
+	only a UTF-8 one can do for any sample; and their 'wide unicode' mode sets its own locale
+*/
+static bool IsSupported(
+	enum Method	method,
+	enum Mode	mode,
+	const char	*locale
+	)
+{
+switch (method) {
+	case kMethodWindowsAPI:
+#ifdef _WIN32
+		return mode != kModeText && mode != kModeWide;
+#else
+		return false;
+#endif
+	
+	case kMethodURing:	return IsURingAvailable();
+	case kMethodIconv:	return IsIconvAvailable() && gModeEncodings[mode] != kEncodingNone;
+	
+	case kMethodCPPUnformatted:
+	case kMethodCPPFormatted:
+		if (mode == kModeWide && !NamesUTF8Locale(locale)) return false;
+		/* fall through */
+	
+	case kMethodStreambuf:
+	case kMethodStreambufFormatted:	return !(mode == kModeWideUnicode && locale);
+	
+	default:		return true;
+	}
+}
+
+
+/*	IsMatrixSupported
+	IsSupported() by the offsets of the Method and Mode names that 'all' is given
+*/
+static bool IsMatrixSupported(
+	size_t		method,
+	size_t		mode,
+	const char	*locale
+	)
+{
+return IsSupported((enum Method) (method + 1), (enum Mode) (mode + 1), locale);
+}
+
+
+/*	IsStartupSupported
+	Likewise for 'startup', which writes to a pipe that the mmap and io_uring methods can't
+*/
+static bool IsStartupSupported(
+	size_t		method,
+	size_t		mode,
+	const char	*locale
+	)
+{
+return
+	IsMatrixSupported(method, mode, locale) &&
+	method + 1 != kMethodMmap && method + 1 != kMethodURing;
+}
+
+
 /*	main
 	Command-line entry point
 */
@@ -250,21 +1097,78 @@ int main(
 	const char	*argv[]
 	)
 {
+/* for the startup harness */
+const double entered = Now();
+
+// run the entire matrix?
+if (argc > 1 && strcmp(argv[1], "all") == 0)
+	return RunMatrix(
+		argv[0],
+		gMethodNames + 1, sizeof gMethodNames / sizeof *gMethodNames - 1,
+		gModeNames + 1, sizeof gModeNames / sizeof *gModeNames - 1,
+		IsMatrixSupported,
+		argc - 2, argv + 2
+		) ? -1 : 0;
+
+// measure process startup?
+if (argc > 1 && strcmp(argv[1], "startup") == 0)
+	return RunStartup(
+		argv[0],
+		gMethodNames + 1, sizeof gMethodNames / sizeof *gMethodNames - 1,
+		gModeNames + 1, sizeof gModeNames / sizeof *gModeNames - 1,
+		IsStartupSupported,
+		argc - 2, argv + 2
+		) ? -1 : 0;
+
+// measure the cost of setting up locales?
+if (argc > 1 && strcmp(argv[1], "locale") == 0)
+	return (argc > 2 ?
+		BenchmarkLocales(argv + 2, argc - 2) :
+		BenchmarkLocales(gDefaultLocales, sizeof gDefaultLocales / sizeof *gDefaultLocales)
+		) ? -1 : 0;
+
+// compare the codecvt facets?
+if (argc > 1 && strcmp(argv[1], "codecvt") == 0) {
+	struct Sample sample = gDefaultSample;
+	const bool failed =
+		(argc > 2 && (OpenSampleFile(&sample, argv[2]) || DecodeSampleWide(&sample))) ||
+		BenchmarkCodecvt(&sample);
+	CloseSample(&sample);
+	return failed ? -1 : 0;
+	}
+
 bool standardOutput = true;
-UINT codePage = 0;
+unsigned int codePage = 0;
 const char *locale = NULL;
+unsigned long long benchVolume = 0;
+const char *input = NULL;
+struct Options options = { false, kURingDefaultDepth, { kBufferingDefault, 0 }, kFacetStandard, kIconvDefaultChunk, { kBatchDefaultBytes, 0, 0 } };
+bool sweep = false;
+struct Durability durability = { false, false, false, kSyncNone, kSyncDefaultInterval, 0 };
+bool syncSweep = false;
+unsigned int threads = 0;
+unsigned long long dumpLimit = 0;
+bool verify = false;
+const char *expected = NULL;
+bool validate = false;
+bool validateInline = false;
+bool validateSplits = false;
+bool count = false;
+bool countSyscalls = false;
+unsigned long long latencyWrites = 0;
+bool pty = false;
 
 // first argument is method
 const enum Method method = argc > 1 ? ParseMethod((--argc, *++argv)) : kMethodNone;
 if (method == kMethodNone) {
-	fprintf(stderr, "error: first argument must be one of: winapi, posix, unformatted, formatted, unformatted++, formatted++\n");
+	fprintf(stderr, "error: first argument must be one of: winapi, posix, unformatted, formatted, unformatted++, formatted++, simd, mmap, io_uring, streambuf, streambuf-formatted, iconv, batch (or all, locale, codecvt, startup)\n");
 	return -1;
 	}
 
 // second argument is format
 const enum Mode mode = argc > 1 ? ParseMode((--argc, *++argv)) : kModeNone;
 if (mode == kModeNone) {
-	fprintf(stderr, "error: second argument must be one of: binary, text, wide, unicode, wideunicode\n");
+	fprintf(stderr, "error: second argument must be one of: binary, text, wide, unicode, wideunicode, char8, char16, char32\n");
 	return -1;
 	}
 
@@ -276,6 +1180,15 @@ for (const char *arg; arg = *(--argc, ++argv); )
 			fprintf(stderr, "warning: option cp#### needs code page number\n");
 		}
 	
+	// per-write latency? (before the locale, which it would otherwise be taken for)
+	else if (strncmp(arg, "latency", 7) == 0) {
+		if (arg[7] == '\0')
+			latencyWrites = kLatencyDefaultWrites;
+		
+		else if (arg[7] != '=' || (latencyWrites = ParseVolume(arg + 8)) == 0)
+			fprintf(stderr, "warning: option latency=#### needs a number of writes\n");
+		}
+	
 	// locale?
 	else if (strncmp(arg, "l", 1) == 0)
 		locale = arg + 1;
@@ -284,29 +1197,379 @@ for (const char *arg; arg = *(--argc, ++argv); )
 	else if (strcmp(arg, "file") == 0)
 		standardOutput = false;
 	
+	// output into pseudo-terminal?
+	else if (strcmp(arg, "pty") == 0)
+		pty = true;
+	
+	// name of file?
+	else if (strncmp(arg, "output=", 7) == 0)
+		gFileName = arg + 7;
+	
+	// benchmark?
+	else if (strncmp(arg, "bench", 5) == 0) {
+		if (arg[5] == '\0')
+			benchVolume = kBenchmarkDefaultVolume;
+		
+		else if (arg[5] != '=' || (benchVolume = ParseVolume(arg + 6)) == 0)
+			fprintf(stderr, "warning: option bench=#### needs a byte count\n");
+		}
+	
+	// input corpus?
+	else if (strncmp(arg, "input=", 6) == 0)
+		input = arg + 6;
+	
+	// flush memory-mapped output?
+	else if (strcmp(arg, "msync") == 0)
+		options.sync = true;
+	
+	// io_uring queue depth?
+	else if (strncmp(arg, "depth=", 6) == 0) {
+		if ((options.depth = strtoul(arg + 6, NULL, 10)) == 0) {
+			fprintf(stderr, "warning: option depth=#### needs a queue depth\n");
+			options.depth = kURingDefaultDepth;
+			}
+		}
+	
+	// iconv chunk size?
+	else if (strncmp(arg, "chunk=", 6) == 0) {
+		if ((options.chunk = (size_t) ParseVolume(arg + 6)) == 0) {
+			fprintf(stderr, "warning: option chunk=#### needs a number of characters\n");
+			options.chunk = kIconvDefaultChunk;
+			}
+		}
+	
+	// batch arena size?
+	else if (strncmp(arg, "batch=", 6) == 0) {
+		if ((options.batching.bytes = (size_t) ParseVolume(arg + 6)) == 0) {
+			fprintf(stderr, "warning: option batch=#### needs a byte count\n");
+			options.batching.bytes = kBatchDefaultBytes;
+			}
+		}
+	
+	// batch message count?
+	else if (strncmp(arg, "messages=", 9) == 0) {
+		if ((options.batching.messages = strtoul(arg + 9, NULL, 10)) == 0)
+			fprintf(stderr, "warning: option messages=#### needs a number of messages\n");
+		}
+	
+	// batch timer?
+	else if (strncmp(arg, "interval=", 9) == 0) {
+		if ((options.batching.interval = strtoul(arg + 9, NULL, 10) / 1e6) == 0)
+			fprintf(stderr, "warning: option interval=#### needs a number of microseconds\n");
+		}
+	
+	// preallocate the output file?
+	else if (strcmp(arg, "fallocate") == 0)
+		durability.preallocate = true;
+	
+	// bypass the page cache?
+	else if (strcmp(arg, "direct") == 0)
+		durability.direct = true;
+	
+	// sync with fdatasync()?
+	else if (strcmp(arg, "datasync") == 0)
+		durability.data = true;
+	
+	// sync policy?
+	else if (strncmp(arg, "sync=", 5) == 0) {
+		if (strcmp(arg + 5, "none") == 0)
+			durability.policy = kSyncNone;
+		
+		else if (strcmp(arg + 5, "end") == 0)
+			durability.policy = kSyncEnd;
+		
+		else if (strcmp(arg + 5, "range") == 0)
+			durability.policy = kSyncRange;
+		
+		else if (strcmp(arg + 5, "all") == 0)
+			syncSweep = true;
+		
+		else if ((durability.interval = (size_t) ParseVolume(arg + 5)) != 0)
+			durability.policy = kSyncEvery;
+		
+		else {
+			fprintf(stderr, "warning: option sync= needs one of: none, end, range, all, or a byte count\n");
+			durability.interval = kSyncDefaultInterval;
+			}
+		}
+	
+	// stream buffer size?
+	else if (strncmp(arg, "buffer=", 7) == 0) {
+		if ((options.buffering.size = (size_t) ParseVolume(arg + 7)) == 0)
+			fprintf(stderr, "warning: option buffer=#### needs a byte count\n");
+		
+		else if (options.buffering.policy == kBufferingDefault)
+			options.buffering.policy = kBufferingFull;
+		}
+	
+	// stream buffering policy?
+	else if (strncmp(arg, "buffering=", 10) == 0) {
+		if ((options.buffering.policy = ParseBuffering(arg + 10)) == kBufferingDefault)
+			fprintf(stderr, "warning: option buffering= needs one of: full, line, none\n");
+		}
+	
+	// codecvt facet?
+	else if (strncmp(arg, "facet=", 6) == 0) {
+		if (strcmp(arg + 6, "standard") == 0)
+			options.facet = kFacetStandard;
+		
+		else if (strcmp(arg + 6, "project") == 0)
+			options.facet = kFacetProject;
+		
+		else
+			fprintf(stderr, "warning: option facet= needs one of: standard, project\n");
+		}
+	
+	// buffer sweep?
+	else if (strcmp(arg, "sweep") == 0)
+		sweep = true;
+	
+	// shared output from threads?
+	else if (strncmp(arg, "threads=", 8) == 0) {
+		if ((threads = strtoul(arg + 8, NULL, 10)) == 0)
+			fprintf(stderr, "warning: option threads=#### needs a number of threads\n");
+		}
+	
+	// performance counters?
+	else if (strcmp(arg, "counters") == 0)
+		count = true;
+	
+	// system calls?
+	else if (strcmp(arg, "syscalls") == 0)
+		countSyscalls = true;
+	
+	// readback limit?
+	else if (strncmp(arg, "dump=", 5) == 0) {
+		if ((dumpLimit = ParseVolume(arg + 5)) == 0)
+			fprintf(stderr, "warning: option dump=#### needs a byte count\n");
+		}
+	
+	// compare output?
+	else if (strncmp(arg, "verify", 6) == 0) {
+		if (arg[6] == '=')
+			expected = arg + 7;
+		
+		else if (arg[6] != '\0')
+			fprintf(stderr, "warning: unexpected option: \"%s\"\n", arg);
+		
+		verify = true;
+		}
+	
+	// check that output is well-formed?
+	else if (strcmp(arg, "validate") == 0)
+		validate = true;
+	
+	else if (strcmp(arg, "validate=inline") == 0)
+		validateInline = true;
+	
+	else if (strcmp(arg, "validate=splits") == 0)
+		validate = validateSplits = true;
+	
 	else
 		fprintf(stderr, "warning: unexpected option: \"%s\"\n", arg);
 
-// run test
-if (Test(standardOutput, method, mode, codePage, locale)) return -1;
-
-// test output to file?
-if (!standardOutput) {
-	/* Remember to open in 'binary' mode or we get CR/LF conversion.
-	   We're _assuming_ nothing else funky is happening in binary mode;
-	   to be completely sure we could memory-map the file in. */
-	FILE *const file = fopen(gFileName, "rb");
-	if (!file) {
-		fprintf(stderr, "can't open output file for reading\n");
-		return -1;
+#ifdef _WIN32
+/* the console converts to its code page itself */
+const bool exportCodePage = false;
+#else
+const bool exportCodePage = codePage && !gModeIsWide[mode] && !IsCodeUnitMode(mode);
+#endif
+
+// sample to write
+struct Sample sample = gDefaultSample;
+char *exported = NULL;
+if (
+	(input && (
+		OpenSampleFile(&sample, input) ||
+		((gModeIsWide[mode] || exportCodePage) && DecodeSampleWide(&sample)) ||
+		(mode == kModeChar16 && DecodeSampleUnits(&sample, sizeof(char16_t))) ||
+		(mode == kModeChar32 && DecodeSampleUnits(&sample, sizeof(char32_t)))
+		)) ||
+	(exportCodePage && ExportSample(codePage, &sample, benchVolume != 0, &exported))
+	) {
+	free(exported);
+	CloseSample(&sample);
+	return -1;
+	}
+
+// the terminal takes the place of the file
+if (pty && !standardOutput) {
+	fprintf(stderr, "warning: 'pty' replaces 'file'\n");
+	standardOutput = true;
+	}
+
+// sweep?
+if (sweep && pty)
+	fprintf(stderr, "warning: 'sweep' writes to the file, not the terminal\n");
+
+if (sweep) {
+	const bool failed = Sweep(standardOutput, method, mode, codePage, locale, &sample, benchVolume ? benchVolume : kSweepDefaultVolume, options);
+	free(exported);
+	CloseSample(&sample);
+	return failed ? -1 : 0;
+	}
+
+// shared output from threads?
+if (threads) {
+	bool failed = false;
+	switch (method) {
+		case kMethodCUnformatted:
+		case kMethodCFormatted:
+		case kMethodCPPUnformatted:
+		case kMethodCPPFormatted:
+			break;
+		
+		default:
+			fprintf(stderr, "error: threads applies only to the unformatted, formatted, unformatted++ and formatted++ methods\n");
+			failed = true;
+		}
+	
+	/* The table goes to standard output */
+	if (!failed && (standardOutput || pty)) {
+		fprintf(stderr, "error: threads requires the 'file' option\n");
+		failed = true;
 		}
 	
-	// print each byte in the file as hexadecimal
-	for (int c; (c = fgetc(file)) != EOF;) printf("%02x ", c);
-	fputc('\n', stdout);
+	if (!failed && (latencyWrites || validateInline))
+		fprintf(stderr, "warning: 'latency' and 'validate=inline' don't apply to threads\n");
+	
+	if (!failed)
+		failed = MeasureThreads(
+			method == kMethodCFormatted || method == kMethodCPPFormatted,
+			method == kMethodCPPUnformatted || method == kMethodCPPFormatted,
+			mode, &sample, threads, benchVolume ? benchVolume : kSweepDefaultVolume, &options.buffering
+			);
+	
+	free(exported);
+	CloseSample(&sample);
+	return failed ? -1 : 0;
+	}
+
+// durable output file?
+const bool durable = IsDurable(&durability);
+if ((durable || syncSweep) && (!gMethodWritesOutputFile[method] || standardOutput)) {
+	fprintf(stderr, "error: fallocate, direct and sync= apply only to the posix, simd, iconv and batch methods, with the 'file' option\n");
+	free(exported);
+	CloseSample(&sample);
+	return -1;
+	}
+
+if (syncSweep) {
+	const bool failed = SweepDurability(method, mode, codePage, locale, &sample, benchVolume ? benchVolume : kSweepDefaultVolume, &options, durability);
+	free(exported);
+	CloseSample(&sample);
+	return failed ? -1 : 0;
+	}
+
+// number of times to write the sample
+const bool bench = benchVolume != 0;
+const size_t repeat = bench ? GetRepeat(&sample, mode, benchVolume) : latencyWrites ? (size_t) latencyWrites : 1;
+durability.expected = GetOutputBytes(&sample, mode, repeat);
+
+// write to a pseudo-terminal?
+/* what it receives is only kept if it will be read back */
+struct Terminal terminal;
+const bool capture = pty && ((!bench && !latencyWrites) || dumpLimit || verify || validate);
+if (pty && OpenTerminal(&terminal, capture ? gFileName : NULL)) {
+	free(exported);
+	CloseSample(&sample);
+	return -1;
+	}
+
+// count events, if this process may
+struct Counters counters;
+const bool counting = count && !OpenCounters(&counters);
+
+// count system calls, if the interposer is loaded
+const bool countingSyscalls = countSyscalls && !OpenSyscallCounts();
+if (countingSyscalls) ResetSyscallCounts();
+
+// time each write?
+static struct Histogram latency;
+if (latencyWrites) StartLatency(&latency);
+
+// check each buffer before it is written?
+enum Encoding validated;
+bool withMark;
+if (
+	!GetWrittenEncoding(method, mode, locale, &validated, &withMark) &&
+	((verify && !expected) || validate || validateInline)
+	) {
+	fprintf(stderr, "info: %s %s writes the multibyte characters of a locale that isn't known to be UTF-8; not verifying or validating it\n",
+		gMethodNames[method], gModeNames[mode]
+		);
+	verify = verify && expected;
+	validate = validateInline = false;
+	}
+
+struct Validator validator;
+if (validateInline) {
+	StartValidator(&validator, validated);
+	StartInlineValidation(&validator);
+	}
+
+// make the output file durable?
+struct DurableStatistics durableStatistics;
+if (durable) StartDurability(&durability);
+
+// run test
+double elapsed, setup, teardown;
+const double started = Now();
+bool failed = Test(standardOutput, method, mode, codePage, locale, &sample, repeat, &options, counting ? &counters : NULL, &elapsed, &setup, &teardown);
+const double finished = Now();
+if (countingSyscalls) TakeSyscallCounts();
+if (latencyWrites) StopLatency();
+if (durable) StopDurability(&durableStatistics);
+if (validateInline) {
+	StopInlineValidation();
+	if (!failed || validator.failed) failed |= ReportInlineValidation(&validator, &sample, mode, bench ? elapsed : 0);
+	}
+if (pty) {
+	failed |= CloseTerminal(&terminal);
+	if (!failed) ReportTerminal(&terminal, gMethodNames[method], gModeNames[mode], started, finished);
+	}
+if (!failed && bench) ReportBenchmark(method, mode, &sample, repeat, elapsed, setup, teardown);
+if (!failed) ReportStartup(entered, finished - teardown - elapsed, finished);
+if (!failed && latencyWrites) ReportLatency(&latency, gMethodNames[method], gModeNames[mode]);
+if (!failed && durable) ReportDurability(&durability, &durableStatistics, gMethodNames[method], gModeNames[mode], elapsed);
+if (counting) {
+	if (!failed)
+		ReportCounters(
+			&counters, gMethodNames[method], gModeNames[mode],
+			(unsigned long long) repeat * GetSampleBytes(&sample, mode)
+			);
+	
+	CloseCounters(&counters);
+	}
+if (countingSyscalls && !failed)
+	ReportSyscallCounts(gMethodNames[method], gModeNames[mode], repeat * CountLines(&sample, mode));
+if (failed) {
+	free(exported);
+	CloseSample(&sample);
+	return -1;
+	}
+
+// read back output file?
+/* Dumping a benchmark's worth of output isn't useful, unless asked for a part of it */
+bool readbackFailed = false;
+if (!standardOutput || capture) {
+	if ((!bench && !latencyWrites) || dumpLimit)
+		readbackFailed |= DumpFile(gFileName, dumpLimit ? dumpLimit : ~0ull);
 	
-	fclose(file);
+	if (verify)
+		readbackFailed |=
+			expected ? VerifyFile(gFileName, expected) :
+			VerifyFileWithSample(gFileName, &sample, mode, validated, !standardOutput && withMark, repeat);
+	
+	if (validate)
+		readbackFailed |= ValidateFile(gFileName, validated, !standardOutput && withMark, validateSplits);
 	}
 
-return 0;
+else if (verify || validate || dumpLimit)
+	fprintf(stderr, "warning: dump, verify and validate need the 'file' or 'pty' option\n");
+
+free(exported);
+CloseSample(&sample);
+
+return readbackFailed ? -1 : 0;
 }